@@ -0,0 +1,423 @@
+/**
+ * @file bench.cpp
+ * @brief 周期処理と射撃判定のベンチマーク、nativeビルドで動かす
+ *
+ * pio run -e native-bench -t exec で実行し、結果をbench_results.json(引数で変更可)に書き出す。
+ * まとの数毎に、1回あたりのPC上での処理時間、ヒープ確保回数、シミュレーションのI2Cバスに流れたバイト数と
+ * バスの所要時間を測る。バスの所要時間は実機でI2C通信にかかる時間の見積もりになる。
+ * sweep_flush_*は、赤外線受信モジュールの走査とLEDの送信を別々のスレッドで同時に行い、
+ * LEDを同じバスに繋いだ場合とWire1に分けた場合とで、両方が終わるまでの実時間を比べる。
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <alloc_counter.hpp>
+#include <hal.hpp>
+#include <hal_sim.hpp>
+#include <i2c_bus.hpp>
+#include <ht16k33LED.hpp>
+#include <ht16k33Animator.hpp>
+#include "GunColor.hpp"
+#include "Targets.hpp"
+
+static void on_init();
+static void on_receive_ir(int target_id, bool is_alive);
+static void on_not_receive_ir(int target_id, bool is_alive);
+static void on_hit(int target_id, int gun_id);
+
+// 1つのHT16K33に繋がっているLEDの数
+static constexpr int LED_PER_DISPLAY = 5;
+// HT16K33に使えるアドレスの数(0x70~0x76)、0x77はTCA9548Aに使う
+static constexpr int DISPLAY_NUM = 7;
+// 別々のHT16K33の別々の位置に繋がるLEDの数、これを超えるLEDは前のLEDと同じ位置を共有する
+static constexpr int UNIQUE_LED_NUM = DISPLAY_NUM * LED_PER_DISPLAY;
+static constexpr uint8_t MUX_ADDRESS = 0x77;
+static constexpr int ROUTE_NUM = Targets::MAX_TARGET_NUM / IrReceiver::ID_NUM;
+static constexpr uint16_t HTTP_PORT = 18080;
+// 16個を超える場合はTCA9548Aの先に繋ぐ
+static constexpr int TARGET_NUMS[] = {1, 9, 16, 32, 64};
+static constexpr uint32_t DEFAULT_CLOCK_HZ = 100000;
+static constexpr uint32_t FAST_CLOCK_HZ = 400000;
+
+static Targets targets(on_init, on_receive_ir, on_not_receive_ir, on_hit);
+static std::vector<ht16k33LED::Led> leds;
+static ht16k33LED::Animator animator;
+static hal::sim::IrReceiverDevice ir_devices[Targets::MAX_TARGET_NUM];
+static hal::sim::Ht16k33Device displays[DISPLAY_NUM];
+static hal::sim::Tca9548aDevice mux;
+// 最適化で処理が消されないよう、結果を書き込んでおく
+static volatile int sink = 0;
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Result
+{
+  const char *name;
+  int target_num;
+  uint32_t iterations;
+  double ns_per_op;
+  double allocs_per_op;
+  double i2c_bytes_per_op;
+  double bus_us_per_op;
+};
+
+//! 全てのバスの合計
+hal::sim::SimI2cBus::Stats bus_totals(void)
+{
+  hal::sim::SimI2cBus::Stats totals;
+  for (int i = 0; i < 2; i++)
+  {
+    hal::sim::SimI2cBus::Stats stats = hal::sim::bus(i).stats();
+    totals.transactions += stats.transactions;
+    totals.bytes += stats.bytes;
+    totals.busy_us += stats.busy_us;
+    totals.nacks += stats.nacks;
+  }
+  return totals;
+}
+
+double elapsed_ns(Clock::time_point start, Clock::time_point end)
+{
+  return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+//! 時刻の取得にかかる時間、1回毎に測る場合はこれを引く
+double timer_overhead_ns(void)
+{
+  static double overhead_ns = -1;
+  if (overhead_ns < 0)
+  {
+    constexpr int SAMPLE_NUM = 10000;
+    double total_ns = 0;
+    for (int i = 0; i < SAMPLE_NUM; i++)
+    {
+      Clock::time_point start = Clock::now();
+      total_ns += elapsed_ns(start, Clock::now());
+    }
+    overhead_ns = total_ns / SAMPLE_NUM;
+  }
+  return overhead_ns;
+}
+
+Result make_result(const char *name, int target_num, uint32_t iterations, double total_ns,
+                   uint32_t allocs, const hal::sim::SimI2cBus::Stats &start, const hal::sim::SimI2cBus::Stats &end)
+{
+  Result result;
+  result.name = name;
+  result.target_num = target_num;
+  result.iterations = iterations;
+  result.ns_per_op = total_ns / iterations;
+  result.allocs_per_op = static_cast<double>(allocs) / iterations;
+  result.i2c_bytes_per_op = static_cast<double>(end.bytes - start.bytes) / iterations;
+  result.bus_us_per_op = static_cast<double>(end.busy_us - start.busy_us) / iterations;
+  return result;
+}
+
+//! opをiterations回続けて呼び、まとめて測る
+template <typename Op>
+Result run(const char *name, int target_num, uint32_t iterations, Op op)
+{
+  // キャッシュ等を温めるため、少しだけ空回しする
+  for (uint32_t i = 0; i < iterations / 10; i++)
+  {
+    op(i);
+  }
+  hal::sim::SimI2cBus::Stats bus_start = bus_totals();
+  alloc_counter::Scope alloc_scope;
+  Clock::time_point start = Clock::now();
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    op(i);
+  }
+  Clock::time_point end = Clock::now();
+  return make_result(name, target_num, iterations, elapsed_ns(start, end),
+                     alloc_scope.allocations(), bus_start, bus_totals());
+}
+
+//! 毎回setupで状態を整えてからopを呼び、opの部分だけを測る
+template <typename Setup, typename Op>
+Result run(const char *name, int target_num, uint32_t iterations, Setup setup, Op op)
+{
+  for (uint32_t i = 0; i < iterations / 10; i++)
+  {
+    setup(i);
+    op(i);
+  }
+  double total_ns = 0;
+  uint32_t allocs = 0;
+  hal::sim::SimI2cBus::Stats bus_start;
+  hal::sim::SimI2cBus::Stats bus_end;
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    setup(i);
+    hal::sim::SimI2cBus::Stats before = bus_totals();
+    alloc_counter::Scope alloc_scope;
+    Clock::time_point start = Clock::now();
+    op(i);
+    Clock::time_point end = Clock::now();
+    allocs += alloc_scope.allocations();
+    hal::sim::SimI2cBus::Stats after = bus_totals();
+    total_ns += elapsed_ns(start, end) - timer_overhead_ns();
+    bus_end.bytes += after.bytes - before.bytes;
+    bus_end.busy_us += after.busy_us - before.busy_us;
+  }
+  return make_result(name, target_num, iterations, total_ns, allocs, bus_start, bus_end);
+}
+
+/**
+ * @brief target_num個のまとでTargetsとLEDを初期化する
+ * @param led_bus LEDを繋ぐバス、赤外線受信モジュールは常にバス0に繋ぐ
+ */
+void begin_targets(int target_num, int led_bus = 0)
+{
+  // 16個以下はバスに直接、それより多い場合はTCA9548Aのチャンネル毎に16個ずつ繋ぐ
+  bool uses_mux = (target_num > IrReceiver::ID_NUM);
+  hal::sim::SimI2cBus &bus = hal::sim::bus(0);
+  for (int i = 0; i < IrReceiver::ID_NUM; i++)
+  {
+    IrReceiver receiver(static_cast<uint8_t>(i));
+    if (uses_mux)
+    {
+      bus.detach(receiver.address());
+    }
+    else
+    {
+      bus.attach(receiver.address(), ir_devices[i]);
+    }
+  }
+  i2c_mux::Route routes[ROUTE_NUM];
+  for (uint8_t channel = 0; channel < ROUTE_NUM; channel++)
+  {
+    routes[channel] = uses_mux ? i2c_mux::Route(MUX_ADDRESS, channel) : i2c_mux::Route();
+  }
+  targets.set_ir_routes(routes, uses_mux ? ROUTE_NUM : 0);
+
+  leds.clear();
+  for (int i = 0; i < target_num; i++)
+  {
+    // HT16K33が足りない分のLEDは、前のHT16K33と共有する
+    int display_index = (i / LED_PER_DISPLAY) % DISPLAY_NUM;
+    leds.push_back(ht16k33LED::Led(i % LED_PER_DISPLAY, ht16k33LED::Display::BASE_ADDRESS + display_index, false,
+                                   led_bus));
+  }
+  for (auto &device : ir_devices)
+  {
+    device.set_gun_num(0);
+  }
+  targets.begin(0, target_num, false, 0, HTTP_PORT);
+  targets.set_ir_edge_mode(true);
+  for (auto &led : leds)
+  {
+    led.init();
+  }
+  ht16k33LED::Display::flush_all();
+}
+
+void bench_targets(int target_num, std::vector<Result> &results)
+{
+  begin_targets(target_num);
+  // 何も受信していない時の周期処理
+  results.push_back(run("targets_update", target_num, 2000, [](uint32_t) {
+    targets.update();
+  }));
+
+  // 全てのまとが銃1を受信している状態で撃ち、生存しているまとに1つずつ当てていく
+  // 全て倒したら初期化して、走査し直したところから続ける
+  for (auto &device : ir_devices)
+  {
+    device.set_gun_num(1);
+  }
+  auto revive_all = [target_num](uint32_t i) {
+    if (i % target_num == 0)
+    {
+      hal::sim::dispatch_http(HTTP_PORT, "/init");
+      targets.update();
+    }
+  };
+  results.push_back(run("handle_shoot_hit", target_num, 2000, revive_all, [](uint32_t) {
+    sink = hal::sim::dispatch_http(HTTP_PORT, "/?gun_num=1");
+  }));
+  // どのまとも受信していない銃で撃つ、全てのまとの履歴を調べる
+  hal::sim::dispatch_http(HTTP_PORT, "/init");
+  targets.update();
+  results.push_back(run("handle_shoot_miss", target_num, 2000, [](uint32_t) {
+    sink = hal::sim::dispatch_http(HTTP_PORT, "/?gun_num=2");
+  }));
+
+  // 色を変えて送信するまで、1回で1つのLEDを書き換える
+  // 同じ位置を共有するLEDを続けて書くと、同じ色を書くだけで送信が省かれてしまうので、
+  // まとの数に関係なく、位置が重ならないUNIQUE_LED_NUM個までのLEDを順に書き換える
+  int led_num = (target_num < UNIQUE_LED_NUM) ? target_num : UNIQUE_LED_NUM;
+  results.push_back(run("led_write_color", target_num, 2000, [led_num](uint32_t i) {
+    ht16k33LED::Color color = ((i / led_num) % 2 == 0) ? ht16k33LED::red : ht16k33LED::blue;
+    leds[i % led_num].write_color(color);
+    ht16k33LED::Display::flush_all();
+  }));
+}
+
+/**
+ * @brief 走査(実機の読み取りタスク)とLEDの送信(実機のloop())を、別々のスレッドで同時にiterations回ずつ行う
+ * @param led_bus LEDを繋ぐバス、0なら走査とバスを取り合う
+ * @param clock_hz 両方のバスのクロック
+ *
+ * バスの所要時間を実際に待たせ、両方が終わるまでの実時間を1回あたりに直す。
+ * LEDは毎回全て色を変えるので、全てのHT16K33に送信が発生する。
+ */
+Result run_parallel(const char *name, int target_num, int led_bus, uint32_t clock_hz, uint32_t iterations)
+{
+  for (int bus = 0; bus < i2c_bus::BUS_NUM; bus++)
+  {
+    i2c_bus::begin(bus, -1, -1, clock_hz);
+  }
+  begin_targets(target_num, led_bus);
+  hal::sim::set_real_time(true);
+  std::atomic<bool> is_started{false};
+  // スレッドの生成で確保される分を数えないよう、生成してから計測を始める
+  std::thread sweeper([&is_started, iterations]() {
+    while (!is_started.load())
+    {
+    }
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+      targets.update();
+    }
+  });
+  std::thread flusher([&is_started, iterations, led_bus]() {
+    while (!is_started.load())
+    {
+    }
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+      ht16k33LED::Color color = (i % 2 == 0) ? ht16k33LED::red : ht16k33LED::blue;
+      for (auto &led : leds)
+      {
+        led.write_color(color);
+      }
+      ht16k33LED::Display::flush_all(led_bus);
+    }
+  });
+  hal::sim::SimI2cBus::Stats bus_start = bus_totals();
+  alloc_counter::Scope alloc_scope;
+  Clock::time_point start = Clock::now();
+  is_started.store(true);
+  sweeper.join();
+  flusher.join();
+  Clock::time_point end = Clock::now();
+  Result result = make_result(name, target_num, iterations, elapsed_ns(start, end),
+                              alloc_scope.allocations(), bus_start, bus_totals());
+  hal::sim::set_real_time(false);
+  for (int bus = 0; bus < i2c_bus::BUS_NUM; bus++)
+  {
+    i2c_bus::begin(bus, -1, -1, DEFAULT_CLOCK_HZ);
+  }
+  // 他のケースに影響しないよう、LEDをバス0に戻す
+  begin_targets(target_num);
+  return result;
+}
+
+void write_json(const char *path, const std::vector<Result> &results)
+{
+  FILE *file = fopen(path, "w");
+  if (file == nullptr)
+  {
+    perror(path);
+    return;
+  }
+  const hal::sim::BusTiming &timing = hal::sim::bus(0).timing();
+  fprintf(file, "{\n  \"i2c_clock_hz\": %u,\n  \"i2c_overhead_us\": %u,\n  \"results\": [\n",
+          static_cast<unsigned>(timing.clock_hz), static_cast<unsigned>(timing.overhead_us));
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result &r = results[i];
+    fprintf(file,
+            "    {\"name\": \"%s\", \"targets\": %d, \"iterations\": %u, \"ns_per_op\": %.1f, "
+            "\"allocs_per_op\": %.3f, \"i2c_bytes_per_op\": %.2f, \"bus_us_per_op\": %.1f}%s\n",
+            r.name, r.target_num, static_cast<unsigned>(r.iterations), r.ns_per_op,
+            r.allocs_per_op, r.i2c_bytes_per_op, r.bus_us_per_op, (i + 1 < results.size()) ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  fclose(file);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  const char *path = (argc > 1) ? argv[1] : "bench_results.json";
+  // 1回の処理時間を測るので、バスの所要時間は待たずに時計だけ進める
+  hal::sim::set_real_time(false);
+  hal::sim::SimI2cBus &bus = hal::sim::bus(0);
+  bus.attach_mux(MUX_ADDRESS, mux);
+  for (int i = 0; i < Targets::MAX_TARGET_NUM; i++)
+  {
+    uint8_t channel = static_cast<uint8_t>(i / IrReceiver::ID_NUM);
+    mux.attach(channel, IrReceiver(i % IrReceiver::ID_NUM).address(), ir_devices[i]);
+  }
+  for (size_t i = 0; i < sizeof(displays) / sizeof(displays[0]); i++)
+  {
+    // LEDをWire1に分けるケースのため、HT16K33は両方のバスに繋いでおく
+    bus.attach(ht16k33LED::Display::BASE_ADDRESS + i, displays[i]);
+    hal::sim::bus(1).attach(ht16k33LED::Display::BASE_ADDRESS + i, displays[i]);
+  }
+
+  std::vector<Result> results;
+  results.reserve(32);
+  for (int target_num : TARGET_NUMS)
+  {
+    bench_targets(target_num, results);
+  }
+  results.push_back(run_parallel("sweep_flush_shared_bus", 16, 0, DEFAULT_CLOCK_HZ, 200));
+  results.push_back(run_parallel("sweep_flush_split_bus", 16, 1, DEFAULT_CLOCK_HZ, 200));
+  results.push_back(run_parallel("sweep_flush_split_400k", 16, 1, FAST_CLOCK_HZ, 200));
+  results.push_back(run("gun_id2color", 0, 1000000, [](uint32_t i) {
+    sink = gun_id2color(static_cast<int>(i & 3));
+  }));
+
+  printf("%-24s %7s %12s %10s %10s %10s\n", "name", "targets", "ns/op", "allocs/op", "bytes/op", "bus_us/op");
+  for (const Result &r : results)
+  {
+    printf("%-24s %7d %12.1f %10.3f %10.2f %10.1f\n",
+           r.name, r.target_num, r.ns_per_op, r.allocs_per_op, r.i2c_bytes_per_op, r.bus_us_per_op);
+  }
+  write_json(path, results);
+  printf("results were written to %s\n", path);
+  return 0;
+}
+
+// 演出処理はmain.cppと同じ内容にして、射撃判定の中で呼ばれる分も測る
+static void on_init()
+{
+  animator.stop_all();
+  for (auto &led : leds)
+  {
+    led.clear();
+  }
+}
+
+static void on_receive_ir(int target_id, bool is_alive)
+{
+  if (is_alive)
+  {
+    leds[target_id].write_color(ht16k33LED::red);
+  }
+}
+
+static void on_not_receive_ir(int target_id, bool is_alive)
+{
+  if (is_alive)
+  {
+    leds[target_id].clear();
+  }
+}
+
+static void on_hit(int target_id, int gun_id)
+{
+  ht16k33LED::Color color = gun_id2color(gun_id);
+  animator.blink(leds[target_id], color, 3, 300, color);
+}
@@ -0,0 +1,67 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "alloc_counter.hpp"
+
+#ifdef ALLOC_COUNTER
+static std::atomic<uint32_t> alloc_count(0);
+
+extern "C"
+{
+  void *__real_malloc(size_t size);
+  void *__real_calloc(size_t num, size_t size);
+  void *__real_realloc(void *ptr, size_t size);
+
+  void *__wrap_malloc(size_t size)
+  {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return __real_malloc(size);
+  }
+  void *__wrap_calloc(size_t num, size_t size)
+  {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return __real_calloc(num, size);
+  }
+  void *__wrap_realloc(void *ptr, size_t size)
+  {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return __real_realloc(ptr, size);
+  }
+}
+
+#ifndef ARDUINO
+// nativeビルドでは標準ライブラリが共有ライブラリなので、その中のoperator newが呼ぶmallocは--wrapされない
+// operator newを置き換えて、ここからmallocを呼ぶようにする
+void *operator new(size_t size)
+{
+  void *ptr = malloc((size == 0) ? 1 : size);
+  if (ptr == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+void operator delete(void *ptr) noexcept
+{
+  free(ptr);
+}
+void operator delete[](void *ptr) noexcept
+{
+  free(ptr);
+}
+#endif
+
+uint32_t alloc_counter::count()
+{
+  return alloc_count.load(std::memory_order_relaxed);
+}
+#else
+uint32_t alloc_counter::count()
+{
+  return 0;
+}
+#endif
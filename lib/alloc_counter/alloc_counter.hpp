@@ -0,0 +1,35 @@
+/**
+ * @brief ヒープ確保回数の計測
+ *
+ * ALLOC_COUNTERを定義し、リンカオプションで
+ * -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc を指定した場合のみ計測する。
+ * それ以外の場合、count()は常に0を返す。
+ */
+
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <cstdint>
+
+namespace alloc_counter
+{
+
+//! 計測を始めてからのヒープ確保回数(全タスク合計)
+uint32_t count();
+
+/**
+ * @class Scope
+ * @brief 生成してからのヒープ確保回数を数える
+ */
+class Scope
+{
+public:
+  Scope() : _start(count()) {}
+  uint32_t allocations() const { return count() - _start; }
+
+private:
+  uint32_t _start;
+};
+
+} // namespace alloc_counter
+#endif
@@ -0,0 +1,203 @@
+/**
+ * @brief ハードウェア抽象化層
+ *
+ * I2Cバス、GPIO/DAC、ADC、PWM、時計、HTTPサーバ、UDPと、タスク関係の機能を薄いインタフェースで包む。
+ * 実機ではArduino(ESP32)の実装、nativeビルドではhal_sim.hppのシミュレーション実装が使われる。
+ * どちらを使うかはコンパイル時に決まるので、呼び出し側で切り替える必要は無い。
+ */
+
+#ifndef HAL_HPP
+#define HAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+typedef uint8_t byte;
+#endif
+
+namespace hal
+{
+
+//! IPv4アドレス
+struct IpAddress
+{
+  uint8_t octets[4];
+
+  IpAddress() : octets{0, 0, 0, 0} {}
+  IpAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+};
+
+/**
+ * @class I2cBus
+ * @brief I2Cバス、TwoWireと同じ使い方をする
+ *
+ * 複数のタスクから使う場合は、i2c_bus::Lockで1トランザクションを排他すること。
+ */
+class I2cBus
+{
+public:
+  virtual ~I2cBus() {}
+  virtual void begin(void) = 0;
+  //! ピンとクロックを指定して開始する、Wire1のようにピンが決まっていないバスで使う
+  virtual void begin(int sda, int scl, uint32_t clock_hz) = 0;
+  virtual void begin_transmission(uint8_t address) = 0;
+  virtual size_t write(const uint8_t *data, size_t length) = 0;
+  size_t write(uint8_t data) { return write(&data, 1); }
+  //! @return uint8_t 0:成功, それ以外:失敗
+  virtual uint8_t end_transmission(bool stop = true) = 0;
+  //! @return uint8_t 受信できたバイト数
+  virtual uint8_t request_from(uint8_t address, uint8_t length) = 0;
+  virtual int available(void) = 0;
+  virtual int read(void) = 0;
+  virtual void set_clock(uint32_t hz) = 0;
+};
+
+enum class PinMode
+{
+  input,
+  output
+};
+
+//! GPIOとDAC
+class Gpio
+{
+public:
+  virtual ~Gpio() {}
+  virtual void pin_mode(int pin, PinMode mode) = 0;
+  virtual void digital_write(int pin, bool is_high) = 0;
+  virtual bool digital_read(int pin) = 0;
+  virtual void dac_write(int pin, uint8_t value) = 0;
+};
+
+class Adc
+{
+public:
+  virtual ~Adc() {}
+  virtual int read(int pin) = 0;
+};
+
+//! LEDCのようにチャンネル単位で使うPWM
+class Pwm
+{
+public:
+  virtual ~Pwm() {}
+  virtual void setup(int channel, uint32_t freq_hz, int resolution_bits) = 0;
+  virtual void attach_pin(int pin, int channel) = 0;
+  virtual void write(int channel, uint32_t duty) = 0;
+};
+
+class Clock
+{
+public:
+  virtual ~Clock() {}
+  virtual unsigned long millis(void) = 0;
+  virtual unsigned long micros(void) = 0;
+  virtual void delay_ms(unsigned long ms) = 0;
+  virtual void delay_us(unsigned long us) = 0;
+};
+
+/**
+ * @class HttpServer
+ * @brief GETリクエストを受け付けるHTTPサーバ
+ *
+ * ハンドラはhandle_client()の中から呼ばれ、その中でarg()とsend()を使う。
+ */
+class HttpServer
+{
+public:
+  virtual ~HttpServer() {}
+  virtual void on(const char *path, std::function<void(void)> handler) = 0;
+  virtual void begin(void) = 0;
+  virtual void handle_client(void) = 0;
+  /**
+   * @brief 処理中のリクエストのクエリ引数を取得する
+   * @param name 引数名
+   * @param value 値の格納先、終端文字を含めてsizeに収まらない部分は切り捨てる
+   * @return bool true:引数があった, false:無かった(valueは空文字列になる)
+   */
+  virtual bool arg(const char *name, char *value, size_t size) = 0;
+  virtual void send(int code, const char *content_type, const char *body) = 0;
+};
+
+class UdpSocket
+{
+public:
+  virtual ~UdpSocket() {}
+  virtual bool begin(uint16_t port) = 0;
+  //! 受信したパケットを1つ取り出す、@return int パケットのサイズ、無ければ0
+  virtual int parse_packet(void) = 0;
+  virtual int read(uint8_t *data, size_t size) = 0;
+  virtual IpAddress remote_ip(void) = 0;
+  virtual uint16_t remote_port(void) = 0;
+  virtual bool send_to(const IpAddress &ip, uint16_t port, const uint8_t *data, size_t length) = 0;
+};
+
+//! 一定周期でコールバックを呼ぶタイマ
+class PeriodicTimer
+{
+public:
+  virtual ~PeriodicTimer() {}
+  virtual bool start(uint32_t period_us) = 0;
+  virtual void stop(void) = 0;
+};
+
+class Mutex
+{
+public:
+  virtual ~Mutex() {}
+  virtual void lock(void) = 0;
+  virtual void unlock(void) = 0;
+};
+
+//! 固定サイズの要素を送るタスク間のキュー
+class Queue
+{
+public:
+  virtual ~Queue() {}
+  //! @param timeout_ms 一杯の場合に空くまで待つ時間[ms]
+  virtual bool send(const void *item, uint32_t timeout_ms) = 0;
+  //! @param timeout_ms 空の場合に届くまで待つ時間[ms]
+  virtual bool receive(void *item, uint32_t timeout_ms) = 0;
+  //! 長さ1のキューの中身を置き換える
+  virtual void overwrite(const void *item) = 0;
+};
+
+//! @param bus 0:Wire, 1:Wire1
+I2cBus &i2c(int bus = 0);
+Gpio &gpio(void);
+Adc &adc(void);
+Pwm &pwm(void);
+Clock &clock(void);
+std::unique_ptr<HttpServer> make_http_server(uint16_t port);
+std::unique_ptr<UdpSocket> make_udp_socket(void);
+std::unique_ptr<PeriodicTimer> make_periodic_timer(void (*callback)(void *), void *arg, const char *name);
+std::unique_ptr<Mutex> make_mutex(void);
+std::unique_ptr<Queue> make_queue(size_t length, size_t item_size);
+/**
+ * @brief タスクを作る
+ * @param core 動かすコア、シミュレーションでは無視する
+ * @return bool true:成功, false:失敗
+ */
+bool start_task(void (*func)(void *), void *arg, const char *name,
+                uint32_t stack_size, int priority, int core);
+/**
+ * @brief 固定IPでWiFiに接続する
+ * @return bool true:接続できた, false:timeout_ms以内に接続できなかった
+ */
+bool connect_wifi(const IpAddress &ip, const IpAddress &gateway, const IpAddress &subnet,
+                  const char *ssid, const char *password, unsigned long timeout_ms);
+
+//! min以上max未満の乱数
+long random(long min, long max);
+
+inline unsigned long millis(void) { return clock().millis(); }
+inline unsigned long micros(void) { return clock().micros(); }
+inline void delay(unsigned long ms) { clock().delay_ms(ms); }
+inline void delay_microseconds(unsigned long us) { clock().delay_us(us); }
+
+} // namespace hal
+#endif
@@ -0,0 +1,290 @@
+// 実機(Arduino)用の実装
+#ifdef ARDUINO
+
+#include <cstring>
+#include <Arduino.h>
+#include <Wire.h>
+#include <WebServer.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "hal.hpp"
+
+using namespace hal;
+
+namespace
+{
+
+class ArduinoI2cBus : public I2cBus
+{
+public:
+  explicit ArduinoI2cBus(TwoWire &wire) : _wire(wire) {}
+  void begin(void) override { _wire.begin(); }
+  void begin(int sda, int scl, uint32_t clock_hz) override { _wire.begin(sda, scl, clock_hz); }
+  void begin_transmission(uint8_t address) override { _wire.beginTransmission(address); }
+  size_t write(const uint8_t *data, size_t length) override { return _wire.write(data, length); }
+  uint8_t end_transmission(bool stop) override { return _wire.endTransmission(stop); }
+  uint8_t request_from(uint8_t address, uint8_t length) override { return _wire.requestFrom(address, length); }
+  int available(void) override { return _wire.available(); }
+  int read(void) override { return _wire.read(); }
+  void set_clock(uint32_t hz) override { _wire.setClock(hz); }
+
+private:
+  TwoWire &_wire;
+};
+
+class ArduinoGpio : public Gpio
+{
+public:
+  void pin_mode(int pin, PinMode mode) override { pinMode(pin, (mode == PinMode::output) ? OUTPUT : INPUT); }
+  void digital_write(int pin, bool is_high) override { digitalWrite(pin, is_high ? HIGH : LOW); }
+  bool digital_read(int pin) override { return digitalRead(pin) == HIGH; }
+  void dac_write(int pin, uint8_t value) override { dacWrite(pin, value); }
+};
+
+class ArduinoAdc : public Adc
+{
+public:
+  int read(int pin) override { return analogRead(pin); }
+};
+
+class ArduinoPwm : public Pwm
+{
+public:
+  void setup(int channel, uint32_t freq_hz, int resolution_bits) override { ledcSetup(channel, freq_hz, resolution_bits); }
+  void attach_pin(int pin, int channel) override { ledcAttachPin(pin, channel); }
+  void write(int channel, uint32_t duty) override { ledcWrite(channel, duty); }
+};
+
+class ArduinoClock : public Clock
+{
+public:
+  unsigned long millis(void) override { return ::millis(); }
+  unsigned long micros(void) override { return ::micros(); }
+  void delay_ms(unsigned long ms) override { ::delay(ms); }
+  void delay_us(unsigned long us) override { ::delayMicroseconds(us); }
+};
+
+class ArduinoHttpServer : public HttpServer
+{
+public:
+  explicit ArduinoHttpServer(uint16_t port) : _server(port) {}
+  void on(const char *path, std::function<void(void)> handler) override { _server.on(path, handler); }
+  void begin(void) override { _server.begin(); }
+  void handle_client(void) override { _server.handleClient(); }
+  bool arg(const char *name, char *value, size_t size) override
+  {
+    if (size > 0)
+    {
+      value[0] = '\0';
+    }
+    if (!_server.hasArg(name))
+    {
+      return false;
+    }
+    if (size > 0)
+    {
+      strncpy(value, _server.arg(name).c_str(), size - 1);
+      value[size - 1] = '\0';
+    }
+    return true;
+  }
+  void send(int code, const char *content_type, const char *body) override
+  {
+    // Stringへのコピーでヒープを確保しないようsend_Pを使う
+    _server.send_P(code, content_type, body);
+  }
+
+private:
+  WebServer _server;
+};
+
+class ArduinoUdpSocket : public UdpSocket
+{
+public:
+  bool begin(uint16_t port) override { return _udp.begin(port) == 1; }
+  int parse_packet(void) override { return _udp.parsePacket(); }
+  int read(uint8_t *data, size_t size) override { return _udp.read(data, size); }
+  IpAddress remote_ip(void) override
+  {
+    IPAddress ip = _udp.remoteIP();
+    return IpAddress(ip[0], ip[1], ip[2], ip[3]);
+  }
+  uint16_t remote_port(void) override { return _udp.remotePort(); }
+  bool send_to(const IpAddress &ip, uint16_t port, const uint8_t *data, size_t length) override
+  {
+    if (_udp.beginPacket(IPAddress(ip.octets[0], ip.octets[1], ip.octets[2], ip.octets[3]), port) != 1)
+    {
+      return false;
+    }
+    _udp.write(data, length);
+    return _udp.endPacket() == 1;
+  }
+
+private:
+  WiFiUDP _udp;
+};
+
+class ArduinoPeriodicTimer : public PeriodicTimer
+{
+public:
+  ArduinoPeriodicTimer(void (*callback)(void *), void *arg, const char *name)
+  {
+    esp_timer_create_args_t args = {};
+    args.callback = callback;
+    args.arg = arg;
+    args.name = name;
+    if (esp_timer_create(&args, &_timer) != ESP_OK)
+    {
+      _timer = nullptr;
+    }
+  }
+  ~ArduinoPeriodicTimer()
+  {
+    if (_timer != nullptr)
+    {
+      esp_timer_stop(_timer);
+      esp_timer_delete(_timer);
+    }
+  }
+  bool start(uint32_t period_us) override
+  {
+    return (_timer != nullptr) && (esp_timer_start_periodic(_timer, period_us) == ESP_OK);
+  }
+  void stop(void) override
+  {
+    if (_timer != nullptr)
+    {
+      esp_timer_stop(_timer);
+    }
+  }
+
+private:
+  esp_timer_handle_t _timer = nullptr;
+};
+
+class ArduinoMutex : public Mutex
+{
+public:
+  ArduinoMutex() : _mutex(xSemaphoreCreateMutex()) {}
+  ~ArduinoMutex() { vSemaphoreDelete(_mutex); }
+  void lock(void) override { xSemaphoreTake(_mutex, portMAX_DELAY); }
+  void unlock(void) override { xSemaphoreGive(_mutex); }
+
+private:
+  SemaphoreHandle_t _mutex;
+};
+
+class ArduinoQueue : public Queue
+{
+public:
+  ArduinoQueue(size_t length, size_t item_size) : _queue(xQueueCreate(length, item_size)) {}
+  ~ArduinoQueue() { vQueueDelete(_queue); }
+  bool send(const void *item, uint32_t timeout_ms) override
+  {
+    return xQueueSend(_queue, item, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+  }
+  bool receive(void *item, uint32_t timeout_ms) override
+  {
+    return xQueueReceive(_queue, item, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+  }
+  void overwrite(const void *item) override { xQueueOverwrite(_queue, item); }
+
+private:
+  QueueHandle_t _queue;
+};
+
+} // namespace
+
+I2cBus &hal::i2c(int bus)
+{
+  static ArduinoI2cBus wire(Wire);
+  static ArduinoI2cBus wire1(Wire1);
+  return (bus == 1) ? wire1 : wire;
+}
+
+Gpio &hal::gpio(void)
+{
+  static ArduinoGpio gpio;
+  return gpio;
+}
+
+Adc &hal::adc(void)
+{
+  static ArduinoAdc adc;
+  return adc;
+}
+
+Pwm &hal::pwm(void)
+{
+  static ArduinoPwm pwm;
+  return pwm;
+}
+
+Clock &hal::clock(void)
+{
+  static ArduinoClock clock;
+  return clock;
+}
+
+std::unique_ptr<HttpServer> hal::make_http_server(uint16_t port)
+{
+  return std::unique_ptr<HttpServer>(new ArduinoHttpServer(port));
+}
+
+std::unique_ptr<UdpSocket> hal::make_udp_socket(void)
+{
+  return std::unique_ptr<UdpSocket>(new ArduinoUdpSocket());
+}
+
+std::unique_ptr<PeriodicTimer> hal::make_periodic_timer(void (*callback)(void *), void *arg, const char *name)
+{
+  return std::unique_ptr<PeriodicTimer>(new ArduinoPeriodicTimer(callback, arg, name));
+}
+
+std::unique_ptr<Mutex> hal::make_mutex(void)
+{
+  return std::unique_ptr<Mutex>(new ArduinoMutex());
+}
+
+std::unique_ptr<Queue> hal::make_queue(size_t length, size_t item_size)
+{
+  return std::unique_ptr<Queue>(new ArduinoQueue(length, item_size));
+}
+
+bool hal::start_task(void (*func)(void *), void *arg, const char *name,
+                     uint32_t stack_size, int priority, int core)
+{
+  return xTaskCreatePinnedToCore(func, name, stack_size, arg, priority, nullptr, core) == pdPASS;
+}
+
+long hal::random(long min, long max)
+{
+  return ::random(min, max);
+}
+
+bool hal::connect_wifi(const IpAddress &ip, const IpAddress &gateway, const IpAddress &subnet,
+                       const char *ssid, const char *password, unsigned long timeout_ms)
+{
+  WiFi.mode(WIFI_AP_STA);
+  WiFi.config(IPAddress(ip.octets[0], ip.octets[1], ip.octets[2], ip.octets[3]),
+              IPAddress(gateway.octets[0], gateway.octets[1], gateway.octets[2], gateway.octets[3]),
+              IPAddress(subnet.octets[0], subnet.octets[1], subnet.octets[2], subnet.octets[3]));
+  WiFi.begin(ssid, password);
+  unsigned long start_ms = ::millis();
+  while (WiFi.status() != WL_CONNECTED)
+  {
+    if (::millis() - start_ms > timeout_ms)
+    {
+      return false;
+    }
+    ::delay(500);
+  }
+  return true;
+}
+
+#endif // ARDUINO
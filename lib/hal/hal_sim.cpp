@@ -0,0 +1,864 @@
+// nativeビルド用のシミュレーション実装
+#ifndef ARDUINO
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "hal_sim.hpp"
+
+using namespace hal;
+using namespace hal::sim;
+
+namespace
+{
+
+constexpr int PIN_NUM = 40;
+constexpr int PWM_CHANNEL_NUM = 16;
+// HTTPリクエストを読み終えるまで待つ最大時間
+constexpr int HTTP_RECEIVE_TIMEOUT_MS = 100;
+constexpr size_t HTTP_REQUEST_SIZE = 1024;
+constexpr size_t HTTP_RESPONSE_RESERVE_SIZE = 256;
+constexpr size_t MAX_HTTP_SERVER_NUM = 8;
+constexpr size_t UDP_PACKET_SIZE = 512;
+
+std::atomic<bool> is_real_time{false};
+std::array<std::atomic<int>, PIN_NUM> adc_values{};
+std::array<std::atomic<int>, PIN_NUM> dac_values{};
+std::array<std::atomic<bool>, PIN_NUM> digital_values{};
+std::array<std::atomic<uint32_t>, PWM_CHANNEL_NUM> pwm_duties{};
+
+/**
+ * @brief 起動からの実時間に、バスの所要時間として進めた分を足した時計
+ */
+class SimClock : public Clock
+{
+public:
+  SimClock() : _start(std::chrono::steady_clock::now()) {}
+  unsigned long millis(void) override { return static_cast<unsigned long>(_now_us() / 1000); }
+  unsigned long micros(void) override { return static_cast<unsigned long>(_now_us()); }
+  void delay_ms(unsigned long ms) override { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+  void delay_us(unsigned long us) override { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+  void advance_us(uint64_t us) { _offset_us.fetch_add(us, std::memory_order_relaxed); }
+
+private:
+  std::chrono::steady_clock::time_point _start;
+  std::atomic<uint64_t> _offset_us{0};
+
+  uint64_t _now_us(void) const
+  {
+    auto elapsed = std::chrono::steady_clock::now() - _start;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()) +
+           _offset_us.load(std::memory_order_relaxed);
+  }
+};
+
+SimClock &sim_clock(void)
+{
+  static SimClock clock;
+  return clock;
+}
+
+bool is_valid_pin(int pin)
+{
+  return pin >= 0 && pin < PIN_NUM;
+}
+
+class SimGpio : public Gpio
+{
+public:
+  void pin_mode(int pin, PinMode mode) override
+  {
+    (void)pin;
+    (void)mode;
+  }
+  void digital_write(int pin, bool is_high) override
+  {
+    if (is_valid_pin(pin))
+    {
+      digital_values[pin].store(is_high, std::memory_order_relaxed);
+    }
+  }
+  bool digital_read(int pin) override
+  {
+    return is_valid_pin(pin) && digital_values[pin].load(std::memory_order_relaxed);
+  }
+  void dac_write(int pin, uint8_t value) override
+  {
+    if (is_valid_pin(pin))
+    {
+      dac_values[pin].store(value, std::memory_order_relaxed);
+    }
+  }
+};
+
+class SimAdc : public Adc
+{
+public:
+  int read(int pin) override
+  {
+    return is_valid_pin(pin) ? adc_values[pin].load(std::memory_order_relaxed) : 0;
+  }
+};
+
+class SimPwm : public Pwm
+{
+public:
+  void setup(int channel, uint32_t freq_hz, int resolution_bits) override
+  {
+    (void)channel;
+    (void)freq_hz;
+    (void)resolution_bits;
+  }
+  void attach_pin(int pin, int channel) override
+  {
+    (void)pin;
+    (void)channel;
+  }
+  void write(int channel, uint32_t duty) override
+  {
+    if (channel >= 0 && channel < PWM_CHANNEL_NUM)
+    {
+      pwm_duties[channel].store(duty, std::memory_order_relaxed);
+    }
+  }
+};
+
+class SimHttpServer;
+
+std::mutex http_servers_mutex;
+std::array<std::pair<uint16_t, SimHttpServer *>, MAX_HTTP_SERVER_NUM> http_servers{};
+
+//! dispatch_http()で探せるよう、ポート毎にサーバを覚えておく
+void register_http_server(uint16_t port, SimHttpServer *server)
+{
+  std::lock_guard<std::mutex> lock(http_servers_mutex);
+  // 同じポートのサーバを作り直した場合は新しい方に置き換える
+  for (auto &entry : http_servers)
+  {
+    if (entry.second != nullptr && entry.first == port)
+    {
+      entry.second = server;
+      return;
+    }
+  }
+  for (auto &entry : http_servers)
+  {
+    if (entry.second == nullptr)
+    {
+      entry = std::make_pair(port, server);
+      return;
+    }
+  }
+}
+
+void unregister_http_server(SimHttpServer *server)
+{
+  std::lock_guard<std::mutex> lock(http_servers_mutex);
+  for (auto &entry : http_servers)
+  {
+    if (entry.second == server)
+    {
+      entry.second = nullptr;
+    }
+  }
+}
+
+SimHttpServer *find_http_server(uint16_t port)
+{
+  std::lock_guard<std::mutex> lock(http_servers_mutex);
+  for (const auto &entry : http_servers)
+  {
+    if (entry.second != nullptr && entry.first == port)
+    {
+      return entry.second;
+    }
+  }
+  return nullptr;
+}
+
+//! %XXを元に戻す
+std::string url_decode(const std::string &s)
+{
+  std::string decoded;
+  for (size_t i = 0; i < s.size(); i++)
+  {
+    if (s[i] == '%' && i + 2 < s.size())
+    {
+      decoded += static_cast<char>(strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+      i += 2;
+    }
+    else if (s[i] == '+')
+    {
+      decoded += ' ';
+    }
+    else
+    {
+      decoded += s[i];
+    }
+  }
+  return decoded;
+}
+
+const char *status_text(int code)
+{
+  switch (code)
+  {
+  case 200:
+    return "OK";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "";
+  }
+}
+
+/**
+ * @brief 1回のhandle_client()で1つの接続を処理するHTTP/1.0程度のサーバ
+ */
+class SimHttpServer : public HttpServer
+{
+public:
+  explicit SimHttpServer(uint16_t port) : _port(port)
+  {
+    // 処理の度に確保しないよう、応答の置き場所は先に確保しておく
+    _response_body.reserve(HTTP_RESPONSE_RESERVE_SIZE);
+    register_http_server(port, this);
+  }
+  ~SimHttpServer()
+  {
+    unregister_http_server(this);
+    if (_listen_fd >= 0)
+    {
+      close(_listen_fd);
+    }
+  }
+  void on(const char *path, std::function<void(void)> handler) override
+  {
+    _handlers.push_back(std::make_pair(std::string(path), handler));
+  }
+  void begin(void) override
+  {
+    _listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listen_fd < 0)
+    {
+      perror("http socket");
+      return;
+    }
+    int yes = 1;
+    setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(_port);
+    if (bind(_listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(_listen_fd, 16) != 0)
+    {
+      perror("http bind");
+      close(_listen_fd);
+      _listen_fd = -1;
+      return;
+    }
+    fcntl(_listen_fd, F_SETFL, fcntl(_listen_fd, F_GETFL, 0) | O_NONBLOCK);
+  }
+  void handle_client(void) override
+  {
+    if (_listen_fd < 0)
+    {
+      return;
+    }
+    _client_fd = accept(_listen_fd, nullptr, nullptr);
+    if (_client_fd < 0)
+    {
+      return;
+    }
+    timeval timeout = {0, HTTP_RECEIVE_TIMEOUT_MS * 1000};
+    setsockopt(_client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::string target;
+    if (_receive_request(target))
+    {
+      _set_target(target.c_str());
+      _run_handler();
+    }
+    close(_client_fd);
+    _client_fd = -1;
+  }
+  //! ソケットを通さずにリクエストを処理する
+  int dispatch(const char *target, const char **body)
+  {
+    _set_target(target);
+    _run_handler();
+    if (body != nullptr)
+    {
+      *body = _response_body.c_str();
+    }
+    return _response_code;
+  }
+  bool arg(const char *name, char *value, size_t size) override
+  {
+    if (size > 0)
+    {
+      value[0] = '\0';
+    }
+    std::string key = std::string(name) + "=";
+    size_t begin = 0;
+    while (begin <= _query.size())
+    {
+      size_t end = _query.find('&', begin);
+      if (end == std::string::npos)
+      {
+        end = _query.size();
+      }
+      if (_query.compare(begin, key.size(), key) == 0)
+      {
+        std::string decoded = url_decode(_query.substr(begin + key.size(), end - begin - key.size()));
+        if (size > 0)
+        {
+          strncpy(value, decoded.c_str(), size - 1);
+          value[size - 1] = '\0';
+        }
+        return true;
+      }
+      begin = end + 1;
+    }
+    return false;
+  }
+  void send(int code, const char *content_type, const char *body) override
+  {
+    if (_is_sent)
+    {
+      return;
+    }
+    _is_sent = true;
+    _response_code = code;
+    if (_client_fd < 0)
+    {
+      // dispatch()から呼ばれた場合は、応答を覚えておくだけ
+      _response_body.assign(body);
+      return;
+    }
+    char header[256];
+    size_t body_length = strlen(body);
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                                 code, status_text(code), content_type, body_length);
+    ::send(_client_fd, header, header_length, MSG_NOSIGNAL);
+    ::send(_client_fd, body, body_length, MSG_NOSIGNAL);
+  }
+
+private:
+  uint16_t _port;
+  int _listen_fd = -1;
+  int _client_fd = -1;
+  bool _is_sent = false;
+  int _response_code = 0;
+  std::string _response_body;
+  std::string _path;
+  std::string _query;
+  std::vector<std::pair<std::string, std::function<void(void)>>> _handlers;
+
+  //! "/path?query"をパスとクエリに分ける
+  void _set_target(const char *target)
+  {
+    const char *query = strchr(target, '?');
+    if (query == nullptr)
+    {
+      _path.assign(target);
+      _query.clear();
+    }
+    else
+    {
+      _path.assign(target, query - target);
+      _query.assign(query + 1);
+    }
+  }
+  void _run_handler(void)
+  {
+    _is_sent = false;
+    for (const auto &handler : _handlers)
+    {
+      if (handler.first == _path)
+      {
+        handler.second();
+        break;
+      }
+    }
+    if (!_is_sent)
+    {
+      send(404, "text/plain", "Not found");
+    }
+  }
+  //! リクエスト行を読み、"/path?query"の部分を取り出す
+  bool _receive_request(std::string &target)
+  {
+    std::string request;
+    char buf[256];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < HTTP_REQUEST_SIZE)
+    {
+      ssize_t length = recv(_client_fd, buf, sizeof(buf), 0);
+      if (length <= 0)
+      {
+        break;
+      }
+      request.append(buf, length);
+    }
+    // GET /path?query HTTP/1.1
+    size_t method_end = request.find(' ');
+    size_t target_end = request.find(' ', method_end + 1);
+    if (method_end == std::string::npos || target_end == std::string::npos)
+    {
+      return false;
+    }
+    target = request.substr(method_end + 1, target_end - method_end - 1);
+    return true;
+  }
+};
+
+class SimUdpSocket : public UdpSocket
+{
+public:
+  ~SimUdpSocket()
+  {
+    if (_fd >= 0)
+    {
+      close(_fd);
+    }
+  }
+  bool begin(uint16_t port) override
+  {
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (_fd < 0)
+    {
+      return false;
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+      close(_fd);
+      _fd = -1;
+      return false;
+    }
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+    return true;
+  }
+  int parse_packet(void) override
+  {
+    if (_fd < 0)
+    {
+      return 0;
+    }
+    socklen_t remote_length = sizeof(_remote);
+    ssize_t length = recvfrom(_fd, _packet.data(), _packet.size(), 0,
+                              reinterpret_cast<sockaddr *>(&_remote), &remote_length);
+    _packet_length = (length > 0) ? static_cast<size_t>(length) : 0;
+    _read_index = 0;
+    return static_cast<int>(_packet_length);
+  }
+  int read(uint8_t *data, size_t size) override
+  {
+    size_t length = std::min(size, _packet_length - _read_index);
+    memcpy(data, _packet.data() + _read_index, length);
+    _read_index += length;
+    return static_cast<int>(length);
+  }
+  IpAddress remote_ip(void) override
+  {
+    uint32_t ip = ntohl(_remote.sin_addr.s_addr);
+    return IpAddress(ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+  }
+  uint16_t remote_port(void) override { return ntohs(_remote.sin_port); }
+  bool send_to(const IpAddress &ip, uint16_t port, const uint8_t *data, size_t length) override
+  {
+    if (_fd < 0)
+    {
+      return false;
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl((static_cast<uint32_t>(ip.octets[0]) << 24) | (ip.octets[1] << 16) |
+                                 (ip.octets[2] << 8) | ip.octets[3]);
+    addr.sin_port = htons(port);
+    return sendto(_fd, data, length, 0, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ==
+           static_cast<ssize_t>(length);
+  }
+
+private:
+  int _fd = -1;
+  sockaddr_in _remote = {};
+  std::array<uint8_t, UDP_PACKET_SIZE> _packet{};
+  size_t _packet_length = 0;
+  size_t _read_index = 0;
+};
+
+class SimPeriodicTimer : public PeriodicTimer
+{
+public:
+  SimPeriodicTimer(void (*callback)(void *), void *arg) : _callback(callback), _arg(arg) {}
+  ~SimPeriodicTimer() { stop(); }
+  bool start(uint32_t period_us) override
+  {
+    if (_thread.joinable())
+    {
+      return false;
+    }
+    _is_running = true;
+    _thread = std::thread([this, period_us]() {
+      auto next = std::chrono::steady_clock::now();
+      while (_is_running)
+      {
+        next += std::chrono::microseconds(period_us);
+        std::this_thread::sleep_until(next);
+        _callback(_arg);
+      }
+    });
+    return true;
+  }
+  void stop(void) override
+  {
+    _is_running = false;
+    if (_thread.joinable())
+    {
+      _thread.join();
+    }
+  }
+
+private:
+  void (*_callback)(void *);
+  void *_arg;
+  std::atomic<bool> _is_running{false};
+  std::thread _thread;
+};
+
+class SimMutex : public Mutex
+{
+public:
+  void lock(void) override { _mutex.lock(); }
+  void unlock(void) override { _mutex.unlock(); }
+
+private:
+  std::mutex _mutex;
+};
+
+class SimQueue : public Queue
+{
+public:
+  SimQueue(size_t length, size_t item_size) : _length(length), _item_size(item_size) {}
+  bool send(const void *item, uint32_t timeout_ms) override
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_not_full.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                            [this]() { return _items.size() < _length; }))
+    {
+      return false;
+    }
+    _push(item);
+    return true;
+  }
+  bool receive(void *item, uint32_t timeout_ms) override
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_not_empty.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                             [this]() { return !_items.empty(); }))
+    {
+      return false;
+    }
+    memcpy(item, _items.front().data(), _item_size);
+    _items.pop_front();
+    _not_full.notify_one();
+    return true;
+  }
+  void overwrite(const void *item) override
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _items.clear();
+    _push(item);
+  }
+
+private:
+  size_t _length;
+  size_t _item_size;
+  std::deque<std::vector<uint8_t>> _items;
+  std::mutex _mutex;
+  std::condition_variable _not_empty;
+  std::condition_variable _not_full;
+
+  void _push(const void *item)
+  {
+    const uint8_t *bytes = static_cast<const uint8_t *>(item);
+    _items.push_back(std::vector<uint8_t>(bytes, bytes + _item_size));
+    _not_empty.notify_one();
+  }
+};
+
+} // namespace
+
+SimI2cBus::Stats SimI2cBus::stats(void) const
+{
+  Stats stats;
+  stats.transactions = _transactions.load(std::memory_order_relaxed);
+  stats.bytes = _bytes.load(std::memory_order_relaxed);
+  stats.busy_us = _busy_us.load(std::memory_order_relaxed);
+  stats.nacks = _nacks.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void SimI2cBus::reset_stats(void)
+{
+  _transactions = 0;
+  _bytes = 0;
+  _busy_us = 0;
+  _nacks = 0;
+}
+
+void SimI2cBus::begin_transmission(uint8_t address)
+{
+  _tx_address = address;
+  _tx_length = 0;
+}
+
+size_t SimI2cBus::write(const uint8_t *data, size_t length)
+{
+  size_t writable = std::min(length, BUFFER_SIZE - _tx_length);
+  memcpy(_tx_buffer.data() + _tx_length, data, writable);
+  _tx_length += writable;
+  return writable;
+}
+
+uint8_t SimI2cBus::end_transmission(bool stop)
+{
+  (void)stop;
+  I2cDevice *device = _find(_tx_address);
+  if (device == nullptr)
+  {
+    // アドレスでNACKが返るので、アドレスの1バイトだけ流れる
+    _elapse(1);
+    _nacks++;
+    return 2;
+  }
+  _elapse(1 + _tx_length);
+  if (!device->on_write(_tx_buffer.data(), _tx_length))
+  {
+    _nacks++;
+    return 3;
+  }
+  return 0;
+}
+
+uint8_t SimI2cBus::request_from(uint8_t address, uint8_t length)
+{
+  _rx_length = 0;
+  _rx_index = 0;
+  I2cDevice *device = _find(address);
+  if (device == nullptr)
+  {
+    _elapse(1);
+    _nacks++;
+    return 0;
+  }
+  size_t readable = (length < BUFFER_SIZE) ? length : BUFFER_SIZE;
+  _rx_length = device->on_read(_rx_buffer.data(), readable);
+  // スレーブが返さなかった分もマスタはクロックを出して読むので、要求したバイト数で見積もる
+  _elapse(1 + length);
+  return static_cast<uint8_t>(_rx_length);
+}
+
+int SimI2cBus::available(void)
+{
+  return static_cast<int>(_rx_length - _rx_index);
+}
+
+int SimI2cBus::read(void)
+{
+  return (_rx_index < _rx_length) ? _rx_buffer[_rx_index++] : -1;
+}
+
+void SimI2cBus::attach_mux(uint8_t address, Tca9548aDevice &mux)
+{
+  attach(address, mux);
+  _muxes.push_back(&mux);
+}
+
+I2cDevice *SimI2cBus::_find(uint8_t address) const
+{
+  I2cDevice *device = _devices[address % ADDRESS_NUM];
+  // 複数のチャンネルに同じアドレスがあると実機では衝突するが、ここでは最初に見つかったものを返す
+  for (size_t i = 0; device == nullptr && i < _muxes.size(); i++)
+  {
+    device = _muxes[i]->downstream(address);
+  }
+  return device;
+}
+
+void SimI2cBus::_elapse(size_t bytes)
+{
+  // 1バイトあたりデータ8bit + ACK 1bit、スタートとストップで2bit分
+  uint64_t bits = 9 * bytes + 2;
+  uint64_t us = _timing.overhead_us + (bits * 1000000 + _timing.clock_hz - 1) / _timing.clock_hz;
+  _transactions++;
+  _bytes += bytes;
+  _busy_us += us;
+  if (is_real_time.load(std::memory_order_relaxed))
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+  }
+  else
+  {
+    sim_clock().advance_us(us);
+  }
+}
+
+int hal::sim::dispatch_http(uint16_t port, const char *target, const char **body)
+{
+  SimHttpServer *server = find_http_server(port);
+  if (server == nullptr)
+  {
+    return 0;
+  }
+  return server->dispatch(target, body);
+}
+
+SimI2cBus &hal::sim::bus(int index)
+{
+  static SimI2cBus buses[2];
+  return buses[(index == 1) ? 1 : 0];
+}
+
+void hal::sim::set_real_time(bool real_time)
+{
+  is_real_time = real_time;
+}
+
+void hal::sim::set_adc(int pin, int value)
+{
+  if (is_valid_pin(pin))
+  {
+    adc_values[pin].store(value, std::memory_order_relaxed);
+  }
+}
+
+int hal::sim::dac(int pin)
+{
+  return is_valid_pin(pin) ? dac_values[pin].load(std::memory_order_relaxed) : 0;
+}
+
+bool hal::sim::digital(int pin)
+{
+  return is_valid_pin(pin) && digital_values[pin].load(std::memory_order_relaxed);
+}
+
+uint32_t hal::sim::pwm_duty(int channel)
+{
+  return (channel >= 0 && channel < PWM_CHANNEL_NUM) ? pwm_duties[channel].load(std::memory_order_relaxed) : 0;
+}
+
+I2cBus &hal::i2c(int bus)
+{
+  return sim::bus(bus);
+}
+
+Gpio &hal::gpio(void)
+{
+  static SimGpio gpio;
+  return gpio;
+}
+
+Adc &hal::adc(void)
+{
+  static SimAdc adc;
+  return adc;
+}
+
+Pwm &hal::pwm(void)
+{
+  static SimPwm pwm;
+  return pwm;
+}
+
+Clock &hal::clock(void)
+{
+  return sim_clock();
+}
+
+std::unique_ptr<HttpServer> hal::make_http_server(uint16_t port)
+{
+  return std::unique_ptr<HttpServer>(new SimHttpServer(port));
+}
+
+std::unique_ptr<UdpSocket> hal::make_udp_socket(void)
+{
+  return std::unique_ptr<UdpSocket>(new SimUdpSocket());
+}
+
+std::unique_ptr<PeriodicTimer> hal::make_periodic_timer(void (*callback)(void *), void *arg, const char *name)
+{
+  (void)name;
+  return std::unique_ptr<PeriodicTimer>(new SimPeriodicTimer(callback, arg));
+}
+
+std::unique_ptr<Mutex> hal::make_mutex(void)
+{
+  return std::unique_ptr<Mutex>(new SimMutex());
+}
+
+std::unique_ptr<Queue> hal::make_queue(size_t length, size_t item_size)
+{
+  return std::unique_ptr<Queue>(new SimQueue(length, item_size));
+}
+
+bool hal::start_task(void (*func)(void *), void *arg, const char *name,
+                     uint32_t stack_size, int priority, int core)
+{
+  (void)name;
+  (void)stack_size;
+  (void)priority;
+  (void)core;
+  std::thread(func, arg).detach();
+  return true;
+}
+
+long hal::random(long min, long max)
+{
+  if (max <= min)
+  {
+    return min;
+  }
+  static std::mt19937 engine(std::random_device{}());
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  return std::uniform_int_distribution<long>(min, max - 1)(engine);
+}
+
+bool hal::connect_wifi(const IpAddress &ip, const IpAddress &gateway, const IpAddress &subnet,
+                       const char *ssid, const char *password, unsigned long timeout_ms)
+{
+  // ホストのネットワークをそのまま使う
+  (void)ip;
+  (void)gateway;
+  (void)subnet;
+  (void)ssid;
+  (void)password;
+  (void)timeout_ms;
+  return true;
+}
+
+#endif // ARDUINO
@@ -0,0 +1,270 @@
+/**
+ * @brief ハードウェア抽象化層のシミュレーション実装(nativeビルド用)
+ *
+ * I2Cバスには、アドレス毎にI2cDeviceを繋いで応答させる。トランザクション毎に
+ * バスのクロックとビット数から実機での所要時間を見積もり、時計を進める。
+ * HTTPサーバとUDPはPOSIXソケットで実際に待ち受けるので、ホストから実機と同じように通信できる。
+ */
+
+#ifndef HAL_SIM_HPP
+#define HAL_SIM_HPP
+
+#ifndef ARDUINO
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "hal.hpp"
+
+namespace hal
+{
+namespace sim
+{
+
+//! I2Cバスのタイミング
+struct BusTiming
+{
+  uint32_t clock_hz = 100000; // SCLの周波数
+  uint32_t overhead_us = 25;  // 1トランザクション毎にかかるドライバ処理などの時間
+};
+
+/**
+ * @class I2cDevice
+ * @brief シミュレーションのバスに繋ぐI2Cスレーブ
+ */
+class I2cDevice
+{
+public:
+  virtual ~I2cDevice() {}
+  //! @return bool true:ACK, false:NACK
+  virtual bool on_write(const uint8_t *data, size_t length)
+  {
+    (void)data;
+    (void)length;
+    return true;
+  }
+  //! @return size_t 返したバイト数
+  virtual size_t on_read(uint8_t *data, size_t length)
+  {
+    (void)data;
+    (void)length;
+    return 0;
+  }
+};
+
+class Tca9548aDevice;
+
+/**
+ * @class SimI2cBus
+ * @brief I2Cバスのシミュレーション
+ */
+class SimI2cBus : public I2cBus
+{
+public:
+  static constexpr size_t ADDRESS_NUM = 128;
+  static constexpr size_t BUFFER_SIZE = 128;
+
+  struct Stats
+  {
+    uint64_t transactions = 0;
+    uint64_t bytes = 0;   // アドレスを含めてバス上を流れたバイト数
+    uint64_t busy_us = 0; // 見積もった所要時間の合計
+    uint64_t nacks = 0;
+  };
+
+  void attach(uint8_t address, I2cDevice &device) { _devices[address % ADDRESS_NUM] = &device; }
+  void detach(uint8_t address) { _devices[address % ADDRESS_NUM] = nullptr; }
+  /**
+   * @brief マルチプレクサを繋ぐ
+   *
+   * バスに直接繋がっているデバイスが無いアドレスは、開いているチャンネルの先から探す。
+   */
+  void attach_mux(uint8_t address, Tca9548aDevice &mux);
+  void set_timing(const BusTiming &timing) { _timing = timing; }
+  const BusTiming &timing(void) const { return _timing; }
+  Stats stats(void) const;
+  void reset_stats(void);
+
+  void begin(void) override {}
+  void begin(int sda, int scl, uint32_t clock_hz) override
+  {
+    (void)sda;
+    (void)scl;
+    set_clock(clock_hz);
+  }
+  void begin_transmission(uint8_t address) override;
+  size_t write(const uint8_t *data, size_t length) override;
+  uint8_t end_transmission(bool stop = true) override;
+  uint8_t request_from(uint8_t address, uint8_t length) override;
+  int available(void) override;
+  int read(void) override;
+  void set_clock(uint32_t hz) override { _timing.clock_hz = hz; }
+
+private:
+  std::array<I2cDevice *, ADDRESS_NUM> _devices{};
+  std::vector<Tca9548aDevice *> _muxes;
+  BusTiming _timing;
+  uint8_t _tx_address = 0;
+  std::array<uint8_t, BUFFER_SIZE> _tx_buffer{};
+  size_t _tx_length = 0;
+  std::array<uint8_t, BUFFER_SIZE> _rx_buffer{};
+  size_t _rx_length = 0;
+  size_t _rx_index = 0;
+  std::atomic<uint64_t> _transactions{0};
+  std::atomic<uint64_t> _bytes{0};
+  std::atomic<uint64_t> _busy_us{0};
+  std::atomic<uint64_t> _nacks{0};
+
+  //! アドレスとデータをbytes個送った時間だけ時計を進める
+  void _elapse(size_t bytes);
+  I2cDevice *_find(uint8_t address) const;
+};
+
+//! @param index 0:Wire, 1:Wire1に相当するバス
+SimI2cBus &bus(int index = 0);
+/**
+ * @brief バスの所要時間を実時間で待つかを設定する
+ * @param is_real_time true:実際にその時間だけ待つ, false:時計の値だけを進める(既定)
+ *
+ * ベンチマークでは時計だけを進め、負荷試験のように応答時間を測る場合は実際に待たせる。
+ */
+void set_real_time(bool is_real_time);
+//! ADCが返す値を設定する
+void set_adc(int pin, int value);
+int dac(int pin);
+bool digital(int pin);
+uint32_t pwm_duty(int channel);
+/**
+ * @brief ソケットを通さずに、portで待ち受けているHTTPサーバのハンドラを呼ぶ
+ * @param target "/?gun_num=1"のようなパスとクエリ
+ * @param body 応答の本文の格納先、次に呼ぶまで有効
+ * @return int ステータスコード、portのサーバが無ければ0
+ *
+ * ベンチマークでハンドラの処理だけを測るために使う。handle_client()と同時に呼ばないこと。
+ */
+int dispatch_http(uint16_t port, const char *target, const char **body = nullptr);
+
+/**
+ * @class IrReceiverDevice
+ * @brief 赤外線受信モジュールのシミュレーション、読まれると受信中の銃番号を返す
+ */
+class IrReceiverDevice : public I2cDevice
+{
+public:
+  void set_gun_num(byte gun_num) { _gun_num.store(gun_num, std::memory_order_relaxed); }
+  byte gun_num(void) const { return _gun_num.load(std::memory_order_relaxed); }
+  size_t on_read(uint8_t *data, size_t length) override
+  {
+    if (length == 0)
+    {
+      return 0;
+    }
+    data[0] = _gun_num.load(std::memory_order_relaxed);
+    return 1;
+  }
+
+private:
+  std::atomic<byte> _gun_num{0};
+};
+
+/**
+ * @class Ht16k33Device
+ * @brief HT16K33のシミュレーション、表示RAMへの書き込みとコマンドを覚えておく
+ */
+class Ht16k33Device : public I2cDevice
+{
+public:
+  static constexpr size_t RAM_SIZE = 16;
+
+  bool on_write(const uint8_t *data, size_t length) override
+  {
+    if (length == 0)
+    {
+      return true;
+    }
+    if (data[0] < RAM_SIZE)
+    {
+      // 先頭はRAMアドレス、続くデータはアドレスを自動で進めながら書き込む
+      for (size_t i = 1; i < length; i++)
+      {
+        _ram[(data[0] + i - 1) % RAM_SIZE] = data[i];
+      }
+      _ram_write_count++;
+      return true;
+    }
+    _last_command = data[0];
+    return true;
+  }
+  uint8_t ram(size_t address) const { return _ram[address % RAM_SIZE]; }
+  uint8_t last_command(void) const { return _last_command; }
+  uint32_t ram_write_count(void) const { return _ram_write_count; }
+
+private:
+  std::array<uint8_t, RAM_SIZE> _ram{};
+  uint8_t _last_command = 0;
+  uint32_t _ram_write_count = 0;
+};
+
+/**
+ * @class Tca9548aDevice
+ * @brief TCA9548A I2Cマルチプレクサのシミュレーション
+ *
+ * 書き込まれた制御レジスタのビットが立っているチャンネルの先のデバイスが、バスから見えるようになる。
+ */
+class Tca9548aDevice : public I2cDevice
+{
+public:
+  static constexpr size_t CHANNEL_NUM = 8;
+
+  //! チャンネルchannelの先のaddressにデバイスを繋ぐ
+  void attach(uint8_t channel, uint8_t address, I2cDevice &device)
+  {
+    _devices[channel % CHANNEL_NUM][address % SimI2cBus::ADDRESS_NUM] = &device;
+  }
+  bool on_write(const uint8_t *data, size_t length) override
+  {
+    if (length > 0)
+    {
+      _control = data[length - 1];
+      _write_count++;
+    }
+    return true;
+  }
+  size_t on_read(uint8_t *data, size_t length) override
+  {
+    if (length == 0)
+    {
+      return 0;
+    }
+    data[0] = _control;
+    return 1;
+  }
+  //! 開いているチャンネルの先でaddressに繋がっているデバイス、無ければnullptr
+  I2cDevice *downstream(uint8_t address) const
+  {
+    for (size_t channel = 0; channel < CHANNEL_NUM; channel++)
+    {
+      I2cDevice *device = _devices[channel][address % SimI2cBus::ADDRESS_NUM];
+      if ((_control & (1 << channel)) != 0 && device != nullptr)
+      {
+        return device;
+      }
+    }
+    return nullptr;
+  }
+  uint8_t control(void) const { return _control; }
+  uint32_t write_count(void) const { return _write_count; }
+
+private:
+  std::array<std::array<I2cDevice *, SimI2cBus::ADDRESS_NUM>, CHANNEL_NUM> _devices{};
+  uint8_t _control = 0;
+  uint32_t _write_count = 0;
+};
+
+} // namespace sim
+} // namespace hal
+
+#endif // ARDUINO
+#endif
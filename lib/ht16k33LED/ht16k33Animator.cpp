@@ -0,0 +1,166 @@
+#include <algorithm>
+#include "ht16k33Animator.hpp"
+
+using namespace ht16k33LED;
+
+bool Animator::blink(Led &led, Color color, int times, unsigned long interval_ms, Color end_color)
+{
+  const Step steps[] = {{color, interval_ms}, {Color::clear, interval_ms}};
+  return sequence(led, steps, 2, times, end_color);
+}
+
+bool Animator::hold(Led &led, Color color, unsigned long duration_ms, Color end_color)
+{
+  const Step steps[] = {{color, duration_ms}};
+  return sequence(led, steps, 1, 1, end_color);
+}
+
+bool Animator::sequence(Led &led, const Step *steps, size_t step_num, int repeat, Color end_color)
+{
+  return _start(led, steps, step_num, repeat, end_color) != nullptr;
+}
+
+bool Animator::fade(Led &led, Color color, uint8_t from_level, uint8_t to_level, unsigned long duration_ms)
+{
+  const Step steps[] = {{color, duration_ms}};
+  Track *track = _start(led, steps, 1, 1, color);
+  if (track == nullptr)
+  {
+    return false;
+  }
+  track->is_fade = true;
+  track->from_level = from_level;
+  track->to_level = to_level;
+  return true;
+}
+
+void Animator::stop(const Led &led)
+{
+  for (auto &track : _tracks)
+  {
+    if (track.led == &led)
+    {
+      track = Track();
+    }
+  }
+}
+
+void Animator::stop_all()
+{
+  _tracks.fill(Track());
+}
+
+bool Animator::is_running(const Led &led) const
+{
+  for (const auto &track : _tracks)
+  {
+    if (track.led == &led)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Animator::tick(unsigned long now)
+{
+  for (auto &track : _tracks)
+  {
+    if (track.led != nullptr)
+    {
+      _advance(track, now);
+    }
+  }
+}
+
+Animator::Track *Animator::_start(Led &led, const Step *steps, size_t step_num, int repeat, Color end_color)
+{
+  if (step_num == 0 || step_num > MAX_STEP_NUM || repeat == 0)
+  {
+    return nullptr;
+  }
+  Track *track = _allocate(led);
+  if (track == nullptr)
+  {
+    return nullptr;
+  }
+  for (size_t i = 0; i < step_num; i++)
+  {
+    track->steps[i] = steps[i];
+    // 時間0のステップがあるとtick()で進まなくなるので最低1msにする
+    track->steps[i].duration_ms = std::max<unsigned long>(steps[i].duration_ms, 1);
+  }
+  track->step_num = step_num;
+  track->repeat = repeat;
+  track->end_color = end_color;
+  return track;
+}
+
+Animator::Track *Animator::_allocate(Led &led)
+{
+  Track *empty = nullptr;
+  for (auto &track : _tracks)
+  {
+    if (track.led == &led)
+    {
+      // 同じLEDの演出は上書きする、前の演出の進み具合やfadeの設定は引き継がない
+      track = Track();
+      track.led = &led;
+      return &track;
+    }
+    if (empty == nullptr && track.led == nullptr)
+    {
+      empty = &track;
+    }
+  }
+  if (empty != nullptr)
+  {
+    *empty = Track();
+    empty->led = &led;
+  }
+  return empty;
+}
+
+void Animator::_advance(Track &track, unsigned long now)
+{
+  if (!track.is_started)
+  {
+    track.is_started = true;
+    track.step_index = 0;
+    track.step_start_millis = now;
+    track.led->write_color(track.steps[0].color);
+  }
+  // tick()の間隔が空いた場合は、その間に終わったステップを飛ばす
+  while (now - track.step_start_millis >= track.steps[track.step_index].duration_ms)
+  {
+    track.step_start_millis += track.steps[track.step_index].duration_ms;
+    track.step_index++;
+    if (track.step_index >= track.step_num)
+    {
+      track.step_index = 0;
+      if (track.repeat > 0)
+      {
+        track.repeat--;
+      }
+      if (track.repeat == 0)
+      {
+        if (track.is_fade)
+        {
+          track.led->set_brightness(track.to_level);
+        }
+        track.led->write_color(track.end_color);
+        track = Track();
+        return;
+      }
+    }
+    track.led->write_color(track.steps[track.step_index].color);
+  }
+  if (track.is_fade)
+  {
+    unsigned long duration_ms = track.steps[0].duration_ms;
+    unsigned long elapsed_ms = now - track.step_start_millis;
+    int diff = static_cast<int>(track.to_level) - static_cast<int>(track.from_level);
+    int level = track.from_level + diff * static_cast<long>(elapsed_ms) / static_cast<long>(duration_ms);
+    track.led->set_brightness(static_cast<uint8_t>(level));
+  }
+}
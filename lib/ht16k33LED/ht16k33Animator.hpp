@@ -0,0 +1,97 @@
+/**
+ * @brief ht16K33 フルカラーLED アニメーション管理クラス
+ */
+
+#ifndef HT16K33ANIMATOR_HPP
+#define HT16K33ANIMATOR_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "ht16k33LED.hpp"
+
+namespace ht16k33LED
+{
+
+/**
+ * @class Animator
+ * @brief 点滅などのLED演出をdelay()を使わずに進めるクラス
+ *
+ * blink()等で演出を登録し、tick()を定期的に呼ぶと時刻に応じて表示RAMが書き換わる。
+ * 複数のLEDの演出を同時に進められる。同じLEDに演出を登録すると前の演出は上書きされる。
+ * tick()はDisplayの表示RAMを書き換えるだけなので、その後にDisplay::flush_all()を呼ぶこと。
+ */
+class Animator
+{
+public:
+  //! 同時に動かせる演出の数
+  static constexpr size_t MAX_TRACK_NUM = 16;
+  //! sequence()で指定できるステップ数
+  static constexpr size_t MAX_STEP_NUM = 8;
+  //! repeatにこの値を指定するとstop()するまで繰り返す
+  static constexpr int REPEAT_FOREVER = -1;
+
+  struct Step
+  {
+    Color color;
+    unsigned long duration_ms;
+  };
+
+  /**
+   * @brief 点滅
+   * @param times 点滅回数、REPEAT_FOREVERならstop()するまで
+   * @param interval_ms 点灯時間と消灯時間[ms]
+   * @param end_color 点滅が終わった後の色
+   */
+  bool blink(Led &led, Color color, int times, unsigned long interval_ms, Color end_color = Color::clear);
+  /**
+   * @brief 一定時間点灯
+   * @param end_color 点灯時間が終わった後の色
+   */
+  bool hold(Led &led, Color color, unsigned long duration_ms, Color end_color = Color::clear);
+  /**
+   * @brief 色と時間の組を順番に表示する
+   * @param repeat 繰り返し回数、REPEAT_FOREVERならstop()するまで
+   * @param end_color 全て表示し終わった後の色
+   */
+  bool sequence(Led &led, const Step *steps, size_t step_num, int repeat = 1, Color end_color = Color::clear);
+  /**
+   * @brief 明るさを変えながら点灯する、終了後はcolorのままto_levelの明るさになる
+   * @param from_level, to_level 明るさ(0~15)
+   * @note 明るさはHT16K33単位なので、同じアドレスのLED全てに影響する
+   */
+  bool fade(Led &led, Color color, uint8_t from_level, uint8_t to_level, unsigned long duration_ms);
+  //! ledの演出を止める、表示はそのまま
+  void stop(const Led &led);
+  //! 全ての演出を止める、表示はそのまま
+  void stop_all();
+  bool is_running(const Led &led) const;
+  //! 演出を進める、nowはmillis()の値
+  void tick(unsigned long now);
+
+private:
+  struct Track
+  {
+    Led *led = nullptr;
+    std::array<Step, MAX_STEP_NUM> steps{};
+    uint8_t step_num = 0;
+    uint8_t step_index = 0;
+    int repeat = 0; // 残り繰り返し回数、負なら無限
+    Color end_color = Color::clear;
+    bool is_started = false;
+    unsigned long step_start_millis = 0;
+    // fade()の場合のみ使う
+    bool is_fade = false;
+    uint8_t from_level = 0;
+    uint8_t to_level = 0;
+  };
+  std::array<Track, MAX_TRACK_NUM> _tracks{};
+
+  Track *_allocate(Led &led);
+  //! 演出を登録する、@return Track* 登録した演出、登録できなければnullptr
+  Track *_start(Led &led, const Step *steps, size_t step_num, int repeat, Color end_color);
+  void _advance(Track &track, unsigned long now);
+};
+
+} // namespace ht16k33LED
+#endif
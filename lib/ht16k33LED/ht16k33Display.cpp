@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cstdio>
+#include <hal.hpp>
+#include <i2c_bus.hpp>
+#include <metrics.hpp>
+#include "ht16k33Display.hpp"
+
+using namespace ht16k33LED;
+
+namespace
+{
+// 1トランザクションあたりのオーバーヘッド(スレーブアドレス + RAMアドレス)[byte]
+constexpr size_t TRANSACTION_OVERHEAD = 2;
+// 1COMあたりのデータ量[byte]
+constexpr size_t ROW_SIZE = 2;
+// コマンド
+constexpr uint8_t CMD_SYSTEM_SETUP = 0x20;
+constexpr uint8_t CMD_DISPLAY_SETUP = 0x80;
+constexpr uint8_t CMD_DIMMING = 0xE0;
+constexpr uint8_t OSCILLATOR_ON = 0x01;
+constexpr uint8_t DISPLAY_ON = 0x01;
+} // namespace
+
+Display &Display::get(uint8_t address, int bus)
+{
+  // グローバルなLedのコンストラクタから呼ばれても初期化順序の問題が起きないよう関数内staticにする
+  static std::array<std::array<Display, MAX_DISPLAY_NUM>, BUS_NUM> displays;
+  int bus_index = (bus == 1) ? 1 : 0;
+  Display &display = displays[bus_index][(address - BASE_ADDRESS) % MAX_DISPLAY_NUM];
+  display._address = address;
+  display._bus = bus_index;
+  return display;
+}
+
+void Display::flush_all()
+{
+  for (int bus = 0; bus < BUS_NUM; bus++)
+  {
+    flush_all(bus);
+  }
+}
+
+void Display::flush_all(int bus)
+{
+  for (uint8_t i = 0; i < MAX_DISPLAY_NUM; i++)
+  {
+    Display &display = get(BASE_ADDRESS + i, bus);
+    if (display.is_initialized())
+    {
+      display.flush();
+    }
+  }
+}
+
+void Display::begin()
+{
+  if (_initialized)
+  {
+    return;
+  }
+  printf("Display begin() address=%x, bus=%d\n", _address, _bus);
+  // システムオシレータON
+  _is_oscillator_on = _send_command(CMD_SYSTEM_SETUP | OSCILLATOR_ON);
+  // 表示ON、点滅は初期値OFF
+  _send_blink_rate();
+  // 明るさ(0-15)、初期値は1
+  _send_brightness();
+  // 全消灯、begin()前に書き込まれた内容があればそれも反映される
+  if (!_send(0, RAM_SIZE))
+  {
+    // HT16K33側のRAMの内容が分からないので、次のflush()で全てのCOMを送り直す
+    for (size_t i = 0; i < RAM_SIZE; i++)
+    {
+      _sent[i] = static_cast<uint8_t>(~_ram[i]);
+    }
+  }
+  _initialized = true;
+  _dirty = (_ram != _sent) || _is_setting_changed();
+}
+
+void Display::write_ram(uint8_t ram_address, uint8_t row1, uint8_t row2)
+{
+  if (static_cast<size_t>(ram_address) + 1 >= RAM_SIZE)
+  {
+    return;
+  }
+  _ram[ram_address] = row1;
+  _ram[ram_address + 1] = row2;
+  _dirty = (_ram != _sent) || _is_setting_changed();
+}
+
+void Display::set_brightness(uint8_t level)
+{
+  _brightness = std::min<uint8_t>(level, 15);
+  _dirty = _dirty || _is_setting_changed();
+}
+
+void Display::set_blink_rate(BlinkRate rate)
+{
+  _blink_rate = rate;
+  _dirty = _dirty || _is_setting_changed();
+}
+
+void Display::flush()
+{
+  if (!_dirty || !_initialized)
+  {
+    return;
+  }
+  // 送信に失敗した設定とCOMは送信済みにしないので、次のflush()で送り直される
+  if (!_is_oscillator_on)
+  {
+    // begin()の時に応答が無かった、オシレータが止まっていると何も表示されないので先に送る
+    _is_oscillator_on = _send_command(CMD_SYSTEM_SETUP | OSCILLATOR_ON);
+    if (!_is_oscillator_on)
+    {
+      return;
+    }
+  }
+  if (_is_blink_rate_changed())
+  {
+    _send_blink_rate();
+  }
+  if (_is_brightness_changed())
+  {
+    _send_brightness();
+  }
+  // 変化したCOMの範囲と数を調べる
+  size_t first = RAM_SIZE;
+  size_t last = 0;
+  size_t changed_rows = 0;
+  for (size_t i = 0; i < RAM_SIZE; i += ROW_SIZE)
+  {
+    if (_ram[i] != _sent[i] || _ram[i + 1] != _sent[i + 1])
+    {
+      first = std::min(first, i);
+      last = i;
+      changed_rows++;
+    }
+  }
+  if (changed_rows == 0)
+  {
+    // 明るさか点滅だけが変わっていた
+    _dirty = _is_setting_changed();
+    return;
+  }
+  // COM毎に送るのと、変化した範囲をアドレス自動インクリメントでまとめて送るのとで安い方を選ぶ
+  size_t burst_cost = TRANSACTION_OVERHEAD + (last - first + ROW_SIZE);
+  size_t rows_cost = changed_rows * (TRANSACTION_OVERHEAD + ROW_SIZE);
+  if (burst_cost <= rows_cost)
+  {
+    _send(first, last - first + ROW_SIZE);
+  }
+  else
+  {
+    for (size_t i = first; i <= last; i += ROW_SIZE)
+    {
+      if (_ram[i] != _sent[i] || _ram[i + 1] != _sent[i + 1])
+      {
+        _send(i, ROW_SIZE);
+      }
+    }
+  }
+  _dirty = (_ram != _sent) || _is_setting_changed();
+}
+
+bool Display::_send(uint8_t ram_address, size_t length)
+{
+  i2c_bus::Lock lock(_bus);
+  metrics::ScopedTimer timer(metrics::i2c_led);
+  hal::I2cBus &bus = hal::i2c(_bus);
+  bus.begin_transmission(_address);
+  bus.write(ram_address);
+  bus.write(&_ram[ram_address], length);
+  if (bus.end_transmission() != 0)
+  {
+    metrics::i2c_errors.increment();
+    return false;
+  }
+  std::copy(_ram.begin() + ram_address, _ram.begin() + ram_address + length, _sent.begin() + ram_address);
+  return true;
+}
+
+bool Display::_send_command(uint8_t command)
+{
+  i2c_bus::Lock lock(_bus);
+  metrics::ScopedTimer timer(metrics::i2c_led);
+  hal::I2cBus &bus = hal::i2c(_bus);
+  bus.begin_transmission(_address);
+  bus.write(command);
+  if (bus.end_transmission() != 0)
+  {
+    metrics::i2c_errors.increment();
+    return false;
+  }
+  return true;
+}
+
+void Display::_send_blink_rate()
+{
+  if (_send_command(_display_setup_command(_blink_rate)))
+  {
+    _sent_blink_rate = _blink_rate;
+    _is_blink_rate_sent = true;
+  }
+}
+
+void Display::_send_brightness()
+{
+  if (_send_command(_dimming_command(_brightness)))
+  {
+    _sent_brightness = _brightness;
+    _is_brightness_sent = true;
+  }
+}
+
+bool Display::_is_setting_changed() const
+{
+  return !_is_oscillator_on || _is_brightness_changed() || _is_blink_rate_changed();
+}
+
+uint8_t Display::_display_setup_command(BlinkRate rate)
+{
+  return CMD_DISPLAY_SETUP | (static_cast<uint8_t>(rate) << 1) | DISPLAY_ON;
+}
+
+uint8_t Display::_dimming_command(uint8_t level)
+{
+  return CMD_DIMMING | level;
+}
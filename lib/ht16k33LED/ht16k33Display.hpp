@@ -0,0 +1,113 @@
+/**
+ * @brief ht16K33 表示RAMのシャドウ管理クラス
+ */
+
+#ifndef HT16K33DISPLAY_HPP
+#define HT16K33DISPLAY_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ht16k33LED
+{
+
+//! HT16K33のハードウェア点滅の周期
+enum class BlinkRate : uint8_t
+{
+  off = 0,
+  hz2 = 1,
+  hz1 = 2,
+  hz0_5 = 3
+};
+
+/**
+ * @class Display
+ * @brief HT16K33 1個分の表示RAMをマイコン側に持っておくクラス
+ *
+ * write_ram()は手元のRAMを書き換えるだけで通信はしない。
+ * flush()を呼んだ時に、前回送信した内容から変化した部分だけを送信する。
+ * 同じバス、同じアドレスのLedは同じDisplayを共有する。
+ */
+class Display
+{
+public:
+  static constexpr uint8_t BASE_ADDRESS = 0x70;
+  //! アドレス0x70~0x77まで接続できる
+  static constexpr size_t MAX_DISPLAY_NUM = 8;
+  //! 表示RAMのサイズ(COM8本 x 2byte)
+  static constexpr size_t RAM_SIZE = 16;
+  //! 繋げるバスの数、0:Wire, 1:Wire1
+  static constexpr int BUS_NUM = 2;
+
+  //! 指定したバス、アドレスのDisplayを取得する
+  static Display &get(uint8_t address, int bus = 0);
+  //! 初期化済みの全Displayをflush()する
+  static void flush_all();
+  /**
+   * @brief busに繋いだ初期化済みのDisplayだけをflush()する
+   *
+   * 赤外線受信モジュールと別のバスにLEDを繋いだ場合、LEDを送信するタスクはこちらを使う。
+   */
+  static void flush_all(int bus);
+
+  /**
+   * @brief HT16K33の初期化、2回目以降の呼び出しでは何もしない
+   *
+   * 応答が無かったコマンドは送信済みにしないので、次のflush()で送り直される。
+   */
+  void begin();
+  bool is_initialized() const { return _initialized; }
+  uint8_t address() const { return _address; }
+  int bus() const { return _bus; }
+  //! 手元の表示RAMの2byte(row1, row2)をram_addressから書き換える
+  void write_ram(uint8_t ram_address, uint8_t row1, uint8_t row2);
+  /**
+   * @brief 明るさを設定する、flush()で送信される
+   * @param level 0~15
+   * @note 明るさはHT16K33単位なので、同じアドレスのLED全てに影響する
+   */
+  void set_brightness(uint8_t level);
+  uint8_t brightness() const { return _brightness; }
+  /**
+   * @brief ハードウェア点滅を設定する、flush()で送信される
+   * @note 点滅はHT16K33単位なので、同じアドレスで点灯しているLED全てが点滅する
+   */
+  void set_blink_rate(BlinkRate rate);
+  BlinkRate blink_rate() const { return _blink_rate; }
+  //! 変化した部分を送信する
+  void flush();
+  //! 未送信の変更があるか
+  bool is_dirty() const { return _dirty; }
+
+private:
+  uint8_t _address = BASE_ADDRESS;
+  int _bus = 0;
+  bool _initialized = false;
+  bool _dirty = false;
+  bool _is_oscillator_on = false; // システムオシレータONのコマンドが届いた
+  uint8_t _brightness = 1;
+  uint8_t _sent_brightness = 1;
+  bool _is_brightness_sent = false; // _sent_brightnessが届いている
+  BlinkRate _blink_rate = BlinkRate::off;
+  BlinkRate _sent_blink_rate = BlinkRate::off;
+  bool _is_blink_rate_sent = false; // _sent_blink_rateが届いている
+  std::array<uint8_t, RAM_SIZE> _ram{};  // 表示したい内容
+  std::array<uint8_t, RAM_SIZE> _sent{}; // HT16K33に送信済みの内容
+  //! @return bool true:成功, false:NACK、失敗した範囲は送信済みにしない
+  bool _send(uint8_t ram_address, size_t length);
+  bool _send_command(uint8_t command);
+  //! 成功した場合だけ送信済みにする
+  void _send_blink_rate();
+  void _send_brightness();
+  //! 点滅の設定を送る必要があるか
+  bool _is_blink_rate_changed() const { return !_is_blink_rate_sent || _blink_rate != _sent_blink_rate; }
+  //! 明るさの設定を送る必要があるか
+  bool _is_brightness_changed() const { return !_is_brightness_sent || _brightness != _sent_brightness; }
+  bool _is_setting_changed() const;
+  static uint8_t _display_setup_command(BlinkRate rate);
+  static uint8_t _dimming_command(uint8_t level);
+};
+
+} // namespace ht16k33LED
+#endif
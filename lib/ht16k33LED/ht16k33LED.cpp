@@ -1,72 +1,46 @@
-#include <M5Stack.h>
-#include <Wire.h>
+#include <cstdio>
+#include <hal.hpp>
 #include "ht16k33LED.hpp"
 
 using namespace ht16k33LED;
 
-// 複数定義しないようにstatic変数はここで実体を定義
-std::map<uint8_t, bool> Led::_initialized;
+namespace
+{
+// Colorの値を添字とした{r, g, b}の表
+constexpr std::array<std::array<uint8_t, 3>, 4> COLOR_TABLE{{
+    {{0, 0, 0}}, // clear
+    {{1, 0, 0}}, // red
+    {{0, 1, 0}}, // green
+    {{0, 0, 1}}  // blue
+}};
+} // namespace
 
-Led::Led(uint8_t id, uint8_t address, bool do_wire_begin)
-    : _address(address), _id(id)
+Led::Led(uint8_t id, uint8_t address, bool do_wire_begin, int bus)
+    : _address(address), _id(id), _bus(bus)
 {
-  Serial.printf("Led generate id=%d\n", id);
+  printf("Led generate id=%d\n", id);
   if (do_wire_begin)
   {
-    Serial.println("wire.begin()");
-    Wire.begin();
+    printf("wire.begin()\n");
+    hal::i2c(bus).begin();
   }
 }
 
 void Led::init()
 {
-  Serial.printf("Led init() called id=%d, address=%x\n", this->_id, this->_address);
-  if (_initialized.count(_address))
-  {
-    return;
-  }
-  Serial.printf("Led init() run id=%d, address=%x\n", this->_id, this->_address);
-  // システムオシレータON
-  Wire.beginTransmission(_address);
-  Wire.write(0x21);
-  Wire.endTransmission();
-  // 点滅OFF
-  Wire.beginTransmission(_address);
-  Wire.write(0x81);
-  Wire.endTransmission();
-  // 明るさ1(0-15)
-  Wire.beginTransmission(_address);
-  Wire.write(0xE1);
-  Wire.endTransmission();
-  // 全消灯
-  Wire.beginTransmission(_address);
-  Wire.write(0x00);
-  for (int i = 0; i < 8; i++)
-  {
-    Wire.write(0x00);
-    Wire.write(0x00);
-  }
-  Wire.endTransmission();
-  _initialized[_address] = true;
+  printf("Led init() called id=%d, address=%x\n", this->_id, this->_address);
+  _display().begin();
 }
 
 void Led::write_rgb(uint8_t r, uint8_t g, uint8_t b)
 {
   uint16_t row = 0x0000 | (r << (_id * 3)) | (b << (_id * 3 + 1)) | (g << (_id * 3 + 2));
-  Wire.beginTransmission(_address);
-  Wire.write(_id * 2);
-  Wire.write(static_cast<uint8_t>(row & 0x00FF));
-  Wire.write((row >> 8));
-  Wire.endTransmission();
+  _display().write_ram(_id * 2, static_cast<uint8_t>(row & 0x00FF), (row >> 8));
 }
 
 void Led::write_row(uint8_t com, uint8_t row1, uint8_t row2)
 {
-  Wire.beginTransmission(_address);
-  Wire.write(com);
-  Wire.write(row1);
-  Wire.write(row2);
-  Wire.endTransmission();
+  _display().write_ram(com, row1, row2);
 }
 
 void Led::write_color(Color color)
@@ -80,21 +54,23 @@ void Led::clear()
   write_rgb(0, 0, 0);
 }
 
+void Led::flush()
+{
+  _display().flush();
+}
+
+void Led::set_brightness(uint8_t level)
+{
+  _display().set_brightness(level);
+}
+
 std::array<uint8_t, 3> Led::_color_array(Color color) const
 {
-  std::map<Color, std::array<uint8_t, 3>> dict{
-      {Color::clear, {0, 0, 0}},
-      {Color::red, {1, 0, 0}},
-      {Color::green, {0, 1, 0}},
-      {Color::blue, {0, 0, 1}}};
-  try
+  if (color < Color::clear || color > Color::blue)
   {
-    return dict.at(color);
+    return COLOR_TABLE[Color::clear];
   }
-  catch (std::out_of_range &)
-  {
-  }
-  return dict.at(Color::clear);
+  return COLOR_TABLE[color];
 }
 
 void Led::maintenance(int delay_ms)
@@ -115,16 +91,57 @@ void Led::maintenance(int delay_ms)
       this->write_color(ht16k33LED::blue);
     }
     count++;
-    delay(delay_ms);
+    this->flush();
+    hal::delay(delay_ms);
   }
   this->clear();
+  this->flush();
 }
 
 void Led::blink(Color color, int times, int delay_ms){
   for(int i = 0; i < times; i++){
     this->write_color(color);
-    delay(delay_ms);
+    this->flush();
+    hal::delay(delay_ms);
     this->clear();
-    delay(delay_ms);
+    this->flush();
+    hal::delay(delay_ms);
   }
-}
\ No newline at end of file
+}
+bool LedGroup::add(Led &led)
+{
+  if (led.get_address() != _address || led.get_bus() != _bus || _led_num >= MAX_LED_NUM)
+  {
+    return false;
+  }
+  _leds[_led_num++] = &led;
+  return true;
+}
+
+void LedGroup::write_color(Color color)
+{
+  for (size_t i = 0; i < _led_num; i++)
+  {
+    _leds[i]->write_color(color);
+  }
+}
+
+void LedGroup::clear()
+{
+  write_color(Color::clear);
+}
+
+void LedGroup::set_blink_rate(BlinkRate rate)
+{
+  Display::get(_address, _bus).set_blink_rate(rate);
+}
+
+void LedGroup::set_brightness(uint8_t level)
+{
+  Display::get(_address, _bus).set_brightness(level);
+}
+
+void LedGroup::flush()
+{
+  Display::get(_address, _bus).flush();
+}
@@ -6,7 +6,7 @@
 #define HT16K33LED_HPP
 
 #include <array>
-#include <map>
+#include "ht16k33Display.hpp"
 
 namespace ht16k33LED
 {
@@ -21,17 +21,24 @@ enum Color{
 /**
  * @class Led
  * @brief
+ * 
+ * write_rgb(), write_row(), write_color(), clear()はDisplayの表示RAMを書き換えるだけなので、
+ * 実際に表示を変えるにはflush()かDisplay::flush_all()を呼ぶ必要がある。
  */
 class Led {
 private:
-  static std::map<uint8_t, bool> _initialized;
   uint8_t _address = 0;
   uint8_t _id = 0;
+  int _bus = 0;
   std::array<uint8_t, 3> _color_array(Color color) const;
+  Display &_display() const { return Display::get(_address, _bus); }
 
 public:
-  //! idは0始まりで指定する
-  Led(uint8_t id, uint8_t adress = 0x70, bool do_wire_begin = false);
+  /**
+   * @param id 0始まりで指定する
+   * @param bus HT16K33を繋いだバス、0:Wire, 1:Wire1
+   */
+  Led(uint8_t id, uint8_t adress = 0x70, bool do_wire_begin = false, int bus = 0);
   void init();
   //! r, g, bは0x00(OFF)か0x01(ON)で指定する
   void write_rgb(uint8_t r, uint8_t g, uint8_t b);
@@ -41,10 +48,44 @@ public:
   void write_color(Color color);
   // 消灯
   void clear();
-  // 点灯確認
+  // 同じアドレスのLEDへの変更をまとめて送信する
+  void flush();
+  // 明るさ(0~15)指定、同じアドレスのLED全てに影響する
+  void set_brightness(uint8_t level);
+  // 点灯確認、delay()で待つので起動時のみ使う
   void maintenance(int delay_ms = 1000);
-  // 点滅
+  // 点滅、delay()で待つので演出中に他の処理を止めたくない場合はAnimatorを使う
   void blink(Color color, int times, int delay_ms);
+  uint8_t get_address() const { return _address; }
+  int get_bus() const { return _bus; }
+};
+
+/**
+ * @class LedGroup
+ * @brief 同じHT16K33に繋がっているLEDをまとめて操作するクラス
+ *
+ * 色の書き込みはまとめて1回のflush()で送信される。
+ * 点滅と明るさはHT16K33の機能を使うので、設定を変えても1コマンドしか送信しない。
+ * ただし点滅と明るさはHT16K33単位なので、グループ外の同じアドレスのLEDにも影響する。
+ */
+class LedGroup {
+public:
+  //! 1つのHT16K33に繋げられるLEDの数
+  static constexpr size_t MAX_LED_NUM = 5;
+  explicit LedGroup(uint8_t address = Display::BASE_ADDRESS, int bus = 0) : _address(address), _bus(bus) {}
+  //! LEDを追加する、アドレスかバスが違う場合と一杯の場合はfalse
+  bool add(Led &led);
+  void write_color(Color color);
+  void clear();
+  void set_blink_rate(BlinkRate rate);
+  void set_brightness(uint8_t level);
+  void flush();
+
+private:
+  uint8_t _address;
+  int _bus;
+  std::array<Led *, MAX_LED_NUM> _leds{};
+  size_t _led_num = 0;
 };
 
 }// namespace HT16K33LED
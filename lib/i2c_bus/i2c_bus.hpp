@@ -0,0 +1,96 @@
+/**
+ * @brief I2Cバス排他制御
+ *
+ * ESP32にはI2Cコントローラが2つ(Wire, Wire1)あるので、ロックもバス毎に持つ。
+ * 別々のバスに繋いだデバイス同士は、別のタスクから同時に通信できる。
+ */
+
+#ifndef I2C_BUS_HPP
+#define I2C_BUS_HPP
+
+#include <memory>
+#include <hal.hpp>
+
+namespace i2c_bus
+{
+
+// バスの数、0:Wire, 1:Wire1
+constexpr int BUS_NUM = 2;
+// ESP32で設定できるクロックの上限[Hz]、繋いだデバイスが対応しているかは別途確認すること
+constexpr uint32_t MAX_CLOCK_HZ = 1000000;
+
+/**
+ * @class BasicLock
+ * @brief バス毎のmutexを取るロック
+ * @tparam Tag 排他する対象を区別する型、Tag毎に別々のmutexを持つ
+ *
+ * 同じバスでも、排他する対象(1トランザクション、マルチプレクサの経路など)が違えば別のmutexになる。
+ */
+template <typename Tag>
+class BasicLock
+{
+public:
+  //! @param bus 0:Wire, 1:Wire1
+  explicit BasicLock(int bus = 0) : _bus(bus) { _mutex(_bus).lock(); }
+  ~BasicLock() { _mutex(_bus).unlock(); }
+  BasicLock(const BasicLock &) = delete;
+  BasicLock &operator=(const BasicLock &) = delete;
+  //! mutexの生成が競合しないよう、タスクを生成する前に1度呼んでおく
+  static void init()
+  {
+    for (int bus = 0; bus < BUS_NUM; bus++)
+    {
+      _mutex(bus);
+    }
+  }
+
+private:
+  int _bus;
+
+  static hal::Mutex &_mutex(int bus)
+  {
+    static std::unique_ptr<hal::Mutex> mutexes[BUS_NUM] = {hal::make_mutex(), hal::make_mutex()};
+    return *mutexes[(bus == 1) ? 1 : 0];
+  }
+};
+
+//! Lockで排他する対象
+struct TransactionTag
+{
+};
+
+/**
+ * @brief Wireの1トランザクションを排他するためのロック
+ *
+ * TwoWireは送信バッファをインスタンスで共有しているので、複数のタスクから
+ * Wireを使う場合はbeginTransmission()~endTransmission()、requestFrom()~read()の間
+ * このオブジェクトを生存させておくこと。
+ */
+using Lock = BasicLock<TransactionTag>;
+
+/**
+ * @brief バスを開始し、クロックを設定する
+ * @param bus 0:Wire, 1:Wire1
+ * @param sda SDAのピン、sclと共に負の値ならピンは設定せず、クロックだけ変える(M5.begin()で開始済みのWire用)
+ * @param scl SCLのピン
+ * @param clock_hz クロック[Hz]、MAX_CLOCK_HZまで
+ *
+ * HT16K33は400kHzまで対応している。同じバスの全てのデバイスが対応しているクロックにすること。
+ */
+inline void begin(int bus, int sda, int scl, uint32_t clock_hz)
+{
+  if (clock_hz > MAX_CLOCK_HZ)
+  {
+    clock_hz = MAX_CLOCK_HZ;
+  }
+  Lock lock(bus);
+  if (sda < 0 || scl < 0)
+  {
+    hal::i2c(bus).set_clock(clock_hz);
+    return;
+  }
+  hal::i2c(bus).begin(sda, scl, clock_hz);
+}
+
+} // namespace i2c_bus
+#endif
@@ -0,0 +1,77 @@
+#include <i2c_bus.hpp>
+#include <metrics.hpp>
+#include "i2c_mux.hpp"
+
+namespace
+{
+
+//! バス毎の選択状態、同じバスのLockで守る
+struct State
+{
+  i2c_mux::Route selected; // 最後に選択した経路
+  bool is_unknown = false; // 書き込みに失敗した後などで、TCA9548Aの状態が分からない
+};
+State states[i2c_bus::BUS_NUM];
+
+State &state(int bus)
+{
+  return states[(bus == 1) ? 1 : 0];
+}
+
+bool write_control(int bus_index, uint8_t mux_address, uint8_t control)
+{
+  i2c_bus::Lock lock(bus_index);
+  hal::I2cBus &bus = hal::i2c(bus_index);
+  bus.begin_transmission(mux_address);
+  bus.write(control);
+  metrics::i2c_mux_selects.increment();
+  if (bus.end_transmission() != 0)
+  {
+    metrics::i2c_errors.increment();
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+bool i2c_mux::select(const Route &route, int bus)
+{
+  State &s = state(bus);
+  if (!s.is_unknown && route == s.selected)
+  {
+    return true;
+  }
+  if (!s.selected.is_direct() && (s.is_unknown || route.mux_address != s.selected.mux_address))
+  {
+    if (!write_control(bus, s.selected.mux_address, 0))
+    {
+      s.is_unknown = true;
+      return false;
+    }
+  }
+  if (!route.is_direct() && !write_control(bus, route.mux_address, static_cast<uint8_t>(1 << route.channel)))
+  {
+    s.selected = route;
+    s.is_unknown = true;
+    return false;
+  }
+  s.selected = route;
+  s.is_unknown = false;
+  return true;
+}
+
+bool i2c_mux::disable(uint8_t mux_address, int bus)
+{
+  if (!write_control(bus, mux_address, 0))
+  {
+    return false;
+  }
+  State &s = state(bus);
+  if (s.selected.mux_address == mux_address)
+  {
+    s.selected = Route();
+    s.is_unknown = false;
+  }
+  return true;
+}
@@ -0,0 +1,78 @@
+/**
+ * @brief TCA9548A I2Cマルチプレクサの経路選択
+ *
+ * 赤外線受信モジュールのアドレスは0x08~0x17の16個しかないので、17個以上のまとを繋ぐ場合は
+ * TCA9548Aのチャンネル毎に16個ずつ繋ぎ、読む前にそのチャンネルを選択する。
+ * 選択中の経路はバス毎に1つだけ覚えておき、同じ経路が続く場合はTCA9548Aへの書き込みを省く。
+ * 書き込んだ回数はmetrics::i2c_mux_selectsで数える。
+ */
+
+#ifndef I2C_MUX_HPP
+#define I2C_MUX_HPP
+
+#include <hal.hpp>
+#include <i2c_bus.hpp>
+
+namespace i2c_mux
+{
+
+// TCA9548Aのチャンネル数
+constexpr uint8_t CHANNEL_NUM = 8;
+// マルチプレクサを通さないことを表すアドレス
+constexpr uint8_t DIRECT = 0;
+
+/**
+ * @brief デバイスまでの経路
+ *
+ * TCA9548Aのアドレスは0x70~0x77で、HT16K33(0x70~)と重なるので、
+ * A0~A2を設定してLEDで使っていないアドレスにすること。
+ */
+struct Route
+{
+  uint8_t mux_address = DIRECT; // TCA9548AのI2Cアドレス、DIRECTならバスに直接繋がっている
+  uint8_t channel = 0;          // 0~7
+
+  Route() {}
+  Route(uint8_t mux_address, uint8_t channel) : mux_address(mux_address), channel(channel) {}
+  bool is_direct() const { return mux_address == DIRECT; }
+  bool operator==(const Route &other) const
+  {
+    return mux_address == other.mux_address && (is_direct() || channel == other.channel);
+  }
+  bool operator!=(const Route &other) const { return !(*this == other); }
+};
+
+//! Lockで排他する対象
+struct RouteTag
+{
+};
+
+/**
+ * @brief 経路を選択してから読み終わるまでの間、他のタスクに経路を切り替えさせないためのロック
+ *
+ * i2c_bus::Lockとはmutexが別なので、経路を保持している間も他のデバイス(LEDなど)との通信は割り込める。
+ * i2c_bus::Lockと両方取る場合は、必ずこちらを先に取ること。
+ */
+using Lock = i2c_bus::BasicLock<RouteTag>;
+
+/**
+ * @brief 経路を切り替える、同じバスのLockを取った状態で呼ぶ
+ * @param bus TCA9548Aを繋いだバス、0:Wire, 1:Wire1
+ * @return bool true:成功, false:TCA9548Aから応答が無かった
+ *
+ * 既に選択されている経路なら何もしない。別のTCA9548Aのチャンネルが開いていれば先に閉じるので、
+ * 異なるTCA9548Aの先に同じアドレスのデバイスがあってもぶつからない。
+ * 直接繋がっている経路を選ぶと、開いているチャンネルを閉じる。
+ */
+bool select(const Route &route, int bus = 0);
+/**
+ * @brief TCA9548Aの全てのチャンネルを閉じる、同じバスのLockを取った状態で呼ぶ
+ * @param mux_address TCA9548Aのアドレス
+ * @param bus TCA9548Aを繋いだバス
+ *
+ * 電源を切らずにリセットした場合はチャンネルが開いたままなので、使い始める前に呼ぶ。
+ */
+bool disable(uint8_t mux_address, int bus = 0);
+
+} // namespace i2c_mux
+#endif
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include "metrics.hpp"
+
+using namespace metrics;
+
+const uint32_t Histogram::BUCKET_BOUNDS_US[Histogram::BUCKET_NUM - 1] = {
+    10, 30, 100, 300, 1000, 3000, 10000, 30000, 100000, 300000, 1000000};
+
+Histogram metrics::shot_duration;
+Histogram metrics::loop_period;
+Histogram metrics::http_queue_delay;
+Histogram metrics::i2c_ir;
+Histogram metrics::i2c_led;
+Histogram metrics::i2c_xiao;
+Histogram metrics::ir_group_sweep[IR_GROUP_NUM];
+Histogram metrics::motor_reaction;
+Counter metrics::hits;
+Counter metrics::misses;
+Counter metrics::i2c_errors;
+Counter metrics::i2c_mux_selects;
+Counter metrics::field_timeouts;
+Counter metrics::xiao_lost;
+
+void Histogram::record(uint32_t us)
+{
+  size_t index = 0;
+  while (index < BUCKET_NUM - 1 && us > BUCKET_BOUNDS_US[index])
+  {
+    index++;
+  }
+  _buckets[index].fetch_add(1, std::memory_order_relaxed);
+  _count.fetch_add(1, std::memory_order_relaxed);
+  _sum_us.fetch_add(us, std::memory_order_relaxed);
+}
+
+uint32_t Histogram::quantile_us(float q) const
+{
+  uint32_t total = count();
+  if (total == 0)
+  {
+    return 0;
+  }
+  float rank = q * total;
+  uint32_t cumulative = 0;
+  for (size_t i = 0; i < BUCKET_NUM; i++)
+  {
+    uint32_t in_bucket = bucket(i);
+    if (in_bucket > 0 && cumulative + in_bucket >= rank)
+    {
+      // バケット内は一様に分布しているとみなして線形補間する
+      uint32_t lower = (i == 0) ? 0 : BUCKET_BOUNDS_US[i - 1];
+      if (i == BUCKET_NUM - 1)
+      {
+        return lower;
+      }
+      uint32_t upper = BUCKET_BOUNDS_US[i];
+      return lower + static_cast<uint32_t>((upper - lower) * (rank - cumulative) / in_bucket);
+    }
+    cumulative += in_bucket;
+  }
+  return BUCKET_BOUNDS_US[BUCKET_NUM - 2];
+}
+
+namespace
+{
+
+/**
+ * @brief 固定長バッファへの追記
+ */
+class Writer
+{
+public:
+  Writer(char *buf, size_t size) : _buf(buf), _size(size) {}
+  void printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+  {
+    if (_length + 1 >= _size)
+    {
+      return;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(_buf + _length, _size - _length, format, args);
+    va_end(args);
+    if (written > 0)
+    {
+      _length = std::min(_length + written, _size - 1);
+    }
+  }
+  size_t length() const { return _length; }
+
+private:
+  char *_buf;
+  size_t _size;
+  size_t _length = 0;
+};
+
+void write_histogram_header(Writer &writer, const char *name, const char *help)
+{
+  writer.printf("# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+}
+
+void write_histogram(Writer &writer, const char *name, const char *labels, const Histogram &histogram)
+{
+  // labelsは"device=\"ir\""のような形式、無ければ空文字
+  const char *sep = (labels[0] != '\0') ? "," : "";
+  uint32_t cumulative = 0;
+  for (size_t i = 0; i < Histogram::BUCKET_NUM - 1; i++)
+  {
+    cumulative += histogram.bucket(i);
+    writer.printf("%s_bucket{%s%sle=\"%g\"} %u\n", name, labels, sep,
+                  Histogram::BUCKET_BOUNDS_US[i] / 1e6, cumulative);
+  }
+  writer.printf("%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, sep, histogram.count());
+  const char *open = (labels[0] != '\0') ? "{" : "";
+  const char *close = (labels[0] != '\0') ? "}" : "";
+  writer.printf("%s_sum%s%s%s %.6f\n", name, open, labels, close, histogram.sum_us() / 1e6);
+  writer.printf("%s_count%s%s%s %u\n", name, open, labels, close, histogram.count());
+}
+
+void write_quantiles(Writer &writer, const char *name, const char *labels, const Histogram &histogram)
+{
+  const char *sep = (labels[0] != '\0') ? "," : "";
+  writer.printf("%s{%s%squantile=\"0.5\"} %.6f\n", name, labels, sep, histogram.quantile_us(0.5f) / 1e6);
+  writer.printf("%s{%s%squantile=\"0.99\"} %.6f\n", name, labels, sep, histogram.quantile_us(0.99f) / 1e6);
+}
+
+void write_counter(Writer &writer, const char *name, const char *help, const Counter &counter)
+{
+  writer.printf("# HELP %s %s\n# TYPE %s counter\n%s %u\n", name, help, name, name, counter.value());
+}
+
+} // namespace
+
+size_t metrics::write_prometheus(char *buf, size_t size)
+{
+  if (size == 0)
+  {
+    return 0;
+  }
+  buf[0] = '\0';
+  Writer writer(buf, size);
+
+  struct Entry
+  {
+    const char *name;
+    const char *labels;
+    const Histogram *histogram;
+  };
+  const Entry entries[] = {
+      {"syateki_shot_duration_seconds", "", &shot_duration},
+      {"syateki_loop_period_seconds", "", &loop_period},
+      {"syateki_http_queue_delay_seconds", "", &http_queue_delay},
+      {"syateki_i2c_transaction_seconds", "device=\"ir\"", &i2c_ir},
+      {"syateki_i2c_transaction_seconds", "device=\"led\"", &i2c_led},
+      {"syateki_i2c_transaction_seconds", "device=\"xiao\"", &i2c_xiao},
+      {"syateki_motor_reaction_seconds", "", &motor_reaction}};
+
+  write_histogram_header(writer, entries[0].name, "Time to handle a shot request.");
+  write_histogram(writer, entries[0].name, entries[0].labels, *entries[0].histogram);
+  write_histogram_header(writer, entries[1].name, "Period between targets.update() calls.");
+  write_histogram(writer, entries[1].name, entries[1].labels, *entries[1].histogram);
+  write_histogram_header(writer, entries[2].name, "Upper bound of time an HTTP request waited before being handled.");
+  write_histogram(writer, entries[2].name, entries[2].labels, *entries[2].histogram);
+  write_histogram_header(writer, entries[3].name, "Duration of one I2C transaction.");
+  for (size_t i = 3; i < 6; i++)
+  {
+    write_histogram(writer, entries[i].name, entries[i].labels, *entries[i].histogram);
+  }
+  write_histogram_header(writer, entries[6].name, "Time from an end stop trigger to the motor stopping or reversing.");
+  write_histogram(writer, entries[6].name, entries[6].labels, *entries[6].histogram);
+  // 走査したことのあるグループだけ書き出す
+  write_histogram_header(writer, "syateki_ir_group_sweep_seconds",
+                         "Time to select the route and read every receiver of one target group.");
+  for (size_t i = 0; i < IR_GROUP_NUM; i++)
+  {
+    if (ir_group_sweep[i].count() > 0)
+    {
+      char labels[16];
+      snprintf(labels, sizeof(labels), "group=\"%u\"", static_cast<unsigned>(i));
+      write_histogram(writer, "syateki_ir_group_sweep_seconds", labels, ir_group_sweep[i]);
+    }
+  }
+
+  // p50/p99はバケットからの推定値、Prometheus側でhistogram_quantile()を使えない場合用
+  writer.printf("# HELP syateki_latency_quantile_seconds Quantiles estimated from the histograms.\n"
+                "# TYPE syateki_latency_quantile_seconds gauge\n");
+  const char *quantile_labels[] = {
+      "metric=\"shot_duration\"", "metric=\"loop_period\"", "metric=\"http_queue_delay\"",
+      "metric=\"i2c_ir\"", "metric=\"i2c_led\"", "metric=\"i2c_xiao\"", "metric=\"motor_reaction\""};
+  for (size_t i = 0; i < 7; i++)
+  {
+    write_quantiles(writer, "syateki_latency_quantile_seconds", quantile_labels[i], *entries[i].histogram);
+  }
+
+  write_counter(writer, "syateki_hits_total", "Shots that hit a target.", hits);
+  write_counter(writer, "syateki_misses_total", "Shots that hit no target.", misses);
+  write_counter(writer, "syateki_i2c_errors_total", "I2C transactions that failed.", i2c_errors);
+  write_counter(writer, "syateki_i2c_mux_selects_total", "Writes to the I2C multiplexers to switch channels.",
+                i2c_mux_selects);
+  write_counter(writer, "syateki_field_timeouts_total", "Requests the network task gave up waiting for.", field_timeouts);
+  write_counter(writer, "syateki_xiao_lost_total", "Effect messages that never reached the XIAO.", xiao_lost);
+  return writer.length();
+}
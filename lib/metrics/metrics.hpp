@@ -0,0 +1,111 @@
+/**
+ * @brief 処理時間のヒストグラムと回数カウンタ
+ *
+ * 記録はヒープを使わず、別のタスクから記録しても壊れないようにatomicで数える。
+ * write_prometheus()でPrometheusのテキスト形式に書き出せる。
+ */
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <hal.hpp>
+
+namespace metrics
+{
+
+/**
+ * @class Histogram
+ * @brief 固定バケットの処理時間ヒストグラム[us]
+ */
+class Histogram
+{
+public:
+  static constexpr size_t BUCKET_NUM = 12;
+  //! 各バケットの上限[us]、最後のバケットは上限なし
+  static const uint32_t BUCKET_BOUNDS_US[BUCKET_NUM - 1];
+
+  void record(uint32_t us);
+  uint32_t count() const { return _count.load(std::memory_order_relaxed); }
+  uint64_t sum_us() const { return _sum_us.load(std::memory_order_relaxed); }
+  uint32_t bucket(size_t index) const { return _buckets[index].load(std::memory_order_relaxed); }
+  /**
+   * @brief バケットから分位点を推定する
+   * @param q 0~1
+   * @return uint32_t 推定値[us]、記録が無ければ0
+   */
+  uint32_t quantile_us(float q) const;
+
+private:
+  std::atomic<uint32_t> _buckets[BUCKET_NUM] = {};
+  std::atomic<uint32_t> _count{0};
+  std::atomic<uint64_t> _sum_us{0};
+};
+
+/**
+ * @class Counter
+ * @brief 単調増加する回数カウンタ
+ */
+class Counter
+{
+public:
+  void increment() { _value.fetch_add(1, std::memory_order_relaxed); }
+  uint32_t value() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint32_t> _value{0};
+};
+
+/**
+ * @class ScopedTimer
+ * @brief 生成から破棄までの時間をヒストグラムに記録する
+ */
+class ScopedTimer
+{
+public:
+  explicit ScopedTimer(Histogram &histogram) : _histogram(histogram), _start_us(hal::micros()) {}
+  ~ScopedTimer() { _histogram.record(hal::micros() - _start_us); }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+  Histogram &_histogram;
+  unsigned long _start_us;
+};
+
+// 射撃判定要求の処理時間
+extern Histogram shot_duration;
+// targets.update()を呼ぶ周期
+extern Histogram loop_period;
+// HTTPリクエストを受け付けるまでの待ち時間(前回handle_client()を抜けてから処理を始めるまで)
+extern Histogram http_queue_delay;
+// 1トランザクションあたりのI2C通信時間
+extern Histogram i2c_ir;
+extern Histogram i2c_led;
+extern Histogram i2c_xiao;
+// 赤外線受信モジュールの走査で、経路(マルチプレクサのチャンネル)毎にかかった時間
+// グループkはid 16k~16k+15のまと
+constexpr size_t IR_GROUP_NUM = 4;
+extern Histogram ir_group_sweep[IR_GROUP_NUM];
+// フォトリフレクタが反応してからモータを止める・反転するまでの時間
+extern Histogram motor_reaction;
+extern Counter hits;
+extern Counter misses;
+extern Counter i2c_errors;
+// TCA9548Aに書き込んで経路を切り替えた回数
+extern Counter i2c_mux_selects;
+// HTTP/UDP処理タスクが射撃判定の結果を待ちきれなかった回数
+extern Counter field_timeouts;
+// 送り直してもXIAOに届かなかった演出の指示の数
+extern Counter xiao_lost;
+
+/**
+ * @brief 全ての値をPrometheusのテキスト形式で書き出す
+ * @return size_t 書き込んだ文字数、bufが足りない場合は途中で打ち切る
+ */
+size_t write_prometheus(char *buf, size_t size);
+
+} // namespace metrics
+#endif
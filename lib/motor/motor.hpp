@@ -5,6 +5,13 @@
 #ifndef MOTOR_HPP
 #define MOTOR_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <hal.hpp>
+#include <metrics.hpp>
+#include <photo_reflector.hpp>
+
 enum Direction {
   UP = (0),
   DOWN,
@@ -29,11 +36,12 @@ public:
     :_ref_pin(ref_pin), _in1_pin(in1_pin), _in2_pin(in2_pin)
   {
     // ピン設定初期化
-    pinMode(in1_pin, OUTPUT);
-    pinMode(in2_pin, OUTPUT);
-    digitalWrite(in1_pin, LOW);
-    digitalWrite(in2_pin, LOW);
-    dacWrite(ref_pin, 0);
+    hal::Gpio &gpio = hal::gpio();
+    gpio.pin_mode(in1_pin, hal::PinMode::output);
+    gpio.pin_mode(in2_pin, hal::PinMode::output);
+    gpio.digital_write(in1_pin, false);
+    gpio.digital_write(in2_pin, false);
+    gpio.dac_write(ref_pin, 0);
   }
   ~Motor() {}
   bool set_power(int power, Direction direction)
@@ -50,13 +58,14 @@ public:
     if(direction != Direction::NOCHANGE){
       _direction = direction;
     }
-    dacWrite(_ref_pin, power);
+    hal::Gpio &gpio = hal::gpio();
+    gpio.dac_write(_ref_pin, power);
     if(_direction == Direction::DOWN){
-      digitalWrite(_in1_pin, HIGH);
-      digitalWrite(_in2_pin, LOW);
+      gpio.digital_write(_in1_pin, true);
+      gpio.digital_write(_in2_pin, false);
     }else{
-      digitalWrite(_in2_pin, HIGH);
-      digitalWrite(_in1_pin, LOW);
+      gpio.digital_write(_in2_pin, true);
+      gpio.digital_write(_in1_pin, false);
     }
     _power = power;
     return true;
@@ -65,6 +74,170 @@ public:
   {
     return _power;
   }
+  Direction get_direction(void)
+  {
+    return _direction;
+  }
+};
+
+/**
+ * @class MotorController
+ * @brief 上下端のフォトリフレクタを見ながらモータを動かすクラス
+ *
+ * 周期タイマ(実機ではesp_timer)で一定周期に端を確認するので、loop()の周期に関係なく一定の遅れで反転・停止できる。
+ * 出力の変更は設定した加速度・減速度でDACを少しずつ変える。ただし端での反転・停止は安全のため即座に行う。
+ */
+class MotorController
+{
+public:
+  /**
+   * @brief コンストラクタ
+   * @param motor 制御するモータ、begin()の後はこのクラス以外から操作しないこと
+   * @param top_reflector 上端のフォトリフレクタ
+   * @param bottom_reflector 下端のフォトリフレクタ
+   */
+  MotorController(Motor &motor, PhotoReflector &top_reflector, PhotoReflector &bottom_reflector)
+    :_motor(motor), _top_reflector(top_reflector), _bottom_reflector(bottom_reflector)
+  {
+  }
+  /**
+   * @brief 加速度・減速度を設定する、begin()の前に呼ぶ
+   * @param accel_per_s 出力を上げる速さ[DAC値/s]、0なら即座に変える
+   * @param decel_per_s 出力を下げる速さ[DAC値/s]、0なら即座に変える
+   */
+  void set_ramp(int accel_per_s, int decel_per_s)
+  {
+    _accel_per_s = accel_per_s;
+    _decel_per_s = decel_per_s;
+  }
+  /**
+   * @brief 制御を開始する
+   * @param period_us 端を確認する周期[us]
+   * @return bool true:成功, false:タイマを作れなかった
+   */
+  bool begin(uint32_t period_us = 500)
+  {
+    if (_timer)
+    {
+      return false;
+    }
+    _period_us = period_us;
+    _timer = hal::make_periodic_timer(MotorController::_on_timer, this, "motor");
+    return _timer->start(period_us);
+  }
+  //! 目標の出力を設定する、0~255
+  void set_power(int power)
+  {
+    _target_power.store(std::max(0, std::min(power, 255)), std::memory_order_relaxed);
+  }
+  int get_target_power(void) const
+  {
+    return _target_power.load(std::memory_order_relaxed);
+  }
+  //! 今DACに出している出力
+  int get_power(void) const
+  {
+    return _power.load(std::memory_order_relaxed);
+  }
+  //! 直近の、フォトリフレクタが反応してから反転・停止するまでの時間[us]
+  uint32_t last_reaction_us(void) const
+  {
+    return _last_reaction_us.load(std::memory_order_relaxed);
+  }
+  //! 反転・停止するまでの時間の最大値[us]
+  uint32_t max_reaction_us(void) const
+  {
+    return _max_reaction_us.load(std::memory_order_relaxed);
+  }
+
+private:
+  Motor &_motor;
+  PhotoReflector &_top_reflector;
+  PhotoReflector &_bottom_reflector;
+  std::unique_ptr<hal::PeriodicTimer> _timer;
+  uint32_t _period_us = 500;
+  int _accel_per_s = 0;
+  int _decel_per_s = 0;
+  // 加減速の途中を表すため、出力は1000倍した値で持つ
+  int32_t _power_milli = 0;
+  bool _was_top_close = false;
+  bool _was_bottom_close = false;
+  std::atomic<int> _target_power{0};
+  std::atomic<int> _power{0};
+  std::atomic<uint32_t> _last_reaction_us{0};
+  std::atomic<uint32_t> _max_reaction_us{0};
+
+  static void _on_timer(void *arg)
+  {
+    static_cast<MotorController *>(arg)->_tick();
+  }
+  //! 1周期で出力を変えられる量[DAC値*1000]、0なら制限なし
+  int32_t _ramp_step(int per_s) const
+  {
+    return static_cast<int32_t>(static_cast<int64_t>(per_s) * _period_us / 1000);
+  }
+  void _tick(void)
+  {
+    bool is_top_close = _top_reflector.is_close();
+    bool is_bottom_close = _bottom_reflector.is_close();
+    int target_power = _target_power.load(std::memory_order_relaxed);
+    Direction direction = Direction::NOCHANGE;
+    if (is_bottom_close)
+    {
+      direction = Direction::UP;
+      if (is_top_close)
+      {
+        // 両方のフォトリフレクタが反応していたら念のためモータは止める
+        target_power = 0;
+        _power_milli = 0;
+      }
+    }
+    else if (is_top_close)
+    {
+      direction = Direction::DOWN;
+    }
+    bool is_reversing = (direction != Direction::NOCHANGE && direction != _motor.get_direction());
+    if (is_reversing)
+    {
+      // 向きを変える時は出力を0にしてから切り替え、そこから加速し直す
+      _power_milli = 0;
+    }
+    else
+    {
+      int32_t target_milli = target_power * 1000;
+      int32_t accel_step = _ramp_step(_accel_per_s);
+      int32_t decel_step = _ramp_step(_decel_per_s);
+      if (_power_milli < target_milli)
+      {
+        _power_milli = (accel_step == 0) ? target_milli : std::min(_power_milli + accel_step, target_milli);
+      }
+      else if (_power_milli > target_milli)
+      {
+        _power_milli = (decel_step == 0) ? target_milli : std::max(_power_milli - decel_step, target_milli);
+      }
+    }
+    int power = _power_milli / 1000;
+    _motor.set_power(power, direction);
+    _power.store(power, std::memory_order_relaxed);
+
+    // 端に着いたことで反転・停止した場合は、反応してからここまでの時間を記録する
+    bool is_top_edge = (is_top_close && !_was_top_close);
+    bool is_bottom_edge = (is_bottom_close && !_was_bottom_close);
+    if ((is_top_edge || is_bottom_edge) && (is_reversing || power == 0))
+    {
+      uint32_t changed_micros = is_top_edge ? _top_reflector.close_changed_micros()
+                                            : _bottom_reflector.close_changed_micros();
+      uint32_t reaction_us = static_cast<uint32_t>(hal::micros()) - changed_micros;
+      _last_reaction_us.store(reaction_us, std::memory_order_relaxed);
+      if (reaction_us > _max_reaction_us.load(std::memory_order_relaxed))
+      {
+        _max_reaction_us.store(reaction_us, std::memory_order_relaxed);
+      }
+      metrics::motor_reaction.record(reaction_us);
+    }
+    _was_top_close = is_top_close;
+    _was_bottom_close = is_bottom_close;
+  }
 };
 
 #endif
\ No newline at end of file
@@ -5,32 +5,180 @@
 #ifndef PHOTO_REFLECTOR_HPP
 #define PHOTO_REFLECTOR_HPP
 
+#include <array>
+#include <atomic>
+#include <memory>
+#include <hal.hpp>
+
 /**
  * @class PhotoReflector
  * @brief フォトリフレクタ用クラス
+ *
+ * 読み取った値は直近のサンプルの中央値にしてから使うので、単発のノイズでは反応しない。
+ * 接近中の判定には、接近したとみなす値と離れたとみなす値を別々に持たせて、閾値付近でばたつかないようにしている。
  */
 class PhotoReflector
 {
+public:
+  // 中央値を取るサンプル数
+  static constexpr size_t FILTER_SIZE = 5;
+
 private:
   int _pin = 0;
   // この値より低い値が読み取れたら接近中と判断する
   int _close_ref_value = 3500;
+  // 接近中にこの値より高い値が読み取れたら離れたと判断する
+  int _leave_ref_value = 3700;
+  std::array<int, FILTER_SIZE> _samples{};
+  size_t _sample_head = 0;
+  size_t _sample_count = 0;
+  std::atomic<int> _value{0};
+  std::atomic<bool> _is_close{false};
+  std::atomic<uint32_t> _close_changed_micros{0};
+  bool _is_sampled = false;
+
+  int _median(void) const
+  {
+    std::array<int, FILTER_SIZE> sorted;
+    for (size_t i = 0; i < _sample_count; i++)
+    {
+      int sample = _samples[i];
+      size_t j = i;
+      for (; j > 0 && sorted[j - 1] > sample; j--)
+      {
+        sorted[j] = sorted[j - 1];
+      }
+      sorted[j] = sample;
+    }
+    return sorted[_sample_count / 2];
+  }
 
 public:
-  PhotoReflector(int pin, int close_ref_value = 3500)
-    :_pin(pin), _close_ref_value(close_ref_value)
+  /**
+   * @brief コンストラクタ
+   * @param pin 接続しているピン
+   * @param close_ref_value この値より低ければ接近したとみなす
+   * @param leave_ref_value 接近中にこの値より高くなれば離れたとみなす、負の値ならclose_ref_value+200
+   */
+  PhotoReflector(int pin, int close_ref_value = 3500, int leave_ref_value = -1)
+    :_pin(pin), _close_ref_value(close_ref_value),
+     _leave_ref_value((leave_ref_value < 0) ? close_ref_value + 200 : leave_ref_value)
   {
-    pinMode(pin, INPUT);
+    hal::gpio().pin_mode(pin, hal::PinMode::input);
   }
   ~PhotoReflector(){}
+  /**
+   * @brief 1回読み取ってフィルタと接近中の判定を更新する
+   *
+   * PhotoReflectorSamplerから周期的に呼ばれる。それ以外のタスクから同時に呼ばないこと。
+   */
+  void sample(void)
+  {
+    _samples[_sample_head] = hal::adc().read(_pin);
+    _sample_head = (_sample_head + 1) % FILTER_SIZE;
+    if (_sample_count < FILTER_SIZE)
+    {
+      _sample_count++;
+    }
+    int value = _median();
+    _value.store(value, std::memory_order_relaxed);
+    bool is_close = _is_close.load(std::memory_order_relaxed);
+    if ((!is_close && value < _close_ref_value) || (is_close && value > _leave_ref_value))
+    {
+      _close_changed_micros.store(hal::micros(), std::memory_order_relaxed);
+      _is_close.store(!is_close, std::memory_order_relaxed);
+    }
+  }
+  /**
+   * @brief 読み取りを周期的なsample()に任せるかを設定する
+   * @param is_sampled true:value()とis_close()は最後の結果を返すだけになる, false:呼ぶ度にsample()する
+   */
+  void set_sampled(bool is_sampled)
+  {
+    _is_sampled = is_sampled;
+  }
+  //! フィルタ後の値
   int value(void)
   {
-    return analogRead(_pin);
+    if (!_is_sampled)
+    {
+      sample();
+    }
+    return _value.load(std::memory_order_relaxed);
   }
   bool is_close(void)
   {
-    return (analogRead(_pin) < _close_ref_value);
+    if (!_is_sampled)
+    {
+      sample();
+    }
+    return _is_close.load(std::memory_order_relaxed);
+  }
+  //! is_close()の結果が最後に変化した時刻、micros()の値
+  uint32_t close_changed_micros(void) const
+  {
+    return _close_changed_micros.load(std::memory_order_relaxed);
+  }
+};
+
+/**
+ * @class PhotoReflectorSampler
+ * @brief 複数のフォトリフレクタをタイマで周期的に読み取るクラス
+ *
+ * 周期タイマ(実機ではesp_timer)のタスクでsample()を呼ぶので、loop()の周期に関係なく一定間隔で読み取れる。
+ */
+class PhotoReflectorSampler
+{
+public:
+  static constexpr size_t MAX_REFLECTOR_NUM = 4;
+
+  /**
+   * @brief 読み取るフォトリフレクタを追加する、begin()の前に呼ぶ
+   * @return bool true:成功, false:上限を超えた
+   */
+  bool add(PhotoReflector &reflector)
+  {
+    if (_timer || _reflector_num >= MAX_REFLECTOR_NUM)
+    {
+      return false;
+    }
+    _reflectors[_reflector_num++] = &reflector;
+    return true;
+  }
+  /**
+   * @brief 読み取りを開始する
+   * @param period_us 読み取り周期[us]
+   * @return bool true:成功, false:タイマを作れなかった
+   */
+  bool begin(uint32_t period_us = 1000)
+  {
+    if (_timer)
+    {
+      return false;
+    }
+    _timer = hal::make_periodic_timer(PhotoReflectorSampler::_on_timer, this, "reflector");
+    for (size_t i = 0; i < _reflector_num; i++)
+    {
+      // 最初の結果が揃ってから切り替える
+      _reflectors[i]->sample();
+      _reflectors[i]->set_sampled(true);
+    }
+    return _timer->start(period_us);
+  }
+
+private:
+  std::array<PhotoReflector *, MAX_REFLECTOR_NUM> _reflectors{};
+  size_t _reflector_num = 0;
+  std::unique_ptr<hal::PeriodicTimer> _timer;
+
+  static void _on_timer(void *arg)
+  {
+    PhotoReflectorSampler *sampler = static_cast<PhotoReflectorSampler *>(arg);
+    for (size_t i = 0; i < sampler->_reflector_num; i++)
+    {
+      sampler->_reflectors[i]->sample();
+    }
   }
 };
 
-#endif
\ No newline at end of file
+#endif
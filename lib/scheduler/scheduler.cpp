@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <hal.hpp>
+#include "scheduler.hpp"
+
+using namespace scheduler;
+
+namespace
+{
+// micros()が一周しても比較できるよう、差の符号で前後を判定する
+bool is_reached(uint32_t now_us, uint32_t deadline_us)
+{
+  return static_cast<int32_t>(now_us - deadline_us) >= 0;
+}
+} // namespace
+
+bool Scheduler::add(const char *name, void (*func)(), uint32_t period_us)
+{
+  if (_task_num >= MAX_TASK_NUM || func == nullptr || period_us == 0)
+  {
+    return false;
+  }
+  Task &task = _tasks[_task_num++];
+  task.func = func;
+  task.stats = TaskStats();
+  task.stats.name = name;
+  task.stats.period_us = period_us;
+  return true;
+}
+
+uint32_t Scheduler::run_pending(uint32_t now_us)
+{
+  if (!_is_started)
+  {
+    // 最初の呼び出しで全タスクを期限切れにしておく
+    for (size_t i = 0; i < _task_num; i++)
+    {
+      _tasks[i].deadline_us = now_us;
+    }
+    _is_started = true;
+  }
+  // 処理が重すぎて常にどれかの期限が来ている場合でも戻れるよう、1回で実行する数には上限を設ける
+  for (size_t count = 0; count < _task_num * 2; count++)
+  {
+    int index = _find_due(now_us);
+    if (index < 0)
+    {
+      break;
+    }
+    _run_task(_tasks[index]);
+    now_us = hal::micros();
+  }
+  uint32_t wait_us = UINT32_MAX;
+  for (size_t i = 0; i < _task_num; i++)
+  {
+    if (is_reached(now_us, _tasks[i].deadline_us))
+    {
+      return 0;
+    }
+    wait_us = std::min(wait_us, _tasks[i].deadline_us - now_us);
+  }
+  return (_task_num == 0) ? 0 : wait_us;
+}
+
+void Scheduler::run()
+{
+  uint32_t wait_us = run_pending(hal::micros());
+  // 1ms以上空いていれば他のタスクに譲り、それより短ければその場で待つ
+  if (wait_us >= 1000)
+  {
+    hal::delay(wait_us / 1000);
+  }
+  else if (wait_us > 0)
+  {
+    hal::delay_microseconds(wait_us);
+  }
+}
+
+uint32_t Scheduler::total_overrun_count() const
+{
+  uint32_t total = 0;
+  for (size_t i = 0; i < _task_num; i++)
+  {
+    total += _tasks[i].stats.overrun_count;
+  }
+  return total;
+}
+
+int Scheduler::_find_due(uint32_t now_us) const
+{
+  int found = -1;
+  for (size_t i = 0; i < _task_num; i++)
+  {
+    if (!is_reached(now_us, _tasks[i].deadline_us))
+    {
+      continue;
+    }
+    if (found < 0 || static_cast<int32_t>(_tasks[i].deadline_us - _tasks[found].deadline_us) < 0)
+    {
+      found = static_cast<int>(i);
+    }
+  }
+  return found;
+}
+
+void Scheduler::_run_task(Task &task)
+{
+  uint32_t start_us = hal::micros();
+  task.func();
+  uint32_t end_us = hal::micros();
+
+  TaskStats &stats = task.stats;
+  stats.last_run_us = end_us - start_us;
+  stats.max_run_us = std::max(stats.max_run_us, stats.last_run_us);
+  stats.run_count++;
+
+  uint32_t next_deadline_us = task.deadline_us + stats.period_us;
+  if (is_reached(end_us, next_deadline_us))
+  {
+    // 次の周期の開始にも間に合わなかったので、追いつこうとせず今から1周期後にする
+    stats.overrun_count++;
+    next_deadline_us = end_us + stats.period_us;
+  }
+  task.deadline_us = next_deadline_us;
+}
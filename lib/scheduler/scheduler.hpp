@@ -0,0 +1,76 @@
+/**
+ * @brief 周期処理の協調スケジューラ
+ */
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace scheduler
+{
+
+//! タスク毎の実行状況
+struct TaskStats
+{
+  const char *name = "";
+  uint32_t period_us = 0;
+  uint32_t last_run_us = 0;   // 直近の実行時間
+  uint32_t max_run_us = 0;    // 最大の実行時間
+  uint32_t run_count = 0;
+  uint32_t overrun_count = 0; // 次の周期の開始までに終わらなかった回数
+};
+
+/**
+ * @class Scheduler
+ * @brief 周期と期限を持つタスクを、期限の早い順に実行するクラス
+ *
+ * loop()の中でrun()を呼ぶと、期限が来たタスクを実行し、次の期限まで待つ。
+ * 処理が周期に間に合わなかった場合は、追いつこうとせずに次の周期から実行し直し、
+ * overrun_countを増やす。
+ */
+class Scheduler
+{
+public:
+  static constexpr size_t MAX_TASK_NUM = 12;
+
+  /**
+   * @brief タスクを登録する
+   * @param name 名前、文字列リテラルなど生存し続けるものを渡す
+   * @param func 実行する処理
+   * @param period_us 周期[us]
+   * @return bool true:成功, false:登録数の上限を超えた
+   */
+  bool add(const char *name, void (*func)(), uint32_t period_us);
+  /**
+   * @brief 期限が来たタスクを期限の早い順に実行する
+   * @param now_us 現在時刻、micros()の値
+   * @return uint32_t 次の期限までの時間[us]
+   */
+  uint32_t run_pending(uint32_t now_us);
+  //! run_pending()を呼び、次の期限まで待つ
+  void run();
+  size_t task_num() const { return _task_num; }
+  const TaskStats &stats(size_t index) const { return _tasks[index].stats; }
+  uint32_t total_overrun_count() const;
+
+private:
+  struct Task
+  {
+    void (*func)() = nullptr;
+    uint32_t deadline_us = 0;
+    TaskStats stats;
+  };
+  std::array<Task, MAX_TASK_NUM> _tasks{};
+  size_t _task_num = 0;
+  bool _is_started = false;
+
+  //! 期限が来ているタスクのうち、期限が最も早いもの、無ければ-1
+  int _find_due(uint32_t now_us) const;
+  void _run_task(Task &task);
+};
+
+} // namespace scheduler
+#endif
@@ -1,7 +1,8 @@
 #ifndef SERVO_HPP
 #define SERVO_HPP
 
-#include <Arduino.h>
+#include <array>
+#include <hal.hpp>
 
 template <class T>
 static constexpr T spow(T base, T exp) noexcept
@@ -19,16 +20,27 @@ protected:
   constexpr static float LEDC_UNIT_TIME_MS = 1000 / LEDC_SERVO_FREQ;
   constexpr static int LEDC_TIMER_BIT = 16;
   constexpr static int LEDC_FULL_BIT = spow<int>(2, LEDC_TIMER_BIT);
+  constexpr static int MIN_ANGLE = -90;
+  constexpr static int MAX_ANGLE = 90;
   int _chennel;
   int _pin;
-  int _angle;
+  int _angle = 0;
   float MIN_WIDTH_MS;
   float MAX_WIDTH_MS;
+  // 角度毎のデューティ、書き込みの度に浮動小数点で計算しないようコンストラクタで作っておく
+  std::array<uint16_t, MAX_ANGLE - MIN_ANGLE + 1> _duty_table;
 
   int count(int angle)
   {
-    float ratio = (angle + 90) / 180.0;
-    return (int)(LEDC_FULL_BIT * (MIN_WIDTH_MS + ratio * (MAX_WIDTH_MS - MIN_WIDTH_MS)) / LEDC_UNIT_TIME_MS);
+    if (angle < MIN_ANGLE)
+    {
+      angle = MIN_ANGLE;
+    }
+    else if (angle > MAX_ANGLE)
+    {
+      angle = MAX_ANGLE;
+    }
+    return _duty_table[angle - MIN_ANGLE];
   }
 
 public:
@@ -43,9 +55,15 @@ public:
     , MIN_WIDTH_MS(min_width_ms)
     , MAX_WIDTH_MS(max_width_ms)
   {
-    pinMode(pin, OUTPUT);
-    ledcSetup(channel, LEDC_SERVO_FREQ, LEDC_TIMER_BIT);
-    ledcAttachPin(_pin, channel);
+    for (int angle = MIN_ANGLE; angle <= MAX_ANGLE; angle++)
+    {
+      float ratio = (angle - MIN_ANGLE) / static_cast<float>(MAX_ANGLE - MIN_ANGLE);
+      _duty_table[angle - MIN_ANGLE] = static_cast<uint16_t>(
+          LEDC_FULL_BIT * (MIN_WIDTH_MS + ratio * (MAX_WIDTH_MS - MIN_WIDTH_MS)) / LEDC_UNIT_TIME_MS);
+    }
+    hal::gpio().pin_mode(pin, hal::PinMode::output);
+    hal::pwm().setup(channel, LEDC_SERVO_FREQ, LEDC_TIMER_BIT);
+    hal::pwm().attach_pin(_pin, channel);
   }
 
   /**
@@ -55,7 +73,7 @@ public:
   void write(int angle)
   {
     _angle = angle;
-    ledcWrite(_chennel, count(angle));
+    hal::pwm().write(_chennel, count(angle));
   }
 
   int read()
@@ -66,9 +84,9 @@ public:
   void maintenance(int angle, int delay_ms = 1000)
   {
     this->write(angle);
-    delay(delay_ms);
+    hal::delay(delay_ms);
     this->write(-angle);
-    delay(delay_ms);
+    hal::delay(delay_ms);
     this->write(0);
   }
 };
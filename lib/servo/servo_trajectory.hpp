@@ -0,0 +1,347 @@
+/**
+ * @brief サーボの軌道生成
+ *
+ * 目標角度へ滑らかに動かす区間を順番に作り、タイマで50Hzごとに角度を補間してサーボへ書き込む。
+ * loop()では動かし方を指定するだけで、周期的に呼ぶ必要のある処理は無い。
+ */
+
+#ifndef SERVO_TRAJECTORY_HPP
+#define SERVO_TRAJECTORY_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <hal.hpp>
+#include "servo.hpp"
+
+//! 区間内での動き方
+enum class ServoProfile
+{
+  trapezoid, // 等加速・等速・等減速
+  min_jerk   // 躍度最小、始めと終わりで加速度も0になる
+};
+
+//! 動作パターンの1区間
+struct ServoWaypoint
+{
+  int angle;              // 目標角度[deg]
+  unsigned long move_ms;  // 目標角度まで動く時間[ms]
+  unsigned long hold_ms;  // 着いてから次の区間までとどまる時間[ms]
+};
+
+/**
+ * @class ServoTrajectory
+ * @brief 複数のサーボを、区間毎に補間しながら動かすクラス
+ *
+ * 動かし方は以下から選ぶ。区間が終わると、パターンに従って次の区間を作る。
+ * - move_to(): 1回だけ指定の角度へ動かす
+ * - play_script(): 決められた区間を順番に動かす
+ * - play_random(): ランダムな間隔でランダムな角度へ動かす
+ * - play_oscillation(): ランダムな角度とその反対側を同じ間隔で行き来する
+ */
+class ServoTrajectory
+{
+public:
+  static constexpr size_t MAX_SERVO_NUM = 8;
+  static constexpr size_t MAX_WAYPOINT_NUM = 8;
+  // 角度を更新する周期、サーボのPWM周期と同じ50Hz
+  static constexpr uint32_t PERIOD_US = 20000;
+
+  /**
+   * @brief サーボを追加する、begin()の前に呼ぶ
+   * @param servo 動かすサーボ、begin()の後はこのクラス以外から書き込まないこと
+   * @param profile 区間内での動き方
+   * @return int サーボの番号、追加できなければ-1
+   */
+  int add(M5Servo &servo, ServoProfile profile = ServoProfile::min_jerk)
+  {
+    if (_timer || _track_num >= MAX_SERVO_NUM)
+    {
+      return -1;
+    }
+    Track &track = _tracks[_track_num];
+    track.servo = &servo;
+    track.profile = profile;
+    track.from_angle = servo.read();
+    track.to_angle = track.from_angle;
+    track.written_angle = track.from_angle;
+    return static_cast<int>(_track_num++);
+  }
+  /**
+   * @brief 角度の更新を開始する
+   * @return bool true:成功, false:タイマを作れなかった
+   */
+  bool begin(void)
+  {
+    if (_timer)
+    {
+      return false;
+    }
+    _timer = hal::make_periodic_timer(ServoTrajectory::_on_timer, this, "servo");
+    return _timer->start(PERIOD_US);
+  }
+  /**
+   * @brief 今の角度から指定の角度へ1回だけ動かす
+   * @param index サーボの番号
+   * @param angle 目標角度[deg]
+   * @param move_ms 動く時間[ms]
+   */
+  void move_to(int index, int angle, unsigned long move_ms)
+  {
+    _update(index, [angle, move_ms](Track &track, unsigned long now) {
+      track.mode = Mode::single;
+      _start_segment(track, now, angle, move_ms, 0);
+    });
+  }
+  /**
+   * @brief 決められた区間を順番に動かす
+   * @param index サーボの番号
+   * @param waypoints 区間の配列、中身はコピーする
+   * @param waypoint_num 区間の数、MAX_WAYPOINT_NUMを超えた分は無視する
+   * @param is_loop true:最後まで動いたら最初に戻る, false:最後の区間で止まる
+   */
+  void play_script(int index, const ServoWaypoint *waypoints, size_t waypoint_num, bool is_loop = true)
+  {
+    if (waypoint_num == 0)
+    {
+      return;
+    }
+    _update(index, [waypoints, waypoint_num, is_loop](Track &track, unsigned long now) {
+      track.mode = Mode::script;
+      track.waypoint_num = waypoint_num;
+      if (track.waypoint_num > MAX_WAYPOINT_NUM)
+      {
+        track.waypoint_num = MAX_WAYPOINT_NUM;
+      }
+      for (size_t i = 0; i < track.waypoint_num; i++)
+      {
+        track.waypoints[i] = waypoints[i];
+      }
+      track.waypoint_index = 0;
+      track.is_loop = is_loop;
+      const ServoWaypoint &first = track.waypoints[0];
+      _start_segment(track, now, first.angle, first.move_ms, first.hold_ms);
+    });
+  }
+  /**
+   * @brief ランダムな間隔でランダムな角度へ動かし続ける
+   * @param index サーボの番号
+   * @param min_angle, max_angle 角度の範囲[deg]
+   * @param min_interval_ms, max_interval_ms 角度を変える間隔の範囲[ms]
+   * @param move_ms 動く時間[ms]、間隔より長ければ間隔に合わせる
+   */
+  void play_random(int index, int min_angle, int max_angle,
+                   unsigned long min_interval_ms, unsigned long max_interval_ms, unsigned long move_ms)
+  {
+    _update(index, [=](Track &track, unsigned long now) {
+      track.mode = Mode::random;
+      track.min_angle = min_angle;
+      track.max_angle = max_angle;
+      track.min_interval_ms = min_interval_ms;
+      track.max_interval_ms = max_interval_ms;
+      track.move_ms = move_ms;
+      _next_segment(track, now);
+    });
+  }
+  /**
+   * @brief ランダムな角度と、その反対側の角度を行き来させる
+   * @param index サーボの番号
+   * @param amplitude 角度の範囲、-amplitude~amplitude[deg]
+   * @param min_interval_ms, max_interval_ms 行きと帰りの間隔の範囲[ms]、行きと帰りは同じ間隔にする
+   * @param move_ms 動く時間[ms]、間隔より長ければ間隔に合わせる
+   */
+  void play_oscillation(int index, int amplitude,
+                        unsigned long min_interval_ms, unsigned long max_interval_ms, unsigned long move_ms)
+  {
+    _update(index, [=](Track &track, unsigned long now) {
+      track.mode = Mode::oscillation;
+      track.min_angle = -amplitude;
+      track.max_angle = amplitude;
+      track.min_interval_ms = min_interval_ms;
+      track.max_interval_ms = max_interval_ms;
+      track.move_ms = move_ms;
+      track.is_reversing = true;
+      _next_segment(track, now);
+    });
+  }
+  //! 今の角度で止める
+  void stop(int index)
+  {
+    _update(index, [](Track &track, unsigned long now) {
+      track.mode = Mode::single;
+      _start_segment(track, now, track.written_angle, 0, 0);
+    });
+  }
+
+private:
+  enum class Mode
+  {
+    single,
+    script,
+    random,
+    oscillation
+  };
+  struct Track
+  {
+    M5Servo *servo = nullptr;
+    ServoProfile profile = ServoProfile::min_jerk;
+    Mode mode = Mode::single;
+    // 今の区間
+    int from_angle = 0;
+    int to_angle = 0;
+    int written_angle = 0;
+    unsigned long segment_start_ms = 0;
+    unsigned long segment_move_ms = 0;
+    unsigned long segment_hold_ms = 0;
+    bool is_segment_done = true;
+    // play_script()のパターン
+    std::array<ServoWaypoint, MAX_WAYPOINT_NUM> waypoints{};
+    size_t waypoint_num = 0;
+    size_t waypoint_index = 0;
+    bool is_loop = false;
+    // play_random()とplay_oscillation()のパターン
+    int min_angle = 0;
+    int max_angle = 0;
+    unsigned long min_interval_ms = 0;
+    unsigned long max_interval_ms = 0;
+    unsigned long move_ms = 0;
+    unsigned long interval_ms = 0;
+    bool is_reversing = false;
+  };
+
+  std::array<Track, MAX_SERVO_NUM> _tracks{};
+  size_t _track_num = 0;
+  std::unique_ptr<hal::PeriodicTimer> _timer;
+  // loop()側からの指定とタイマ側の更新が同時に区間を触らないようにする
+  std::unique_ptr<hal::Mutex> _mutex = hal::make_mutex();
+
+  template <typename F>
+  void _update(int index, F func)
+  {
+    if (index < 0 || static_cast<size_t>(index) >= _track_num)
+    {
+      return;
+    }
+    unsigned long now = hal::millis();
+    _mutex->lock();
+    func(_tracks[index], now);
+    _mutex->unlock();
+  }
+  static void _on_timer(void *arg)
+  {
+    static_cast<ServoTrajectory *>(arg)->_tick(hal::millis());
+  }
+  void _tick(unsigned long now)
+  {
+    for (size_t i = 0; i < _track_num; i++)
+    {
+      Track &track = _tracks[i];
+      _mutex->lock();
+      int angle = _angle_at(track, now);
+      bool is_changed = (angle != track.written_angle);
+      track.written_angle = angle;
+      if (!track.is_segment_done && now - track.segment_start_ms >= track.segment_move_ms + track.segment_hold_ms)
+      {
+        _next_segment(track, now);
+      }
+      _mutex->unlock();
+      // PWMの書き込みはロックの外で行う
+      if (is_changed)
+      {
+        track.servo->write(angle);
+      }
+    }
+  }
+  static int _angle_at(const Track &track, unsigned long now)
+  {
+    unsigned long elapsed_ms = now - track.segment_start_ms;
+    if (elapsed_ms >= track.segment_move_ms)
+    {
+      return track.to_angle;
+    }
+    float t = static_cast<float>(elapsed_ms) / track.segment_move_ms;
+    float s = (track.profile == ServoProfile::trapezoid) ? _trapezoid(t) : _min_jerk(t);
+    return track.from_angle + static_cast<int>(lroundf((track.to_angle - track.from_angle) * s));
+  }
+  //! 区間の1/4ずつで加速・減速する台形速度での移動量、t,戻り値とも0~1
+  static float _trapezoid(float t)
+  {
+    const float accel_t = 0.25f;
+    const float max_v = 1.0f / (1.0f - accel_t);
+    if (t < accel_t)
+    {
+      return 0.5f * max_v / accel_t * t * t;
+    }
+    if (t > 1.0f - accel_t)
+    {
+      float rest = 1.0f - t;
+      return 1.0f - 0.5f * max_v / accel_t * rest * rest;
+    }
+    return max_v * (t - 0.5f * accel_t);
+  }
+  //! 躍度最小の移動量、t,戻り値とも0~1
+  static float _min_jerk(float t)
+  {
+    return t * t * t * (10.0f + t * (-15.0f + t * 6.0f));
+  }
+  static void _start_segment(Track &track, unsigned long now, int angle, unsigned long move_ms, unsigned long hold_ms)
+  {
+    track.from_angle = track.written_angle;
+    track.to_angle = angle;
+    track.segment_start_ms = now;
+    track.segment_move_ms = move_ms;
+    track.segment_hold_ms = hold_ms;
+    track.is_segment_done = false;
+  }
+  //! パターンに従って次の区間を作る
+  static void _next_segment(Track &track, unsigned long now)
+  {
+    switch (track.mode)
+    {
+    case Mode::single:
+      track.is_segment_done = true;
+      break;
+    case Mode::script:
+    {
+      track.waypoint_index++;
+      if (track.waypoint_index >= track.waypoint_num)
+      {
+        if (!track.is_loop)
+        {
+          track.is_segment_done = true;
+          break;
+        }
+        track.waypoint_index = 0;
+      }
+      const ServoWaypoint &waypoint = track.waypoints[track.waypoint_index];
+      _start_segment(track, now, waypoint.angle, waypoint.move_ms, waypoint.hold_ms);
+      break;
+    }
+    case Mode::random:
+    {
+      unsigned long interval_ms = hal::random(track.min_interval_ms, track.max_interval_ms + 1);
+      int angle = static_cast<int>(hal::random(track.min_angle, track.max_angle + 1));
+      unsigned long move_ms = std::min(track.move_ms, interval_ms);
+      _start_segment(track, now, angle, move_ms, interval_ms - move_ms);
+      break;
+    }
+    case Mode::oscillation:
+    {
+      // 新しい角度を選んだら、同じ間隔でその反対側へ戻る
+      int angle = -track.to_angle;
+      if (track.is_reversing)
+      {
+        track.interval_ms = hal::random(track.min_interval_ms, track.max_interval_ms + 1);
+        angle = static_cast<int>(hal::random(track.min_angle, track.max_angle + 1));
+      }
+      track.is_reversing = !track.is_reversing;
+      unsigned long move_ms = std::min(track.move_ms, track.interval_ms);
+      _start_segment(track, now, angle, move_ms, track.interval_ms - move_ms);
+      break;
+    }
+    }
+  }
+};
+
+#endif // SERVO_TRAJECTORY_HPP
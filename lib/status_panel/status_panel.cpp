@@ -0,0 +1,111 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include "status_panel.hpp"
+
+using namespace status_panel;
+
+namespace
+{
+constexpr int COLOR_DEPTH = 16;
+constexpr uint32_t COLOR_FOREGROUND = TFT_WHITE;
+constexpr uint32_t COLOR_BACKGROUND = TFT_BLACK;
+} // namespace
+
+int StatusPanel::add_field(int x, int y, int width)
+{
+  if (_is_begun || _field_num >= MAX_FIELD_NUM || width <= 0)
+  {
+    return -1;
+  }
+  Field &field = _fields[_field_num];
+  field.x = x;
+  field.y = y;
+  field.width = width;
+  return static_cast<int>(_field_num++);
+}
+
+bool StatusPanel::begin()
+{
+  _height = _lcd.fontHeight();
+  bool is_succeeded = true;
+  for (size_t i = 0; i < _field_num; i++)
+  {
+    Field &field = _fields[i];
+    field.sprite.setColorDepth(COLOR_DEPTH);
+    if (field.sprite.createSprite(field.width, _height) == nullptr)
+    {
+      is_succeeded = false;
+      continue;
+    }
+    field.sprite.setTextColor(COLOR_FOREGROUND, COLOR_BACKGROUND);
+  }
+  _lcd.initDMA();
+  _is_begun = true;
+  invalidate();
+  return is_succeeded;
+}
+
+bool StatusPanel::set_text(int field_index, const char *format, ...)
+{
+  if (field_index < 0 || static_cast<size_t>(field_index) >= _field_num)
+  {
+    return false;
+  }
+  char text[MAX_TEXT_LENGTH + 1];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+
+  Field &field = _fields[field_index];
+  if (strcmp(field.text, text) == 0)
+  {
+    return false;
+  }
+  memcpy(field.text, text, sizeof(text));
+  field.is_dirty = true;
+  return true;
+}
+
+size_t StatusPanel::render()
+{
+  if (!_is_begun)
+  {
+    return 0;
+  }
+  size_t rendered_num = 0;
+  for (size_t i = 0; i < _field_num; i++)
+  {
+    Field &field = _fields[i];
+    if (!field.is_dirty || field.sprite.getBuffer() == nullptr)
+    {
+      continue;
+    }
+    if (rendered_num == 0)
+    {
+      // 前回のrender()で送ったスプライトを書き換えないよう、転送が終わるのを待つ
+      _lcd.waitDMA();
+      _lcd.startWrite();
+    }
+    field.sprite.fillSprite(COLOR_BACKGROUND);
+    field.sprite.drawString(field.text, 0, 0);
+    _lcd.pushImageDMA(field.x, field.y, field.width, _height,
+                      static_cast<const lgfx::swap565_t *>(field.sprite.getBuffer()));
+    field.is_dirty = false;
+    rendered_num++;
+  }
+  if (rendered_num > 0)
+  {
+    _lcd.endWrite();
+  }
+  return rendered_num;
+}
+
+void StatusPanel::invalidate()
+{
+  for (size_t i = 0; i < _field_num; i++)
+  {
+    _fields[i].is_dirty = true;
+  }
+}
@@ -0,0 +1,81 @@
+/**
+ * @brief LCDに状態を表示するパネル
+ *
+ * 表示する文字列をフィールド毎に保持しておき、前回描画した内容から変わったフィールドだけを
+ * 小さなスプライトに描いてLCDへ送る。変化が無ければSPIの転送は発生しない。
+ */
+
+#ifndef STATUS_PANEL_HPP
+#define STATUS_PANEL_HPP
+
+#include <array>
+#include <cstddef>
+#include <LovyanGFX.hpp>
+
+namespace status_panel
+{
+
+/**
+ * @class StatusPanel
+ * @brief 変化したフィールドだけを描画する状態表示パネル
+ */
+class StatusPanel
+{
+public:
+  static constexpr size_t MAX_FIELD_NUM = 8;
+  // 1フィールドに表示できる最大文字数
+  static constexpr size_t MAX_TEXT_LENGTH = 47;
+
+  explicit StatusPanel(LGFX_Device &lcd) : _lcd(lcd) {}
+  /**
+   * @brief 表示するフィールドを追加する、begin()の前に呼ぶ
+   * @param x 左上のx座標
+   * @param y 左上のy座標
+   * @param width 幅、この幅に収まらない部分は表示されない
+   * @return int フィールド番号、追加できなければ-1
+   */
+  int add_field(int x, int y, int width);
+  /**
+   * @brief フィールド毎のスプライトを確保する、lcd.init()の後に1度だけ呼ぶ
+   * @return bool true:成功, false:スプライトを確保できなかった
+   */
+  bool begin();
+  /**
+   * @brief フィールドの表示内容を設定する
+   * @param field フィールド番号
+   * @param format printfと同じ書式
+   * @return bool true:前回の内容から変化した, false:変化していない
+   *
+   * ここでは文字列を保持するだけで、LCDへの描画はrender()で行う。
+   */
+  bool set_text(int field, const char *format, ...) __attribute__((format(printf, 3, 4)));
+  /**
+   * @brief 内容が変化したフィールドだけをLCDへ送る
+   * @return size_t 送ったフィールドの数
+   *
+   * DMAが使える場合は、1つ前のフィールドを転送している間に次のフィールドを描く。
+   */
+  size_t render();
+  //! 全フィールドを次のrender()で描き直す
+  void invalidate();
+
+private:
+  struct Field
+  {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    char text[MAX_TEXT_LENGTH + 1] = {};
+    bool is_dirty = true;
+    LGFX_Sprite sprite;
+  };
+
+  LGFX_Device &_lcd;
+  std::array<Field, MAX_FIELD_NUM> _fields;
+  size_t _field_num = 0;
+  int _height = 0;
+  bool _is_begun = false;
+};
+
+} // namespace status_panel
+#endif
@@ -0,0 +1,159 @@
+#include <hal.hpp>
+#include <i2c_bus.hpp>
+#include <metrics.hpp>
+#include "xiao_link.hpp"
+
+using namespace xiao_link;
+
+namespace
+{
+uint8_t checksum(const uint8_t *data, size_t length)
+{
+  uint8_t sum = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    sum ^= data[i];
+  }
+  return sum;
+}
+} // namespace
+
+Frame xiao_link::encode(const Message &message, uint8_t seq)
+{
+  Frame frame = {{FRAME_MAGIC, seq, static_cast<uint8_t>(message.phase), static_cast<uint8_t>(message.pattern), 0}};
+  frame[FRAME_SIZE - 1] = checksum(frame.data(), FRAME_SIZE - 1);
+  return frame;
+}
+
+bool xiao_link::decode(const uint8_t *data, size_t length, Message &message, uint8_t &seq)
+{
+  if (length != FRAME_SIZE || data[0] != FRAME_MAGIC || checksum(data, FRAME_SIZE - 1) != data[FRAME_SIZE - 1])
+  {
+    return false;
+  }
+  seq = data[1];
+  message.phase = static_cast<char>(data[2]);
+  message.pattern = static_cast<int8_t>(data[3]);
+  return true;
+}
+
+void Link::begin(Format format, bool use_ack)
+{
+  _format = format;
+  _use_ack = use_ack && (format == Format::framed);
+}
+
+bool Link::send(char phase, int pattern)
+{
+  Message message;
+  message.phase = phase;
+  message.pattern = static_cast<int8_t>((pattern < 0 || pattern > INT8_MAX) ? -1 : pattern);
+  if (_count > 0 && message.phase != PHASE_HIT)
+  {
+    const Message &last = _queue[(_head + _count - 1) % QUEUE_SIZE];
+    if (last.phase == message.phase && last.pattern == message.pattern)
+    {
+      // まだ送っていない同じ指示があれば、演出は1回で十分なのでまとめる
+      _coalesced_count++;
+      return false;
+    }
+  }
+  if (_count == QUEUE_SIZE)
+  {
+    _head = (_head + 1) % QUEUE_SIZE;
+    _count--;
+    _dropped_count++;
+  }
+  _queue[(_head + _count) % QUEUE_SIZE] = message;
+  _count++;
+  return true;
+}
+
+void Link::update(void)
+{
+  if (_count == 0)
+  {
+    return;
+  }
+  const Message message = _queue[_head];
+  _head = (_head + 1) % QUEUE_SIZE;
+  _count--;
+  // 送り直しでもseqは変えないので、XIAO側で重複を捨てられる
+  uint8_t seq = _seq++;
+  for (int i = 0; i <= MAX_RETRY_NUM; i++)
+  {
+    if (_transmit(message, seq))
+    {
+      _sent_count++;
+      return;
+    }
+  }
+  _lost_count++;
+  metrics::xiao_lost.increment();
+}
+
+bool Link::_transmit(const Message &message, uint8_t seq)
+{
+  return (_format == Format::framed) ? _transmit_framed(message, seq) : _transmit_legacy(message);
+}
+
+bool Link::_transmit_framed(const Message &message, uint8_t seq)
+{
+  Frame frame = encode(message, seq);
+  if (!_write(frame.data(), frame.size()))
+  {
+    return false;
+  }
+  return !_use_ack || _read_ack(seq);
+}
+
+bool Link::_transmit_legacy(const Message &message)
+{
+  uint8_t phase = static_cast<uint8_t>(message.phase);
+  if (!_write(&phase, 1))
+  {
+    return false;
+  }
+  if (message.pattern > 0 && message.pattern < 10)
+  {
+    uint8_t pattern = static_cast<uint8_t>(message.pattern + '0');
+    // phaseは届いているので、patternだけ送り直せるようにはしない
+    _write(&pattern, 1);
+  }
+  return true;
+}
+
+bool Link::_write(const uint8_t *data, size_t length)
+{
+  i2c_bus::Lock lock(_bus);
+  metrics::ScopedTimer timer(metrics::i2c_xiao);
+  hal::I2cBus &bus = hal::i2c(_bus);
+  bus.begin_transmission(_address);
+  bus.write(data, length);
+  if (bus.end_transmission() != 0)
+  {
+    metrics::i2c_errors.increment();
+    return false;
+  }
+  return true;
+}
+
+bool Link::_read_ack(uint8_t seq)
+{
+  uint8_t ack[ACK_SIZE] = {};
+  {
+    i2c_bus::Lock lock(_bus);
+    metrics::ScopedTimer timer(metrics::i2c_xiao);
+    hal::I2cBus &bus = hal::i2c(_bus);
+    if (bus.request_from(_address, static_cast<uint8_t>(ACK_SIZE)) != ACK_SIZE)
+    {
+      metrics::i2c_errors.increment();
+      return false;
+    }
+    for (size_t i = 0; i < ACK_SIZE; i++)
+    {
+      ack[i] = static_cast<uint8_t>(bus.read());
+    }
+  }
+  return (ack[0] == seq && ack[1] == 1);
+}
@@ -0,0 +1,127 @@
+/**
+ * @brief XIAO(演出用マイコン)へのI2C送信
+ *
+ * 演出の指示はキューに積むだけにして、I2Cへの送信はupdate()でまとめて行う。
+ * 射撃判定の応答や命中時の処理が、演出用マイコンとの通信で待たされることは無い。
+ */
+
+#ifndef XIAO_LINK_HPP
+#define XIAO_LINK_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace xiao_link
+{
+
+//! 演出の指示
+struct Message
+{
+  char phase = 0;      // 演出の段階、'r':準備, 'h':命中, 'e':終了 など
+  int8_t pattern = -1; // 演出パターンの番号、指定しない場合は-1
+};
+
+// 命中の演出の段階、命中の数だけ演出するのでまとめない
+constexpr char PHASE_HIT = 'h';
+
+/**
+ * @brief 1回のトランザクションで送るフレーム
+ *
+ * | 0     | 1   | 2     | 3       | 4        |
+ * | magic | seq | phase | pattern | checksum |
+ *
+ * checksumはmagicからpatternまでのXOR。
+ * ACKを使う場合、XIAOはrequestFrom()に対して、最後に受け取ったseqと、checksumが正しければ1を返す。
+ */
+constexpr uint8_t FRAME_MAGIC = 0xA5;
+constexpr size_t FRAME_SIZE = 5;
+constexpr size_t ACK_SIZE = 2;
+using Frame = std::array<uint8_t, FRAME_SIZE>;
+
+Frame encode(const Message &message, uint8_t seq);
+/**
+ * @brief フレームを読み取る、XIAO側での確認用
+ * @return bool true:正しいフレーム, false:magicかchecksumが違う
+ */
+bool decode(const uint8_t *data, size_t length, Message &message, uint8_t &seq);
+
+/**
+ * @class Link
+ * @brief XIAOへの送信キュー
+ *
+ * send()とupdate()は同じタスクから呼ぶこと。
+ */
+class Link
+{
+public:
+  static constexpr uint8_t DEFAULT_ADDRESS = 0x7D;
+  static constexpr size_t QUEUE_SIZE = 8;
+  // 1つのメッセージを送り直す最大回数
+  static constexpr int MAX_RETRY_NUM = 2;
+
+  enum class Format
+  {
+    framed, // 1トランザクションでフレームを送る
+    legacy  // フレームに対応していないXIAO向け、phaseとpatternを1文字ずつ別のトランザクションで送る
+  };
+
+  /**
+   * @param address XIAOのI2Cアドレス
+   * @param bus XIAOを繋いだバス、0:Wire, 1:Wire1
+   */
+  explicit Link(uint8_t address = DEFAULT_ADDRESS, int bus = 0) : _address(address), _bus(bus) {}
+  /**
+   * @brief 送信方法を設定する
+   * @param format 送信する形式、既定はフレームに対応していないXIAOでも動くlegacy
+   * @param use_ack true:送る度にACKを読み、届いたことを確認する(framedの時だけ有効)
+   */
+  void begin(Format format = Format::legacy, bool use_ack = false);
+  /**
+   * @brief 送信キューに積む、I2Cの通信はしない
+   * @param phase 演出の段階
+   * @param pattern 演出パターンの番号、指定しない場合は-1
+   * @return bool true:積んだ, false:直前に積んだものと同じなのでまとめた
+   *
+   * 命中(PHASE_HIT)は続けて来ても全て積むので、短い間隔の命中もそれぞれ演出される。
+   * キューが一杯の場合は、一番古いものを捨てて積む。
+   */
+  bool send(char phase, int pattern = -1);
+  /**
+   * @brief キューの先頭を1つだけ送る
+   *
+   * 1回の呼び出しで行う通信は、送り直しを含めて最大MAX_RETRY_NUM+1回。
+   */
+  void update(void);
+  size_t pending(void) const { return _count; }
+  uint32_t sent_count(void) const { return _sent_count; }
+  //! 送り直しても届かなかった数
+  uint32_t lost_count(void) const { return _lost_count; }
+  //! 直前と同じ指示だったのでまとめた数、命中は数えない
+  uint32_t coalesced_count(void) const { return _coalesced_count; }
+  //! キューが一杯で捨てた数
+  uint32_t dropped_count(void) const { return _dropped_count; }
+
+private:
+  uint8_t _address = DEFAULT_ADDRESS;
+  int _bus = 0;
+  Format _format = Format::legacy;
+  bool _use_ack = false;
+  std::array<Message, QUEUE_SIZE> _queue{};
+  size_t _head = 0;
+  size_t _count = 0;
+  uint8_t _seq = 0;
+  uint32_t _sent_count = 0;
+  uint32_t _lost_count = 0;
+  uint32_t _coalesced_count = 0;
+  uint32_t _dropped_count = 0;
+
+  bool _transmit(const Message &message, uint8_t seq);
+  bool _transmit_framed(const Message &message, uint8_t seq);
+  bool _transmit_legacy(const Message &message);
+  bool _write(const uint8_t *data, size_t length);
+  bool _read_ack(uint8_t seq);
+};
+
+} // namespace xiao_link
+#endif
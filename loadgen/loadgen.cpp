@@ -0,0 +1,772 @@
+/**
+ * @file loadgen.cpp
+ * @brief センターの代わりに、シミュレーションのまとユニットへ射撃判定要求を送る負荷試験ツール
+ *
+ * sim_unit(pio run -e native でビルドされる)をN個起動し、localhostの別々のポートで待ち受けさせる。
+ * 銃の動きを真似て、まとの赤外線受信状態をsim_unitの標準入力から変えてから"/"かUDPで撃ち、
+ * 応答と実際の状態(正解)を比べて、命中までの遅れ、見逃し、誤命中を数える。
+ *
+ * 使い方: pio run -e native && pio run -e native-loadgen
+ *         .pio/build/native-loadgen/program --units 4 --rate 40 --concurrency 8 --duration 10
+ * 引数の一覧は --help で表示する。
+ *
+ * 銃のモデル
+ * - 同時に撃つ射手(concurrency)毎に別の銃番号を持たせ、誰の弾が当たったかを区別できるようにする
+ * - 命中させる場合は、生存していて誰も照らしていないまとを1つ選び、ir_lead_msだけ赤外線を当ててから撃つ
+ *   撃った後はir_hold_msまで当て続け、それから消す
+ * - 外す場合は、どのまとにも赤外線を当てずに撃つ
+ * - ユニットの生存しているまとが無くなったら"/init"(UDPの場合は初期化要求)を送る
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ShotProtocol.hpp"
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+enum class Protocol
+{
+  http,
+  udp,
+  mixed // 射手毎にHTTPとUDPを交互に割り当てる
+};
+
+struct Options
+{
+  int unit_num = 3;
+  int target_num = 9;
+  int base_port = 18000; // ユニットiはHTTPがbase_port+2i、UDPがbase_port+2i+1
+  double rate = 20;      // 全体で1秒あたりに撃つ回数
+  int concurrency = 4;   // 同時に撃つ射手の数
+  double duration_s = 10;
+  Protocol protocol = Protocol::mixed;
+  double hit_ratio = 0.7; // 命中させる射撃の割合
+  int ir_lead_ms = 30;    // 撃つ前に赤外線を当てておく時間
+  int ir_hold_ms = 60;    // 赤外線を当て始めてから消すまでの時間
+  int hit_window_ms = 150; // ユニットの射撃判定で遡る時間、見逃した後はこれだけ待ってから次を撃つ
+  int timeout_ms = 500;
+  bool is_real_time = true;
+  bool is_verbose = false;
+  const char *unit_program = ".pio/build/native/program";
+  const char *out_path = nullptr;
+};
+
+//! 起動したまとユニットと、その正解の状態
+struct Unit
+{
+  pid_t pid = -1;
+  int command_fd = -1; // sim_unitの標準入力
+  uint16_t http_port = 0;
+  uint16_t udp_port = 0;
+  std::atomic<uint32_t> udp_seq{0};
+  std::mutex mutex;
+  std::vector<bool> alive;
+  std::vector<bool> lit;
+  bool is_initializing = false;
+};
+
+//! 1回の射撃の正解と結果
+struct ShotResult
+{
+  bool is_error = false;    // タイムアウトや503
+  bool is_hit = false;      // ユニットが命中と答えた
+  int target_id = -1;       // UDPの場合に分かる、命中したまと
+  uint32_t latency_us = 0;
+};
+
+//! 射手毎の集計、最後にまとめる
+struct Stats
+{
+  uint32_t shots = 0;
+  uint32_t expected_hits = 0;
+  uint32_t hits = 0;
+  uint32_t misses = 0;     // 当てたのに外れと答えた
+  uint32_t false_hits = 0; // 当てていない(または別の)まとに命中と答えた
+  uint32_t errors = 0;
+  uint32_t inits = 0;
+  std::vector<uint32_t> latencies_us;
+  std::vector<uint32_t> hit_latencies_us;
+  std::vector<uint32_t> init_latencies_us;
+};
+
+Options options;
+std::vector<std::unique_ptr<Unit>> units;
+
+uint32_t elapsed_us(Clock::time_point start)
+{
+  return static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+}
+
+sockaddr_in localhost_address(uint16_t port)
+{
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  return addr;
+}
+
+void set_timeout(int fd, int timeout_ms)
+{
+  timeval timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * @brief HTTPでGETする
+ * @return int ステータスコード、通信できなければ0
+ */
+int http_get(uint16_t port, const char *target, std::string &body)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    return 0;
+  }
+  set_timeout(fd, options.timeout_ms);
+  sockaddr_in addr = localhost_address(port);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+  {
+    close(fd);
+    return 0;
+  }
+  char request[128];
+  int length = snprintf(request, sizeof(request),
+                        "GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n", target);
+  send(fd, request, length, MSG_NOSIGNAL);
+  std::string response;
+  char buf[512];
+  ssize_t received;
+  while ((received = recv(fd, buf, sizeof(buf), 0)) > 0)
+  {
+    response.append(buf, received);
+  }
+  close(fd);
+  int code = 0;
+  if (sscanf(response.c_str(), "HTTP/1.%*d %d", &code) != 1)
+  {
+    return 0;
+  }
+  size_t body_begin = response.find("\r\n\r\n");
+  body = (body_begin == std::string::npos) ? "" : response.substr(body_begin + 4);
+  return code;
+}
+
+/**
+ * @brief ShotProtocol.hppの要求をUDPで送り、同じseqの応答を待つ
+ * @return bool true:応答があった, false:タイムアウト
+ */
+bool udp_request(int fd, Unit &unit, shot_protocol::MessageType type, uint8_t gun_num, shot_protocol::Reply &reply)
+{
+  shot_protocol::Request request;
+  request.type = type;
+  request.seq = ++unit.udp_seq;
+  request.gun_num = gun_num;
+  shot_protocol::Buffer buf = shot_protocol::encode(request);
+  sockaddr_in addr = localhost_address(unit.udp_port);
+  sendto(fd, buf.data(), buf.size(), 0, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+  Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(options.timeout_ms);
+  while (Clock::now() < deadline)
+  {
+    uint8_t data[shot_protocol::MESSAGE_SIZE + 1];
+    ssize_t length = recv(fd, data, sizeof(data), 0);
+    if (length <= 0)
+    {
+      return false;
+    }
+    // 前にタイムアウトした要求への応答は読み捨てる
+    if (shot_protocol::decode(data, length, reply) && reply.seq == request.seq)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+//! まとの赤外線受信状態を変える
+void set_ir(Unit &unit, int target_id, int gun_num)
+{
+  char command[32];
+  int length = snprintf(command, sizeof(command), "ir %d %d\n", target_id, gun_num);
+  std::lock_guard<std::mutex> lock(unit.mutex);
+  if (write(unit.command_fd, command, length) != length)
+  {
+    perror("write command");
+  }
+}
+
+bool start_unit(Unit &unit, int unit_id)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+  {
+    perror("pipe");
+    return false;
+  }
+  unit.http_port = static_cast<uint16_t>(options.base_port + unit_id * 2);
+  unit.udp_port = static_cast<uint16_t>(options.base_port + unit_id * 2 + 1);
+  unit.alive.assign(options.target_num, true);
+  unit.lit.assign(options.target_num, false);
+  unit.pid = fork();
+  if (unit.pid < 0)
+  {
+    perror("fork");
+    return false;
+  }
+  if (unit.pid == 0)
+  {
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    if (!options.is_verbose)
+    {
+      int null_fd = open("/dev/null", O_WRONLY);
+      dup2(null_fd, STDOUT_FILENO);
+      close(null_fd);
+    }
+    std::string id_s = std::to_string(unit_id);
+    std::string targets_s = std::to_string(options.target_num);
+    std::string http_s = std::to_string(unit.http_port);
+    std::string udp_s = std::to_string(unit.udp_port);
+    std::vector<const char *> args = {options.unit_program, "--unit-id", id_s.c_str(), "--targets", targets_s.c_str(),
+                                      "--http-port", http_s.c_str(), "--udp-port", udp_s.c_str()};
+    if (options.is_real_time)
+    {
+      args.push_back("--real-time");
+    }
+    args.push_back(nullptr);
+    execv(options.unit_program, const_cast<char *const *>(args.data()));
+    perror(options.unit_program);
+    _exit(127);
+  }
+  close(fds[0]);
+  unit.command_fd = fds[1];
+  return true;
+}
+
+//! HTTPで応答が返ってくるまで待つ
+bool wait_unit_ready(Unit &unit)
+{
+  Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+  while (Clock::now() < deadline)
+  {
+    std::string body;
+    if (http_get(unit.http_port, "/init", body) == 200)
+    {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  return false;
+}
+
+void stop_units(void)
+{
+  for (auto &unit : units)
+  {
+    if (unit->pid > 0)
+    {
+      kill(unit->pid, SIGTERM);
+      waitpid(unit->pid, nullptr, 0);
+      close(unit->command_fd);
+    }
+  }
+}
+
+/**
+ * @class Shooter
+ * @brief 1人の射手、自分の銃番号で決まった間隔で撃ち続ける
+ */
+class Shooter
+{
+public:
+  Shooter(int index, Protocol protocol)
+      : _gun_num(index + 1), _protocol(protocol), _random(static_cast<uint32_t>(index) * 7919 + 1)
+  {
+    _udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    set_timeout(_udp_fd, options.timeout_ms);
+  }
+  ~Shooter() { close(_udp_fd); }
+  void run(Clock::time_point start, Clock::time_point end, double interval_s)
+  {
+    // 射手同士で撃つ時刻がそろわないよう、最初だけずらす
+    Clock::time_point next = start + std::chrono::microseconds(
+                                         static_cast<long>(interval_s * 1e6 * (_gun_num - 1) / options.concurrency));
+    while (next < end)
+    {
+      std::this_thread::sleep_until(next);
+      next += std::chrono::microseconds(static_cast<long>(interval_s * 1e6));
+      _shoot_once();
+    }
+  }
+  Stats &stats(void) { return _stats; }
+
+private:
+  int _gun_num;
+  Protocol _protocol;
+  std::mt19937 _random;
+  int _udp_fd = -1;
+  Stats _stats;
+
+  void _shoot_once(void)
+  {
+    Unit &unit = *units[_random() % units.size()];
+    bool is_aiming = std::uniform_real_distribution<double>(0, 1)(_random) < options.hit_ratio;
+    int target_id = -1;
+    bool needs_init = false;
+    {
+      std::lock_guard<std::mutex> lock(unit.mutex);
+      if (unit.is_initializing)
+      {
+        // 他の射手が初期化しているので、今回は外す射撃にする
+        is_aiming = false;
+      }
+      else if (std::find(unit.alive.begin(), unit.alive.end(), true) == unit.alive.end())
+      {
+        needs_init = true;
+        unit.is_initializing = true;
+      }
+      else if (is_aiming)
+      {
+        std::vector<int> candidates;
+        for (int i = 0; i < options.target_num; i++)
+        {
+          if (unit.alive[i] && !unit.lit[i])
+          {
+            candidates.push_back(i);
+          }
+        }
+        if (candidates.empty())
+        {
+          is_aiming = false;
+        }
+        else
+        {
+          target_id = candidates[_random() % candidates.size()];
+          unit.lit[target_id] = true;
+        }
+      }
+    }
+    if (needs_init)
+    {
+      _init(unit);
+      return;
+    }
+
+    Clock::time_point ir_start = Clock::now();
+    if (target_id >= 0)
+    {
+      set_ir(unit, target_id, _gun_num);
+      std::this_thread::sleep_for(std::chrono::milliseconds(options.ir_lead_ms));
+    }
+    ShotResult result = _send_shot(unit);
+    if (target_id >= 0)
+    {
+      std::this_thread::sleep_until(ir_start + std::chrono::milliseconds(options.ir_hold_ms));
+      set_ir(unit, target_id, 0);
+    }
+    _record(unit, target_id, result);
+  }
+
+  ShotResult _send_shot(Unit &unit)
+  {
+    ShotResult result;
+    Clock::time_point start = Clock::now();
+    if (_protocol == Protocol::udp)
+    {
+      shot_protocol::Reply reply;
+      if (!udp_request(_udp_fd, unit, shot_protocol::MessageType::shoot, static_cast<uint8_t>(_gun_num), reply))
+      {
+        result.is_error = true;
+        return result;
+      }
+      result.is_hit = (reply.gun_num != 0);
+      result.target_id = (reply.target_id == shot_protocol::NO_TARGET) ? -1 : reply.target_id;
+    }
+    else
+    {
+      char target[32];
+      snprintf(target, sizeof(target), "/?gun_num=%d", _gun_num);
+      std::string body;
+      if (http_get(unit.http_port, target, body) != 200)
+      {
+        result.is_error = true;
+        return result;
+      }
+      int gun_num = 0;
+      sscanf(body.c_str(), "target=%d", &gun_num);
+      result.is_hit = (gun_num != 0);
+    }
+    result.latency_us = elapsed_us(start);
+    return result;
+  }
+
+  void _record(Unit &unit, int target_id, const ShotResult &result)
+  {
+    _stats.shots++;
+    if (target_id >= 0)
+    {
+      _stats.expected_hits++;
+    }
+    bool is_missed = false;
+    {
+      std::lock_guard<std::mutex> lock(unit.mutex);
+      if (target_id >= 0)
+      {
+        unit.lit[target_id] = false;
+      }
+      if (result.is_error)
+      {
+        _stats.errors++;
+        // 応答が無くても判定されている場合があるので、正解の状態が分からなくなる
+        is_missed = (target_id >= 0);
+      }
+      else if (result.is_hit && target_id >= 0 && (result.target_id < 0 || result.target_id == target_id))
+      {
+        _stats.hits++;
+        unit.alive[target_id] = false;
+        _stats.hit_latencies_us.push_back(result.latency_us);
+      }
+      else if (result.is_hit)
+      {
+        _stats.false_hits++;
+        if (result.target_id >= 0)
+        {
+          unit.alive[result.target_id] = false;
+        }
+        is_missed = (target_id >= 0);
+      }
+      else if (target_id >= 0)
+      {
+        _stats.misses++;
+        is_missed = true;
+      }
+    }
+    if (!result.is_error)
+    {
+      _stats.latencies_us.push_back(result.latency_us);
+    }
+    if (is_missed)
+    {
+      // 見逃したまとにはまだ受信履歴が残っているので、次の外す射撃で当たらないよう履歴が消えるまで待つ
+      std::this_thread::sleep_for(std::chrono::milliseconds(options.hit_window_ms + 20));
+    }
+  }
+
+  void _init(Unit &unit)
+  {
+    Clock::time_point start = Clock::now();
+    bool is_ok = false;
+    if (_protocol == Protocol::udp)
+    {
+      shot_protocol::Reply reply;
+      is_ok = udp_request(_udp_fd, unit, shot_protocol::MessageType::init, 0, reply);
+    }
+    else
+    {
+      std::string body;
+      is_ok = (http_get(unit.http_port, "/init", body) == 200);
+    }
+    uint32_t latency_us = elapsed_us(start);
+    std::lock_guard<std::mutex> lock(unit.mutex);
+    unit.is_initializing = false;
+    if (!is_ok)
+    {
+      _stats.errors++;
+      return;
+    }
+    _stats.inits++;
+    _stats.init_latencies_us.push_back(latency_us);
+    unit.alive.assign(options.target_num, true);
+  }
+};
+
+uint32_t percentile(std::vector<uint32_t> &values, double p)
+{
+  if (values.empty())
+  {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+  return values[index];
+}
+
+void append(std::vector<uint32_t> &to, const std::vector<uint32_t> &from)
+{
+  to.insert(to.end(), from.begin(), from.end());
+}
+
+void print_latencies(FILE *file, const char *name, std::vector<uint32_t> &values, bool is_json, bool is_last)
+{
+  if (is_json)
+  {
+    fprintf(file, "    \"%s\": {\"count\": %zu, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u}%s\n",
+            name, values.size(), percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99),
+            percentile(values, 1.0), is_last ? "" : ",");
+    return;
+  }
+  fprintf(file, "%-8s n=%-6zu p50=%6uus p90=%6uus p99=%6uus max=%6uus\n",
+          name, values.size(), percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99),
+          percentile(values, 1.0));
+}
+
+void report(Stats &total, double elapsed_s)
+{
+  double miss_rate = (total.expected_hits == 0) ? 0 : static_cast<double>(total.misses) / total.expected_hits;
+  double false_hit_rate = (total.shots == 0) ? 0 : static_cast<double>(total.false_hits) / total.shots;
+  printf("shots=%u (%.1f/s), expected hits=%u, hits=%u, misses=%u (%.2f%%), false hits=%u (%.2f%%), "
+         "errors=%u, inits=%u\n",
+         total.shots, total.shots / elapsed_s, total.expected_hits, total.hits, total.misses, miss_rate * 100,
+         total.false_hits, false_hit_rate * 100, total.errors, total.inits);
+  print_latencies(stdout, "all", total.latencies_us, false, false);
+  print_latencies(stdout, "hit", total.hit_latencies_us, false, false);
+  print_latencies(stdout, "init", total.init_latencies_us, false, true);
+  if (options.out_path == nullptr)
+  {
+    return;
+  }
+  FILE *file = fopen(options.out_path, "w");
+  if (file == nullptr)
+  {
+    perror(options.out_path);
+    return;
+  }
+  fprintf(file, "{\n  \"units\": %d,\n  \"targets\": %d,\n  \"concurrency\": %d,\n  \"rate\": %.1f,\n"
+                "  \"elapsed_s\": %.2f,\n  \"shots\": %u,\n  \"expected_hits\": %u,\n  \"hits\": %u,\n"
+                "  \"misses\": %u,\n  \"miss_rate\": %.4f,\n  \"false_hits\": %u,\n  \"false_hit_rate\": %.4f,\n"
+                "  \"errors\": %u,\n  \"inits\": %u,\n  \"latency_us\": {\n",
+          options.unit_num, options.target_num, options.concurrency, options.rate, elapsed_s, total.shots,
+          total.expected_hits, total.hits, total.misses, miss_rate, total.false_hits, false_hit_rate,
+          total.errors, total.inits);
+  print_latencies(file, "all", total.latencies_us, true, false);
+  print_latencies(file, "hit", total.hit_latencies_us, true, false);
+  print_latencies(file, "init", total.init_latencies_us, true, true);
+  fprintf(file, "  }\n}\n");
+  fclose(file);
+  printf("results were written to %s\n", options.out_path);
+}
+
+void print_usage(const char *program)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --units N           number of simulated units (default 3)\n"
+          "  --targets N         targets per unit, 1~64 (default 9)\n"
+          "  --base-port N       unit i listens on HTTP N+2i and UDP N+2i+1 (default 18000)\n"
+          "  --rate R            shots per second in total (default 20)\n"
+          "  --concurrency N     shooters firing at the same time, 1~255 (default 4)\n"
+          "  --duration S        seconds to run (default 10)\n"
+          "  --protocol P        http, udp or mixed (default mixed)\n"
+          "  --hit-ratio X       share of shots aimed at a target, 0~1 (default 0.7)\n"
+          "  --ir-lead MS        IR on time before the shot (default 30)\n"
+          "  --ir-hold MS        IR on time in total (default 60)\n"
+          "  --timeout MS        reply timeout (default 500)\n"
+          "  --no-real-time      do not sleep for the simulated I2C time in the units\n"
+          "  --unit-program PATH sim_unit binary (default .pio/build/native/program)\n"
+          "  --out PATH          write the results as JSON\n"
+          "  --verbose           show the output of the units\n",
+          program);
+}
+
+bool parse_options(int argc, char **argv)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const char *name = argv[i];
+    const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    bool uses_value = true;
+    if (strcmp(name, "--no-real-time") == 0)
+    {
+      options.is_real_time = false;
+      uses_value = false;
+    }
+    else if (strcmp(name, "--verbose") == 0)
+    {
+      options.is_verbose = true;
+      uses_value = false;
+    }
+    else if (value == nullptr)
+    {
+      return false;
+    }
+    else if (strcmp(name, "--units") == 0)
+    {
+      options.unit_num = atoi(value);
+    }
+    else if (strcmp(name, "--targets") == 0)
+    {
+      options.target_num = atoi(value);
+    }
+    else if (strcmp(name, "--base-port") == 0)
+    {
+      options.base_port = atoi(value);
+    }
+    else if (strcmp(name, "--rate") == 0)
+    {
+      options.rate = atof(value);
+    }
+    else if (strcmp(name, "--concurrency") == 0)
+    {
+      options.concurrency = atoi(value);
+    }
+    else if (strcmp(name, "--duration") == 0)
+    {
+      options.duration_s = atof(value);
+    }
+    else if (strcmp(name, "--protocol") == 0)
+    {
+      if (strcmp(value, "http") == 0)
+      {
+        options.protocol = Protocol::http;
+      }
+      else if (strcmp(value, "udp") == 0)
+      {
+        options.protocol = Protocol::udp;
+      }
+      else if (strcmp(value, "mixed") == 0)
+      {
+        options.protocol = Protocol::mixed;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    else if (strcmp(name, "--hit-ratio") == 0)
+    {
+      options.hit_ratio = atof(value);
+    }
+    else if (strcmp(name, "--ir-lead") == 0)
+    {
+      options.ir_lead_ms = atoi(value);
+    }
+    else if (strcmp(name, "--ir-hold") == 0)
+    {
+      options.ir_hold_ms = atoi(value);
+    }
+    else if (strcmp(name, "--timeout") == 0)
+    {
+      options.timeout_ms = atoi(value);
+    }
+    else if (strcmp(name, "--unit-program") == 0)
+    {
+      options.unit_program = value;
+    }
+    else if (strcmp(name, "--out") == 0)
+    {
+      options.out_path = value;
+    }
+    else
+    {
+      return false;
+    }
+    if (uses_value)
+    {
+      i++;
+    }
+  }
+  return options.unit_num > 0 && options.target_num > 0 && options.target_num <= 64 && options.rate > 0 &&
+         options.concurrency > 0 && options.concurrency <= 255 && options.duration_s > 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  if (!parse_options(argc, argv))
+  {
+    print_usage(argv[0]);
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  for (int i = 0; i < options.unit_num; i++)
+  {
+    units.push_back(std::unique_ptr<Unit>(new Unit()));
+    if (!start_unit(*units.back(), i))
+    {
+      stop_units();
+      return 1;
+    }
+  }
+  for (auto &unit : units)
+  {
+    if (!wait_unit_ready(*unit))
+    {
+      fprintf(stderr, "unit on port %u did not start\n", unit->http_port);
+      stop_units();
+      return 1;
+    }
+  }
+  printf("started %d units, %d targets each\n", options.unit_num, options.target_num);
+
+  std::vector<std::unique_ptr<Shooter>> shooters;
+  for (int i = 0; i < options.concurrency; i++)
+  {
+    Protocol protocol = options.protocol;
+    if (protocol == Protocol::mixed)
+    {
+      protocol = (i % 2 == 0) ? Protocol::http : Protocol::udp;
+    }
+    shooters.push_back(std::unique_ptr<Shooter>(new Shooter(i, protocol)));
+  }
+  // 各射手は全体のrateを人数で分けた間隔で撃つ
+  double interval_s = options.concurrency / options.rate;
+  Clock::time_point start = Clock::now();
+  Clock::time_point end = start + std::chrono::microseconds(static_cast<long>(options.duration_s * 1e6));
+  std::vector<std::thread> threads;
+  for (auto &shooter : shooters)
+  {
+    Shooter *s = shooter.get();
+    threads.push_back(std::thread([s, start, end, interval_s]() { s->run(start, end, interval_s); }));
+  }
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+  double elapsed_s = elapsed_us(start) / 1e6;
+  stop_units();
+
+  Stats total;
+  for (auto &shooter : shooters)
+  {
+    Stats &stats = shooter->stats();
+    total.shots += stats.shots;
+    total.expected_hits += stats.expected_hits;
+    total.hits += stats.hits;
+    total.misses += stats.misses;
+    total.false_hits += stats.false_hits;
+    total.errors += stats.errors;
+    total.inits += stats.inits;
+    append(total.latencies_us, stats.latencies_us);
+    append(total.hit_latencies_us, stats.hit_latencies_us);
+    append(total.init_latencies_us, stats.init_latencies_us);
+  }
+  report(total, elapsed_s);
+  return 0;
+}
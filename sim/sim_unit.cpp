@@ -0,0 +1,199 @@
+/**
+ * @file sim_unit.cpp
+ * @brief まとユニットのシミュレーション、nativeビルドで動かす
+ *
+ * main.cppと同じようにTargetsを動かし、赤外線受信モジュールとHT16K33はシミュレーションのI2Cバスに繋ぐ。
+ * HTTPとUDPはlocalhostで待ち受けるので、センターと同じリクエストを送って試せる。
+ * Targetsは状態をstaticに持つので、1プロセスで動かせるのは1ユニットだけ。
+ * まとが16個を超える場合は、赤外線受信モジュールをTCA9548A(0x77)の先に16個ずつ繋ぐ。
+ *
+ * 使い方: sim_unit [--unit-id N] [--targets N] [--http-port N] [--udp-port N] [--real-time]
+ * 標準入力に"ir <まとid> <銃番号>"と書くと、そのまとが銃番号の赤外線を受信している状態になる(0で受信終了)。
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <hal.hpp>
+#include <hal_sim.hpp>
+#include <ht16k33LED.hpp>
+#include <ht16k33Animator.hpp>
+#include <scheduler.hpp>
+#include "Targets.hpp"
+#include "debug.h"
+
+static void on_init();
+static void on_receive_ir(int target_id, bool is_alive);
+static void on_not_receive_ir(int target_id, bool is_alive);
+static void on_hit(int target_id, int gun_id);
+static void task_targets();
+static void read_commands();
+
+// 1つのHT16K33に繋がっているLEDの数
+static constexpr int LED_PER_DISPLAY = 5;
+// HT16K33に使えるアドレスの数(0x70~0x76)、0x77はTCA9548Aに使う
+static constexpr int DISPLAY_NUM = 7;
+static constexpr uint8_t MUX_ADDRESS = 0x77;
+static constexpr uint32_t PERIOD_TARGETS_US = 10000;
+
+static Targets targets(on_init, on_receive_ir, on_not_receive_ir, on_hit);
+static std::vector<ht16k33LED::Led> leds;
+static ht16k33LED::Animator animator;
+static scheduler::Scheduler task_scheduler;
+static hal::sim::IrReceiverDevice ir_devices[Targets::MAX_TARGET_NUM];
+static hal::sim::Ht16k33Device displays[DISPLAY_NUM];
+static hal::sim::Tca9548aDevice mux;
+
+int main(int argc, char **argv)
+{
+  int unit_id = 0;
+  int target_num = 9;
+  int http_port = 8080;
+  int udp_port = shot_protocol::DEFAULT_PORT;
+  for (int i = 1; i < argc; i++)
+  {
+    bool has_value = (i + 1 < argc);
+    if (strcmp(argv[i], "--unit-id") == 0 && has_value)
+    {
+      unit_id = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--targets") == 0 && has_value)
+    {
+      target_num = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--http-port") == 0 && has_value)
+    {
+      http_port = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--udp-port") == 0 && has_value)
+    {
+      udp_port = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--real-time") == 0)
+    {
+      // バスの所要時間を実際に待つ、応答時間を実機に近づけたい場合に使う
+      hal::sim::set_real_time(true);
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [--unit-id N] [--targets N] [--http-port N] [--udp-port N] [--real-time]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (target_num < 1 || target_num > Targets::MAX_TARGET_NUM)
+  {
+    fprintf(stderr, "--targets must be 1~%d\n", Targets::MAX_TARGET_NUM);
+    return 1;
+  }
+
+  // 実機と同じアドレスにモジュールを繋ぐ
+  // 16個を超える場合は、赤外線受信モジュールを16個ずつTCA9548Aのチャンネル0~3に繋ぐ
+  hal::sim::SimI2cBus &bus = hal::sim::bus(0);
+  bool uses_mux = (target_num > IrReceiver::ID_NUM);
+  if (uses_mux)
+  {
+    bus.attach_mux(MUX_ADDRESS, mux);
+  }
+  leds.reserve(target_num);
+  for (int i = 0; i < target_num; i++)
+  {
+    IrReceiver receiver(static_cast<uint8_t>(i % IrReceiver::ID_NUM));
+    if (uses_mux)
+    {
+      mux.attach(static_cast<uint8_t>(i / IrReceiver::ID_NUM), receiver.address(), ir_devices[i]);
+    }
+    else
+    {
+      bus.attach(receiver.address(), ir_devices[i]);
+    }
+    // HT16K33が足りない分のLEDは、前のHT16K33と共有する
+    int display_index = (i / LED_PER_DISPLAY) % DISPLAY_NUM;
+    uint8_t address = ht16k33LED::Display::BASE_ADDRESS + display_index;
+    bus.attach(address, displays[display_index]);
+    leds.push_back(ht16k33LED::Led(i % LED_PER_DISPLAY, address));
+  }
+
+  if (uses_mux)
+  {
+    i2c_mux::Route routes[Targets::MAX_TARGET_NUM / IrReceiver::ID_NUM];
+    for (uint8_t channel = 0; channel < Targets::MAX_TARGET_NUM / IrReceiver::ID_NUM; channel++)
+    {
+      routes[channel] = i2c_mux::Route(MUX_ADDRESS, channel);
+    }
+    targets.set_ir_routes(routes, sizeof(routes) / sizeof(routes[0]));
+  }
+  targets.begin(unit_id, target_num, true, 0, http_port);
+  targets.begin_udp(udp_port);
+  targets.set_ir_edge_mode(true);
+  for (auto &led : leds)
+  {
+    led.init();
+  }
+  DebugPrint("sim unit %d: targets=%d, http=%d, udp=%d", unit_id, target_num, http_port, udp_port);
+
+  std::thread(read_commands).detach();
+  task_scheduler.add("targets", task_targets, PERIOD_TARGETS_US);
+  while (true)
+  {
+    task_scheduler.run();
+  }
+}
+
+static void task_targets()
+{
+  targets.update();
+  animator.tick(hal::millis());
+  ht16k33LED::Display::flush_all();
+}
+
+// 標準入力から赤外線の受信状態を変える
+static void read_commands()
+{
+  char line[64];
+  while (fgets(line, sizeof(line), stdin) != nullptr)
+  {
+    int target_id = 0;
+    int gun_num = 0;
+    if (sscanf(line, "ir %d %d", &target_id, &gun_num) != 2 ||
+        target_id < 0 || target_id >= static_cast<int>(leds.size()))
+    {
+      fprintf(stderr, "unknown command: %s", line);
+      continue;
+    }
+    ir_devices[target_id].set_gun_num(static_cast<byte>(gun_num));
+  }
+}
+
+static void on_init()
+{
+  animator.stop_all();
+  for (auto &led : leds)
+  {
+    led.clear();
+  }
+}
+
+static void on_receive_ir(int target_id, bool is_alive)
+{
+  if (is_alive)
+  {
+    leds[target_id].write_color(ht16k33LED::red);
+  }
+}
+
+static void on_not_receive_ir(int target_id, bool is_alive)
+{
+  if (is_alive)
+  {
+    leds[target_id].clear();
+  }
+}
+
+static void on_hit(int target_id, int gun_id)
+{
+  DebugPrint("on_hit() target_id=%d, gun_id=%d", target_id, gun_id);
+  animator.blink(leds[target_id], ht16k33LED::red, 3, 300, ht16k33LED::red);
+}
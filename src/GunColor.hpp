@@ -0,0 +1,26 @@
+/**
+ * @file GunColor.hpp
+ * @brief 銃番号とLEDの色の対応
+ */
+
+#ifndef GUN_COLOR_HPP
+#define GUN_COLOR_HPP
+
+#include <ht16k33LED.hpp>
+
+//! 銃番号に対応する色、対応する色が無ければclear
+inline ht16k33LED::Color gun_id2color(int gun_id)
+{
+  // 銃番号を添字とした色の表、0番は銃なし
+  static constexpr ht16k33LED::Color GUN_COLORS[] = {
+      ht16k33LED::Color::clear,
+      ht16k33LED::Color::red,
+      ht16k33LED::Color::blue};
+  if (gun_id < 0 || gun_id >= static_cast<int>(sizeof(GUN_COLORS) / sizeof(GUN_COLORS[0])))
+  {
+    return ht16k33LED::Color::clear;
+  }
+  return GUN_COLORS[gun_id];
+}
+
+#endif // GUN_COLOR_HPP
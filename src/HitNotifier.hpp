@@ -0,0 +1,164 @@
+/**
+ * @file HitNotifier.hpp
+ * @brief まとユニットからセンターへ命中を通知するクラスヘッダ
+ *
+ * 送信処理はHitTransportに任せるので、Arduinoに依存しない。
+ */
+
+#ifndef HIT_NOTIFIER_HPP
+#define HIT_NOTIFIER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "ShotProtocol.hpp"
+
+/**
+ * @class HitTransport
+ * @brief 命中通知の送信手段
+ *
+ * 実機ではUdpHitTransportを使う。差し替えればセンター無しで動作確認できる。
+ */
+class HitTransport
+{
+public:
+  virtual ~HitTransport() {}
+  //! イベントをまとめて送信する、送信できなければfalse
+  virtual bool send(const shot_protocol::HitEvent *events, size_t count) = 0;
+  //! 届いている確認応答があれば、確認されたseqの最大値を入れてtrueを返す、待たずにすぐ戻ること
+  virtual bool poll_ack(uint32_t &acked_seq) = 0;
+};
+
+/**
+ * @class HitNotifier
+ * @brief 命中イベントを貯めておき、まとめて送信し、確認応答が来なければ再送するクラス
+ * @tparam CAPACITY 貯めておけるイベントの数、溢れた場合は古いものから捨てる
+ *
+ * イベントは検出した順番に送信し、確認応答されるまで先頭から消さない。
+ * update()を定期的に呼ぶこと。
+ */
+template <size_t CAPACITY>
+class HitNotifier
+{
+public:
+  void set_transport(HitTransport *transport) { _transport = transport; }
+  //! 最初のイベントからこの時間待って、その間に増えたイベントとまとめて送る[ms]
+  void set_batch_delay(unsigned long batch_delay_ms) { _batch_delay_ms = batch_delay_ms; }
+  //! 送信してからこの時間確認応答が無ければ再送する[ms]
+  void set_retry_timeout(unsigned long retry_timeout_ms) { _retry_timeout_ms = retry_timeout_ms; }
+
+  /**
+   * @brief 命中イベントを追加する
+   * @return bool true:追加できた, false:一杯だったので一番古いイベントを捨てた
+   */
+  bool push(uint8_t target_id, uint8_t gun_num, unsigned long now)
+  {
+    bool is_dropped = false;
+    if (_size == CAPACITY)
+    {
+      _pop_front();
+      _dropped_count++;
+      is_dropped = true;
+    }
+    shot_protocol::HitEvent &event = _events[(_head + _size) % CAPACITY];
+    event.seq = _next_seq++;
+    event.detected_ms = static_cast<uint32_t>(now);
+    event.target_id = target_id;
+    event.gun_num = gun_num;
+    _size++;
+    return !is_dropped;
+  }
+
+  void update(unsigned long now)
+  {
+    if (_transport == nullptr)
+    {
+      return;
+    }
+    uint32_t acked_seq = 0;
+    while (_transport->poll_ack(acked_seq))
+    {
+      _acknowledge(acked_seq);
+    }
+    if (_inflight_count > 0)
+    {
+      if (now - _sent_millis >= _retry_timeout_ms)
+      {
+        _send(_inflight_count, now);
+        _retry_count++;
+      }
+      return;
+    }
+    if (_size == 0)
+    {
+      return;
+    }
+    if (_size >= shot_protocol::MAX_HIT_EVENTS ||
+        now - _events[_head].detected_ms >= _batch_delay_ms)
+    {
+      _send(std::min(_size, shot_protocol::MAX_HIT_EVENTS), now);
+    }
+  }
+  //! 確認応答を待っているイベントの数
+  size_t pending() const { return _size; }
+  uint32_t dropped_count() const { return _dropped_count; }
+  uint32_t retry_count() const { return _retry_count; }
+  void clear()
+  {
+    _head = 0;
+    _size = 0;
+    _inflight_count = 0;
+  }
+  /**
+   * @brief 次に追加するイベントのseqを設定する
+   *
+   * seqは一周しても確認応答を正しく扱えるので、一周する前後の動作を確かめる場合などに使う。
+   */
+  void set_next_seq(uint32_t seq) { _next_seq = seq; }
+
+private:
+  HitTransport *_transport = nullptr;
+  std::array<shot_protocol::HitEvent, CAPACITY> _events{};
+  size_t _head = 0;
+  size_t _size = 0;
+  size_t _inflight_count = 0; // 先頭から何個送信済みで確認応答待ちか
+  unsigned long _sent_millis = 0;
+  unsigned long _batch_delay_ms = 10;
+  unsigned long _retry_timeout_ms = 100;
+  uint32_t _next_seq = 1;
+  uint32_t _dropped_count = 0;
+  uint32_t _retry_count = 0;
+
+  void _pop_front()
+  {
+    _head = (_head + 1) % CAPACITY;
+    _size--;
+    if (_inflight_count > 0)
+    {
+      _inflight_count--;
+    }
+  }
+  void _acknowledge(uint32_t acked_seq)
+  {
+    // seqが一周しても比較できるよう差の符号で判定する
+    while (_size > 0 && static_cast<int32_t>(acked_seq - _events[_head].seq) >= 0)
+    {
+      _pop_front();
+    }
+  }
+  void _send(size_t count, unsigned long now)
+  {
+    shot_protocol::HitEvent batch[shot_protocol::MAX_HIT_EVENTS];
+    for (size_t i = 0; i < count; i++)
+    {
+      batch[i] = _events[(_head + i) % CAPACITY];
+    }
+    // 送信に失敗してもretry_timeout後に再送する
+    _transport->send(batch, count);
+    _inflight_count = count;
+    _sent_millis = now;
+  }
+};
+
+#endif // HIT_NOTIFIER_HPP
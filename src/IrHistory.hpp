@@ -0,0 +1,107 @@
+/**
+ * @file IrHistory.hpp
+ * @brief 赤外線受信履歴用クラスヘッダ
+ */
+
+#ifndef IR_HISTORY_HPP
+#define IR_HISTORY_HPP
+
+#include <array>
+#include <hal.hpp>
+
+/**
+ * @class IrHistory
+ * @brief 赤外線受信履歴を固定長で保持するリングバッファ
+ * @tparam N 保持するサンプル数
+ *
+ * 受信していない(銃番号0の)サンプルは保持しない。
+ * 同じ銃番号が続けて受信された場合は最新サンプルの時刻だけを更新するので、
+ * N個のサンプルで「直近に受信したN種類の銃番号の最終受信時刻」を表せる。
+ */
+template <size_t N>
+class IrHistory
+{
+public:
+  struct Sample
+  {
+    unsigned long millis = 0; // 受信した時刻[ms]
+    byte gun_num = 0;         // 受信した銃番号
+  };
+
+  //! 受信サンプルを追加する
+  void push(unsigned long now, byte gun_num)
+  {
+    if (gun_num == 0)
+    {
+      return;
+    }
+    if (_count > 0 && _samples[_head].gun_num == gun_num)
+    {
+      _samples[_head].millis = now;
+      return;
+    }
+    _head = (_head + 1) % N;
+    _samples[_head].millis = now;
+    _samples[_head].gun_num = gun_num;
+    if (_count < N)
+    {
+      _count++;
+    }
+  }
+  /**
+   * @brief 指定時間内に指定した銃番号を受信していたかを返す
+   * @param gun_num 銃番号
+   * @param now 現在時刻[ms]
+   * @param window_ms 遡る時間[ms]
+   * @param since_millis この時刻より後に受信したサンプルだけを見る[ms]
+   */
+  bool contains(byte gun_num, unsigned long now, unsigned long window_ms, unsigned long since_millis) const
+  {
+    for (size_t i = 0; i < _count; i++)
+    {
+      const Sample &sample = _samples[(_head + N - i) % N];
+      if (now - sample.millis > window_ms || static_cast<long>(sample.millis - since_millis) <= 0)
+      {
+        // 新しい順に見ているので、これより前は全て範囲外
+        return false;
+      }
+      if (sample.gun_num == gun_num)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+  /**
+   * @brief 指定時間内に受信したサンプルについて、新しい順にfuncを呼ぶ
+   * @param func void(const Sample &)
+   */
+  template <typename F>
+  void for_each_within(unsigned long now, unsigned long window_ms, F func) const
+  {
+    for (size_t i = 0; i < _count; i++)
+    {
+      const Sample &sample = _samples[(_head + N - i) % N];
+      if (now - sample.millis > window_ms)
+      {
+        return;
+      }
+      func(sample);
+    }
+  }
+  void clear()
+  {
+    _count = 0;
+  }
+  size_t size() const
+  {
+    return _count;
+  }
+
+private:
+  std::array<Sample, N> _samples{};
+  size_t _head = 0;
+  size_t _count = 0;
+};
+
+#endif // IR_HISTORY_HPP
@@ -6,40 +6,106 @@
 #ifndef IR_RECEIVER_HPP
 #define IR_RECEIVER_HPP
 
-#include <Arduino.h>
-#include <Wire.h>
+#include <hal.hpp>
+#include <i2c_bus.hpp>
+#include <i2c_mux.hpp>
+#include <metrics.hpp>
 
 /**
  * @class IrReceiver
  * @brief 赤外線受信モジュール用クラス
- * @attention 本クラスのメンバ関数を使用する前にWire.begin()を実行しておくこと
+ * @attention 本クラスのメンバ関数を使用する前にWire.begin()を実行しておくこと(実機の場合)
+ *
+ * TCA9548Aの先に繋いだ場合は、読む度にそのチャンネルを選択してから読む。
+ * 同じチャンネルのモジュールをまとめて読む場合は、bus()のi2c_mux::Lockを取ってselect_route()してから
+ * read_selected()を使うと、選択は1回で済む。
  */
 class IrReceiver
 {
 private:
   uint8_t _i2c_address = 8; //  赤外線受信モジュールのI2Cスレーブアドレス
+  i2c_mux::Route _route;    // 赤外線受信モジュールまでの経路
+  int _bus = 0;             // 0:Wire, 1:Wire1
 
 public:
+  // ロータリースイッチで設定できるidの数、1つの経路に繋げるモジュールの最大数
+  static constexpr int ID_NUM = 16;
+
   IrReceiver() {}
   //! id = 0~15、赤外線受信モジュールのロータリースイッチの値と等しくする。
   IrReceiver(uint8_t id) { _i2c_address = id + 8; }
+  /**
+   * @brief 経路とバスを指定する
+   * @param route TCA9548Aのチャンネルの先に繋いだ場合はその経路、バスに直接繋いだ場合はi2c_mux::Route()
+   * @param bus 0:Wire, 1:Wire1
+   */
+  IrReceiver(uint8_t id, const i2c_mux::Route &route, int bus = 0) : _i2c_address(id + 8), _route(route), _bus(bus) {}
   ~IrReceiver() {}
+  uint8_t address() const { return _i2c_address; }
+  const i2c_mux::Route &route() const { return _route; }
+  int bus() const { return _bus; }
   byte read() const
   {
-    Wire.requestFrom(_i2c_address, static_cast<uint8_t>(1));
     byte read_data = 0;
-    while (Wire.available())
+    read(read_data);
+    return read_data;
+  }
+  /**
+   * @brief 受信データを読み取り、同時に疎通の有無も返す
+   * @param read_data 読み取ったデータの格納先、応答が無ければ0になる
+   * @return bool true:応答あり, false:応答なし
+   *
+   * read()とis_connected()を別々に呼ぶと2回通信が発生するので、
+   * 両方必要な場合はこちらを使う。
+   */
+  bool read(byte &read_data) const
+  {
+    i2c_mux::Lock route_lock(_bus);
+    if (!select_route())
     {
-      read_data = Wire.read();
+      read_data = 0;
+      return false;
     }
-    return read_data;
+    return read_selected(read_data);
+  }
+  //! このモジュールまでの経路を選択する、i2c_mux::Lockを取った状態で呼ぶ
+  bool select_route() const { return i2c_mux::select(_route, _bus); }
+  /**
+   * @brief 経路を選択済みの状態で読み取る
+   *
+   * i2c_mux::Lockを取ってselect_route()してから、ロックを保持したまま呼ぶ。
+   */
+  bool read_selected(byte &read_data) const
+  {
+    i2c_bus::Lock lock(_bus);
+    hal::I2cBus &bus = hal::i2c(_bus);
+    metrics::ScopedTimer timer(metrics::i2c_ir);
+    byte ret_bytes = bus.request_from(_i2c_address, static_cast<uint8_t>(1));
+    read_data = 0;
+    while (bus.available())
+    {
+      read_data = bus.read();
+    }
+    if (ret_bytes != 1)
+    {
+      metrics::i2c_errors.increment();
+      return false;
+    }
+    return true;
   }
   bool is_connected(void) const
   {
-    byte ret_bytes = Wire.requestFrom(_i2c_address, static_cast<uint8_t>(1));
-    while (Wire.available())
+    i2c_mux::Lock route_lock(_bus);
+    if (!select_route())
+    {
+      return false;
+    }
+    i2c_bus::Lock lock(_bus);
+    hal::I2cBus &bus = hal::i2c(_bus);
+    byte ret_bytes = bus.request_from(_i2c_address, static_cast<uint8_t>(1));
+    while (bus.available())
     {
-      Wire.read();
+      bus.read();
     }
     if (ret_bytes == 1)
     {
@@ -49,4 +115,4 @@ public:
   }
 };
 
-#endif
\ No newline at end of file
+#endif
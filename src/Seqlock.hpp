@@ -0,0 +1,66 @@
+/**
+ * @file Seqlock.hpp
+ * @brief タスク間でデータを受け渡すためのseqlockクラスヘッダ
+ */
+
+#ifndef SEQLOCK_HPP
+#define SEQLOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @class Seqlock
+ * @brief 書き込み1タスク・読み出し1タスク以上で使うロックフリーなスナップショット
+ * @tparam T 受け渡すデータ型、memcpyでコピーできる型であること
+ *
+ * 書き込み側は待たされることがない。読み出し側は書き込み中に読んだ場合に失敗するので、
+ * try_read()が失敗した時は読み直すか、前回読めた値を使い続けること。
+ * Tが大きくてもスタックを使わないよう、try_read()は呼び出し側のバッファへ直接コピーする。
+ */
+template <typename T>
+class Seqlock
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Seqlock requires a trivially copyable type");
+
+public:
+  //! 書き込みは1つのタスクからのみ行うこと
+  void write(const T &value)
+  {
+    uint32_t seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&_data, &value, sizeof(T));
+    _seq.store(seq + 2, std::memory_order_release);
+  }
+  /**
+   * @brief outへ読み出す
+   * @return bool true:一貫性のある値が読めた, false:書き込み中だった
+   * @attention 失敗した場合、outには書き込み途中の値が入っていることがある。
+   *            前回の値を残したい場合は、別のバッファに読んで成功した時だけ切り替えること。
+   */
+  bool try_read(T &out) const
+  {
+    uint32_t seq_begin = _seq.load(std::memory_order_acquire);
+    if (seq_begin & 1)
+    {
+      return false;
+    }
+    std::memcpy(&out, &_data, sizeof(T));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return _seq.load(std::memory_order_relaxed) == seq_begin;
+  }
+  //! 書き込まれた回数、0なら1度も書き込まれていない
+  uint32_t version() const
+  {
+    return _seq.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  std::atomic<uint32_t> _seq{0};
+  T _data{};
+};
+
+#endif // SEQLOCK_HPP
@@ -0,0 +1,305 @@
+/**
+ * @file ShotProtocol.hpp
+ * @brief UDPで射撃判定を行うためのバイナリプロトコル定義
+ *
+ * Arduinoに依存しないので、センター側やLinux上のツールからも使える。
+ */
+
+#ifndef SHOT_PROTOCOL_HPP
+#define SHOT_PROTOCOL_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace shot_protocol
+{
+
+constexpr uint16_t DEFAULT_PORT = 5000;
+//! 命中通知の送信元ポート、センターからの確認応答はここに届く
+constexpr uint16_t DEFAULT_PUSH_LOCAL_PORT = 5001;
+//! センター側で命中通知を待ち受けるポート
+constexpr uint16_t DEFAULT_PUSH_CENTER_PORT = 5002;
+constexpr uint8_t MAGIC0 = 'S';
+constexpr uint8_t MAGIC1 = 'G';
+constexpr uint8_t VERSION = 1;
+//! 要求、応答とも固定長
+constexpr size_t MESSAGE_SIZE = 16;
+//! 応答のtarget_idで、命中しなかったことを表す値
+constexpr uint8_t NO_TARGET = 0xFF;
+
+enum class MessageType : uint8_t
+{
+  shoot = 0x01,       // 射撃判定要求
+  init = 0x02,        // ゲーム開始時の初期化要求
+  hit_events = 0x03,  // まとユニットからの命中通知
+  result = 0x81,      // 射撃判定結果
+  initialized = 0x82, // 初期化完了
+  hit_ack = 0x83      // 命中通知の確認応答
+};
+
+/**
+ * @brief センターから送られる要求
+ *
+ * バイト配置(数値はリトルエンディアン)
+ * | 0-1 | 2       | 3    | 4-7 | 8-11         | 12      | 13-15    |
+ * | 'S''G' | version | type | seq | timestamp_ms | gun_num | reserved |
+ */
+struct Request
+{
+  MessageType type = MessageType::shoot;
+  uint32_t seq = 0;          // センターが要求毎に増やす番号、再送判定に使う
+  uint32_t timestamp_ms = 0; // センター側の送信時刻、応答でそのまま返す
+  uint8_t gun_num = 0;
+};
+
+/**
+ * @brief まとユニットから返す応答
+ *
+ * バイト配置(数値はリトルエンディアン)
+ * | 0-1 | 2       | 3    | 4-7 | 8-11         | 12      | 13        | 14-15    |
+ * | 'S''G' | version | type | seq | timestamp_ms | gun_num | target_id | reserved |
+ * gun_numはHTTPの"target=N"と同じく、命中時は銃番号、外れた時は0。
+ */
+struct Reply
+{
+  MessageType type = MessageType::result;
+  uint32_t seq = 0;
+  uint32_t timestamp_ms = 0;
+  uint8_t gun_num = 0;
+  uint8_t target_id = NO_TARGET;
+};
+
+/**
+ * @brief まとユニットが自分で検出した命中
+ *
+ * 命中通知のバイト配置(数値はリトルエンディアン)
+ * ヘッダ 16byte
+ * | 0-1 | 2       | 3    | 4-7             | 8-11         | 12    | 13      | 14-15    |
+ * | 'S''G' | version | type | 先頭イベントのseq | 送信時刻[ms] | count | unit_id | reserved |
+ * イベント 8byte x count、i番目のイベントのseqは先頭イベントのseq + i
+ * | 0-3          | 4         | 5       | 6-7      |
+ * | detected_ms  | target_id | gun_num | reserved |
+ * 確認応答は通常の16byteメッセージで、seqに受け取ったイベントのseqの最大値を入れる。
+ */
+struct HitEvent
+{
+  uint32_t seq = 0;
+  uint32_t detected_ms = 0; // まとユニット側で命中を検出した時刻
+  uint8_t target_id = 0;
+  uint8_t gun_num = 0;
+};
+
+//! 1回の命中通知に入れられるイベントの最大数
+constexpr size_t MAX_HIT_EVENTS = 8;
+constexpr size_t HIT_EVENTS_HEADER_SIZE = 16;
+constexpr size_t HIT_EVENT_SIZE = 8;
+
+using Buffer = std::array<uint8_t, MESSAGE_SIZE>;
+using HitEventsBuffer = std::array<uint8_t, HIT_EVENTS_HEADER_SIZE + MAX_HIT_EVENTS * HIT_EVENT_SIZE>;
+
+inline void put_u32(uint8_t *p, uint32_t value)
+{
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+  p[2] = static_cast<uint8_t>(value >> 16);
+  p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+inline uint32_t get_u32(const uint8_t *p)
+{
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void _put_header(Buffer &buf, MessageType type, uint32_t seq, uint32_t timestamp_ms)
+{
+  buf.fill(0);
+  buf[0] = MAGIC0;
+  buf[1] = MAGIC1;
+  buf[2] = VERSION;
+  buf[3] = static_cast<uint8_t>(type);
+  put_u32(&buf[4], seq);
+  put_u32(&buf[8], timestamp_ms);
+}
+
+inline bool _is_valid_header(const uint8_t *data, size_t length)
+{
+  return length == MESSAGE_SIZE && data[0] == MAGIC0 && data[1] == MAGIC1 && data[2] == VERSION;
+}
+
+inline Buffer encode(const Request &request)
+{
+  Buffer buf;
+  _put_header(buf, request.type, request.seq, request.timestamp_ms);
+  buf[12] = request.gun_num;
+  return buf;
+}
+
+inline Buffer encode(const Reply &reply)
+{
+  Buffer buf;
+  _put_header(buf, reply.type, reply.seq, reply.timestamp_ms);
+  buf[12] = reply.gun_num;
+  buf[13] = reply.target_id;
+  return buf;
+}
+
+//! 形式が不正な場合はfalse
+inline bool decode(const uint8_t *data, size_t length, Request &request)
+{
+  if (!_is_valid_header(data, length))
+  {
+    return false;
+  }
+  MessageType type = static_cast<MessageType>(data[3]);
+  if (type != MessageType::shoot && type != MessageType::init)
+  {
+    return false;
+  }
+  request.type = type;
+  request.seq = get_u32(&data[4]);
+  request.timestamp_ms = get_u32(&data[8]);
+  request.gun_num = data[12];
+  return true;
+}
+
+//! 形式が不正な場合はfalse
+inline bool decode(const uint8_t *data, size_t length, Reply &reply)
+{
+  if (!_is_valid_header(data, length))
+  {
+    return false;
+  }
+  MessageType type = static_cast<MessageType>(data[3]);
+  if (type != MessageType::result && type != MessageType::initialized)
+  {
+    return false;
+  }
+  reply.type = type;
+  reply.seq = get_u32(&data[4]);
+  reply.timestamp_ms = get_u32(&data[8]);
+  reply.gun_num = data[12];
+  reply.target_id = data[13];
+  return true;
+}
+
+//! 命中通知を作る、戻り値は送信するバイト数
+inline size_t encode_hit_events(const HitEvent *events, size_t count, uint8_t unit_id,
+                                uint32_t timestamp_ms, HitEventsBuffer &buf)
+{
+  if (count > MAX_HIT_EVENTS)
+  {
+    count = MAX_HIT_EVENTS;
+  }
+  buf.fill(0);
+  buf[0] = MAGIC0;
+  buf[1] = MAGIC1;
+  buf[2] = VERSION;
+  buf[3] = static_cast<uint8_t>(MessageType::hit_events);
+  put_u32(&buf[4], (count > 0) ? events[0].seq : 0);
+  put_u32(&buf[8], timestamp_ms);
+  buf[12] = static_cast<uint8_t>(count);
+  buf[13] = unit_id;
+  for (size_t i = 0; i < count; i++)
+  {
+    uint8_t *p = &buf[HIT_EVENTS_HEADER_SIZE + i * HIT_EVENT_SIZE];
+    put_u32(p, events[i].detected_ms);
+    p[4] = events[i].target_id;
+    p[5] = events[i].gun_num;
+  }
+  return HIT_EVENTS_HEADER_SIZE + count * HIT_EVENT_SIZE;
+}
+
+//! 命中通知を読む、eventsはMAX_HIT_EVENTS個以上の領域を渡すこと
+inline bool decode_hit_events(const uint8_t *data, size_t length, HitEvent *events,
+                              size_t &count, uint8_t &unit_id)
+{
+  if (length < HIT_EVENTS_HEADER_SIZE || data[0] != MAGIC0 || data[1] != MAGIC1 ||
+      data[2] != VERSION || data[3] != static_cast<uint8_t>(MessageType::hit_events))
+  {
+    return false;
+  }
+  count = data[12];
+  if (count > MAX_HIT_EVENTS || length != HIT_EVENTS_HEADER_SIZE + count * HIT_EVENT_SIZE)
+  {
+    return false;
+  }
+  unit_id = data[13];
+  uint32_t first_seq = get_u32(&data[4]);
+  for (size_t i = 0; i < count; i++)
+  {
+    const uint8_t *p = &data[HIT_EVENTS_HEADER_SIZE + i * HIT_EVENT_SIZE];
+    events[i].seq = first_seq + i;
+    events[i].detected_ms = get_u32(p);
+    events[i].target_id = p[4];
+    events[i].gun_num = p[5];
+  }
+  return true;
+}
+
+inline Buffer encode_hit_ack(uint32_t acked_seq)
+{
+  Buffer buf;
+  _put_header(buf, MessageType::hit_ack, acked_seq, 0);
+  return buf;
+}
+
+inline bool decode_hit_ack(const uint8_t *data, size_t length, uint32_t &acked_seq)
+{
+  if (!_is_valid_header(data, length) || data[3] != static_cast<uint8_t>(MessageType::hit_ack))
+  {
+    return false;
+  }
+  acked_seq = get_u32(&data[4]);
+  return true;
+}
+
+/**
+ * @class DuplicateFilter
+ * @brief 直近に処理した要求のseqと応答を覚えておき、再送された要求には同じ応答を返すためのクラス
+ * @tparam N 覚えておく要求の数
+ *
+ * UDPでは応答が失われるとセンターが同じseqで再送してくるので、
+ * 同じ射撃を2回判定して別のまとを倒してしまわないようにする。
+ */
+template <size_t N>
+class DuplicateFilter
+{
+public:
+  //! seqの応答を覚えていればreplyに入れてtrueを返す
+  bool find(uint32_t seq, Reply &reply) const
+  {
+    for (size_t i = 0; i < _count; i++)
+    {
+      if (_replies[i].seq == seq)
+      {
+        reply = _replies[i];
+        return true;
+      }
+    }
+    return false;
+  }
+  void remember(const Reply &reply)
+  {
+    _replies[_next] = reply;
+    _next = (_next + 1) % N;
+    if (_count < N)
+    {
+      _count++;
+    }
+  }
+  void clear()
+  {
+    _count = 0;
+    _next = 0;
+  }
+
+private:
+  std::array<Reply, N> _replies{};
+  size_t _next = 0;
+  size_t _count = 0;
+};
+
+} // namespace shot_protocol
+#endif // SHOT_PROTOCOL_HPP
@@ -0,0 +1,221 @@
+/**
+ * @file TargetBank.hpp
+ * @brief まと情報をまとめて保持するクラスヘッダ
+ */
+
+#ifndef TARGET_BANK_HPP
+#define TARGET_BANK_HPP
+
+#include <array>
+#include <bitset>
+#include <hal.hpp>
+#include <i2c_mux.hpp>
+#include <metrics.hpp>
+#include "IrReceiver.hpp"
+#include "IrHistory.hpp"
+
+/**
+ * @class TargetBank
+ * @brief まとのid、I2Cアドレス、生存状態、赤外線受信状態をまと毎の配列で保持するクラス
+ * @tparam N 保持できるまとの最大数
+ * @tparam HISTORY_SIZE まと毎に保持する赤外線受信履歴のサンプル数
+ *
+ * 生存状態と受信状態はビットマスクで持つので、
+ * 生存数はpopcount、「銃gで撃たれた生存まと」はマスクのANDで求められる。
+ *
+ * まとはidの順に16個ずつのグループに分け、グループ毎に1つの経路(TCA9548Aのチャンネル)に繋ぐ。
+ * 走査はグループ毎に経路を1度だけ選択してから、そのグループのまとをまとめて読む。
+ */
+template <size_t N, size_t HISTORY_SIZE = 8>
+class TargetBank
+{
+public:
+  using Mask = std::bitset<N>;
+  //! マスクで管理する銃番号の最大値、これより大きい銃番号は履歴を走査して判定する
+  static constexpr byte MAX_GUN_NUM = 15;
+
+  /**
+   * @brief 赤外線受信モジュールの読み取り結果
+   *
+   * 読み取りタスクからloop()側へSeqlockで丸ごと渡せるよう、固定長の配列だけで構成する。
+   */
+  struct Readings
+  {
+    std::array<byte, N> gun_nums;                     // 受信している銃番号、受信していなければ0
+    std::array<unsigned long, N> read_millis;         // 読み取った時刻[ms]
+    Mask connected;                                   // 読み取り時に応答があったまと
+    std::array<IrHistory<HISTORY_SIZE>, N> histories; // 受信履歴
+    std::array<Mask, MAX_GUN_NUM + 1> gun_masks;      // 走査時刻から遡って時間内に各銃番号を受信したまと
+    unsigned long sweep_millis;                       // 走査した時刻[ms]
+  };
+
+  //! グループの最大数
+  static constexpr size_t GROUP_NUM = (N + IrReceiver::ID_NUM - 1) / IrReceiver::ID_NUM;
+
+  /**
+   * @brief idが0~count-1のまとを登録し、全て生存状態にする
+   * @param routes グループ毎の経路、id 16k~16k+15のまとはroutes[k]に繋がっているとする
+   *               nullptrの場合は全てバスに直接繋がっているとする(最大16個)
+   * @param route_count routesの要素数
+   * @param bus 赤外線受信モジュール(とTCA9548A)を繋いだバス、0:Wire, 1:Wire1
+   * @return size_t 登録できたまとの数、経路が足りなければcountより少なくなる
+   */
+  size_t begin(size_t count, const i2c_mux::Route *routes = nullptr, size_t route_count = 0, int bus = 0)
+  {
+    _bus = bus;
+    size_t group_count = (routes == nullptr) ? 1 : ((route_count < GROUP_NUM) ? route_count : GROUP_NUM);
+    _count = std::min(std::min(count, N), group_count * IrReceiver::ID_NUM);
+    _group_count = (_count + IrReceiver::ID_NUM - 1) / IrReceiver::ID_NUM;
+    for (size_t g = 0; g < _group_count; g++)
+    {
+      _routes[g] = (routes == nullptr) ? i2c_mux::Route() : routes[g];
+      // リセット前に開いていたチャンネルが残っていると、別の経路のモジュールとアドレスがぶつかる
+      if (!_routes[g].is_direct())
+      {
+        i2c_mux::Lock route_lock(_bus);
+        i2c_mux::disable(_routes[g].mux_address, _bus);
+      }
+    }
+    for (size_t i = 0; i < _count; i++)
+    {
+      _ids[i] = static_cast<uint8_t>(i);
+      _receivers[i] = IrReceiver(static_cast<uint8_t>(i % IrReceiver::ID_NUM), _routes[i / IrReceiver::ID_NUM], _bus);
+    }
+    _readings[0] = Readings();
+    _readings[1] = Readings();
+    _front = 0;
+    revive_all();
+    return _count;
+  }
+  size_t size() const { return _count; }
+  int bus() const { return _bus; }
+  int id(size_t index) const { return _ids[index]; }
+  uint8_t address(size_t index) const { return _receivers[index].address(); }
+  const IrReceiver &receiver(size_t index) const { return _receivers[index]; }
+
+  //! 登録されている全てのまとのマスク
+  Mask all_mask() const
+  {
+    Mask mask;
+    for (size_t i = 0; i < _count; i++)
+    {
+      mask.set(i);
+    }
+    return mask;
+  }
+  const Mask &alive_mask() const { return _alive; }
+  bool is_alive(size_t index) const { return _alive.test(index); }
+  void kill(size_t index) { _alive.reset(index); }
+  void revive_all() { _alive = all_mask(); }
+  size_t alive_count() const { return _alive.count(); }
+
+  /**
+   * @brief 全てのまとを読み取ってreadingsを更新する
+   * @param window_ms gun_masksを作る時に遡る時間[ms]
+   *
+   * 読み取りタスクから呼ぶ場合もあるので、生存状態には触らない。
+   * グループ毎の所要時間はmetrics::ir_group_sweepに記録する。
+   */
+  void sweep(Readings &readings, unsigned long window_ms) const
+  {
+    for (size_t g = 0; g < _group_count; g++)
+    {
+      size_t begin = g * IrReceiver::ID_NUM;
+      size_t end = std::min(begin + IrReceiver::ID_NUM, _count);
+      metrics::ScopedTimer timer(metrics::ir_group_sweep[g % metrics::IR_GROUP_NUM]);
+      i2c_mux::Lock route_lock(_bus);
+      bool is_selected = _receivers[begin].select_route();
+      for (size_t i = begin; i < end; i++)
+      {
+        byte gun_num = 0;
+        readings.connected.set(i, is_selected && _receivers[i].read_selected(gun_num));
+        readings.gun_nums[i] = gun_num;
+        readings.read_millis[i] = hal::millis();
+        readings.histories[i].push(readings.read_millis[i], gun_num);
+      }
+    }
+    readings.sweep_millis = hal::millis();
+    for (auto &mask : readings.gun_masks)
+    {
+      mask.reset();
+    }
+    for (size_t i = 0; i < _count; i++)
+    {
+      readings.histories[i].for_each_within(
+          readings.sweep_millis, window_ms,
+          [&readings, i](const typename IrHistory<HISTORY_SIZE>::Sample &sample) {
+            if (sample.gun_num <= MAX_GUN_NUM)
+            {
+              readings.gun_masks[sample.gun_num].set(i);
+            }
+          });
+    }
+  }
+  //! 判定に使う走査結果
+  Readings &readings() { return _readings[_front]; }
+  const Readings &readings() const { return _readings[_front]; }
+  /**
+   * @brief 次の走査結果を受け取るためのバッファ
+   *
+   * Seqlockから読む途中の値が判定に使われないよう、ここに読んでからswap_readings()で切り替える。
+   */
+  Readings &back_readings() { return _readings[_front ^ 1]; }
+  //! back_readings()とreadings()を入れ替える、コピーはしない
+  void swap_readings() { _front ^= 1; }
+  void clear_histories(Readings &readings) const
+  {
+    for (auto &history : readings.histories)
+    {
+      history.clear();
+    }
+    for (auto &mask : readings.gun_masks)
+    {
+      mask.reset();
+    }
+  }
+
+  /**
+   * @brief 銃gun_numで撃たれた生存まとを探す
+   * @param now 現在時刻[ms]
+   * @param window_ms 遡る時間[ms]
+   * @param since_millis この時刻より後の受信だけを命中とする[ms]、まとを復活させた時刻を渡す
+   * @return int 見つかったまとのindex、無ければ-1
+   *
+   * gun_masksで候補を絞ってから、候補だけ現在時刻基準で履歴を確認する。
+   * 読み取りタスクが履歴を消す前に走査した結果には復活前の受信が残っているので、since_millisで除く。
+   */
+  int find_hit(byte gun_num, unsigned long now, unsigned long window_ms, unsigned long since_millis) const
+  {
+    if (gun_num == 0)
+    {
+      return -1;
+    }
+    Mask candidates = _alive;
+    if (gun_num <= MAX_GUN_NUM)
+    {
+      candidates &= readings().gun_masks[gun_num];
+    }
+    for (size_t i = 0; i < _count && candidates.any(); i++)
+    {
+      if (candidates.test(i) && readings().histories[i].contains(gun_num, now, window_ms, since_millis))
+      {
+        return static_cast<int>(i);
+      }
+      candidates.reset(i);
+    }
+    return -1;
+  }
+
+private:
+  size_t _count = 0;
+  size_t _group_count = 0;
+  int _bus = 0;
+  std::array<i2c_mux::Route, GROUP_NUM> _routes{};
+  std::array<uint8_t, N> _ids{};
+  std::array<IrReceiver, N> _receivers{};
+  Mask _alive;
+  std::array<Readings, 2> _readings{};
+  size_t _front = 0; // readings()として使う_readingsの添字
+};
+
+#endif // TARGET_BANK_HPP
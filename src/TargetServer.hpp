@@ -6,40 +6,95 @@
 #ifndef TARGET_SERVER_HPP
 #define TARGET_SERVER_HPP
 
-#include <WiFiClient.h>
-#include <WebServer.h>
+#include <memory>
+#include <hal.hpp>
+#include <metrics.hpp>
+#include "ShotProtocol.hpp"
 
 class TargetServer {
 public:
-  TargetServer() {
-    _server = new WebServer(80);
+  explicit TargetServer(uint16_t port = 80):_port(port) {
+    _server = hal::make_http_server(port);
   }
-  TargetServer(IPAddress ip, int port = 80):_ip(ip), _port(port) {
-    _server = new WebServer(ip, port);
+  void on_shoot(void (*func)(hal::HttpServer *http_server)) {
+    if (_server == nullptr) return;
+    _server->on("/", [this, func](){_record_queue_delay(); func(_server.get());});
   };
-  ~TargetServer() {
-    delete _server;
+  void on_shoot_batch(void (*func)(hal::HttpServer *http_server)) {
+    if (_server == nullptr) return;
+    _server->on("/batch", [this, func](){_record_queue_delay(); func(_server.get());});
   };
-  void on_shoot(void (*func)(WebServer *web_server)) {
+  void on_metrics(void (*func)(hal::HttpServer *http_server)) {
     if (_server == nullptr) return;
-    _server->on("/", [this, func](){func(_server);});
+    _server->on("/metrics", [this, func](){func(_server.get());});
   };
-  void on_init(void (*func)(WebServer *web_server)) {
+  void on_init(void (*func)(hal::HttpServer *http_server)) {
     if (_server == nullptr) return;
-    _server->on("/init", [this, func](){func(_server);});
+    _server->on("/init", [this, func](){_record_queue_delay(); func(_server.get());});
   };
+  /**
+   * @brief UDPでの要求を受け付ける
+   * @param func 要求を処理して応答を埋める関数、falseを返した場合は応答しない(センターに再送させる)
+   * @param port 待ち受けポート
+   *
+   * 受信した要求はhandle_client()の中で処理する。
+   * 同じseqの要求が再送されてきた場合はfuncを呼ばずに前回の応答を返す。
+   */
+  bool begin_udp(bool (*func)(const shot_protocol::Request &, shot_protocol::Reply &),
+                 uint16_t port = shot_protocol::DEFAULT_PORT) {
+    _on_udp_request = func;
+    _udp = hal::make_udp_socket();
+    _is_udp_running = _udp->begin(port);
+    return _is_udp_running;
+  }
   void begin(void) {
     if (_server == nullptr) return;
     _server->begin();
   }
   void handle_client(void) {
     if (_server == nullptr) return;
-    _server->handleClient();
+    _server->handle_client();
+    if (_is_udp_running) _handle_udp();
+    _micros_last_handle = hal::micros();
   }
 private:
-  IPAddress _ip = IPAddress(0, 0, 0, 0);
-  int _port = 80;
-  WebServer *_server = nullptr;
+  // 再送判定のために覚えておく応答の数
+  static constexpr size_t UDP_DUPLICATE_HISTORY = 16;
+  uint16_t _port = 80;
+  std::unique_ptr<hal::HttpServer> _server;
+  std::unique_ptr<hal::UdpSocket> _udp;
+  unsigned long _micros_last_handle = 0;
+  bool _is_udp_running = false;
+  bool (*_on_udp_request)(const shot_protocol::Request &, shot_protocol::Reply &) = nullptr;
+  shot_protocol::DuplicateFilter<UDP_DUPLICATE_HISTORY> _duplicate_filter;
+
+  // 前回handle_client()を抜けてからの時間を、リクエストが待たされた時間の上限として記録する
+  void _record_queue_delay(void) {
+    if (_micros_last_handle == 0) return;
+    metrics::http_queue_delay.record(hal::micros() - _micros_last_handle);
+  }
+  void _handle_udp(void) {
+    // 溜まっている要求を全て処理する
+    while (_udp->parse_packet() > 0) {
+      uint8_t data[shot_protocol::MESSAGE_SIZE + 1];
+      int length = _udp->read(data, sizeof(data));
+      shot_protocol::Request request;
+      if (length <= 0 || !shot_protocol::decode(data, length, request)) continue;
+      shot_protocol::Reply reply;
+      if (!_duplicate_filter.find(request.seq, reply)) {
+        if (request.type == shot_protocol::MessageType::init) {
+          // センターが再起動してseqが巻き戻っても判定できるよう、初期化時は忘れる
+          _duplicate_filter.clear();
+        }
+        reply.seq = request.seq;
+        reply.timestamp_ms = request.timestamp_ms;
+        if (!_on_udp_request(request, reply)) continue;
+        _duplicate_filter.remember(reply);
+      }
+      shot_protocol::Buffer buf = shot_protocol::encode(reply);
+      _udp->send_to(_udp->remote_ip(), _udp->remote_port(), buf.data(), buf.size());
+    }
+  }
 };
 
 #endif // TARGET_SERVER_HPP
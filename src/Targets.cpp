@@ -1,10 +1,30 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
-#include <WiFi.h>
+#include <hal.hpp>
+#include <i2c_bus.hpp>
+#include <metrics.hpp>
 #include "Targets.hpp"
 #include "debug.h"
 
-int Targets::alive_target_num = 0;
-std::vector<Target> Targets::_targets;
+Targets::Bank Targets::_bank;
+unsigned long Targets::_hit_window_ms = 150;
+unsigned long Targets::_max_snapshot_age_ms = 200;
+unsigned long Targets::_revived_millis = 0;
+Seqlock<Targets::Bank::Readings> Targets::_published_readings;
+std::atomic<bool> Targets::_clear_history_requested{false};
+int Targets::_poll_rate_hz = 0;
+bool Targets::_is_polling_task_running = false;
+std::unique_ptr<hal::Queue> Targets::_field_requests;
+std::unique_ptr<hal::Queue> Targets::_field_replies;
+uint32_t Targets::_field_seq = 0;
+std::atomic<uint32_t> Targets::_pending_field_seq{0};
+unsigned long Targets::_network_poll_interval_ms = 1;
+unsigned long Targets::_field_timeout_ms = 50;
+bool Targets::_is_network_task_running = false;
+std::array<Targets::IrEdgeState, Targets::MAX_TARGET_NUM> Targets::_edge_states;
 void (*Targets::_on_init)(void);
 void (*Targets::_on_hit)(int, int);
 
@@ -18,11 +38,36 @@ Targets::Targets(void (*on_init)(void),
   Targets::_on_hit = on_hit;
 }
 
-bool Targets::begin(int unit_id, int targets_num, bool begin_wifi)
+bool Targets::begin(int unit_id, int targets_num, bool begin_wifi, int poll_rate_hz, uint16_t http_port)
 {
-  for (int i = 0; i < targets_num; i++)
+  _unit_id = unit_id;
+  if (targets_num > MAX_TARGET_NUM)
   {
-    _targets.push_back(Target(i));
+    DebugPrint("<ERROR> targets_num=%d exceeds %d", targets_num, MAX_TARGET_NUM);
+    targets_num = MAX_TARGET_NUM;
+  }
+  i2c_mux::Lock::init();
+  size_t registered_num = _ir_routes.empty()
+                              ? _bank.begin(targets_num, nullptr, 0, _ir_bus)
+                              : _bank.begin(targets_num, _ir_routes.data(), _ir_routes.size(), _ir_bus);
+  if (static_cast<int>(registered_num) < targets_num)
+  {
+    DebugPrint("<ERROR> targets_num=%d exceeds %d, set more routes by set_ir_routes()", targets_num,
+               static_cast<int>(registered_num));
+  }
+  // get_error_targets()がすぐに使えるよう、読み取りタスクを動かす前に1度走査しておく
+  _bank.sweep(_bank.readings(), Targets::_hit_window_ms);
+  if (poll_rate_hz > 0)
+  {
+    // FreeRTOSのtick(1ms)より細かい周期にはできない
+    Targets::_poll_rate_hz = std::min(poll_rate_hz, 1000);
+    i2c_bus::Lock::init();
+    Targets::_is_polling_task_running = hal::start_task(Targets::_poll_task, nullptr, "ir_poll", POLL_TASK_STACK_SIZE,
+                                                        POLL_TASK_PRIORITY, POLL_TASK_CORE);
+    if (!Targets::_is_polling_task_running)
+    {
+      DebugPrint("<ERROR> failed to create ir polling task");
+    }
   }
   if (begin_wifi)
   {
@@ -35,23 +80,88 @@ bool Targets::begin(int unit_id, int targets_num, bool begin_wifi)
       DebugPrint("<ERROR> failed to connect wifi");
     }
   }
-  _server.reset(new TargetServer());
+  _server.reset(new TargetServer(http_port));
   _server->on_shoot(Targets::_handle_shoot);
+  _server->on_shoot_batch(Targets::_handle_shoot_batch);
   _server->on_init(Targets::_handle_init);
+  _server->on_metrics(Targets::_handle_metrics);
   _server->begin();
+  return true;
+}
+
+void Targets::set_ir_routes(const i2c_mux::Route *routes, size_t count)
+{
+  _ir_routes.assign(routes, routes + count);
+}
+
+void Targets::set_ir_bus(int bus)
+{
+  _ir_bus = bus;
+}
 
-  Targets::alive_target_num = targets_num;
+bool Targets::begin_udp(uint16_t port)
+{
+  if (!_server)
+  {
+    return false;
+  }
+  if (!_server->begin_udp(Targets::_handle_udp_request, port))
+  {
+    DebugPrint("<ERROR> failed to begin udp port=%d", port);
+    return false;
+  }
+  return true;
+}
+
+bool Targets::begin_push(const hal::IpAddress &center_ip, uint16_t center_port)
+{
+  _udp_hit_transport.reset(new UdpHitTransport(static_cast<uint8_t>(_unit_id)));
+  if (!_udp_hit_transport->begin(center_ip, center_port, shot_protocol::DEFAULT_PUSH_LOCAL_PORT))
+  {
+    DebugPrint("<ERROR> failed to begin hit push port=%d", shot_protocol::DEFAULT_PUSH_LOCAL_PORT);
+    return false;
+  }
+  begin_push(*_udp_hit_transport);
   return true;
 }
 
+void Targets::begin_push(HitTransport &transport)
+{
+  _hit_notifier.set_transport(&transport);
+  _is_push_mode = true;
+}
+
+bool Targets::begin_network_task(int core, int priority,
+                                 unsigned long poll_interval_ms, unsigned long field_timeout_ms)
+{
+  if (!_server || Targets::_is_network_task_running)
+  {
+    return false;
+  }
+  Targets::_network_poll_interval_ms = poll_interval_ms;
+  Targets::_field_timeout_ms = field_timeout_ms;
+  Targets::_field_requests = hal::make_queue(FIELD_QUEUE_SIZE, sizeof(FieldRequest));
+  // 結果を待つのは1件ずつなので、結果のキューは最新の1件だけ保持する
+  Targets::_field_replies = hal::make_queue(1, sizeof(FieldReply));
+  Targets::_is_network_task_running = hal::start_task(Targets::_network_task, _server.get(), "network",
+                                                      NETWORK_TASK_STACK_SIZE, priority, core);
+  if (!Targets::_is_network_task_running)
+  {
+    DebugPrint("<ERROR> failed to create network task");
+  }
+  return Targets::_is_network_task_running;
+}
+
 std::vector<int> Targets::get_error_targets(void)
 {
+  // 最後の走査で応答が無かったまとを返す、ここではバス通信しない
+  const Bank::Readings &readings = _bank.readings();
   std::vector<int> error_ids;
-  for (const auto &target : _targets)
+  for (size_t i = 0; i < _bank.size(); i++)
   {
-    if (!target.is_connected())
+    if (!readings.connected.test(i))
     {
-      error_ids.push_back(target.get_id());
+      error_ids.push_back(_bank.id(i));
     }
   }
   return error_ids;
@@ -59,96 +169,499 @@ std::vector<int> Targets::get_error_targets(void)
 
 void Targets::update()
 {
-  _server->handle_client();
-  for (const auto &target : _targets)
+  // 先に走査しておけば、この後のHTTPリクエスト処理では通信せずに判定できる
+  _refresh_readings();
+  if (!Targets::_is_network_task_running)
   {
-    if (target.is_recieve_ir())
+    _server->handle_client();
+  }
+  handle_field_requests();
+  if (_is_push_mode)
+  {
+    _detect_hits();
+    _hit_notifier.update(hal::millis());
+  }
+  const Bank::Readings &readings = _bank.readings();
+  for (size_t i = 0; i < _bank.size(); i++)
+  {
+    bool is_receiving = (readings.gun_nums[i] > 0);
+    if (_is_edge_mode &&
+        !_update_edge_state(_edge_states[i], is_receiving, readings.read_millis[i]))
+    {
+      continue;
+    }
+    if (is_receiving)
     {
-      _on_receive_ir(target.get_id(), target.is_alive);
+      _on_receive_ir(_bank.id(i), _bank.is_alive(i));
     }
     else
     {
-      _on_not_receive_ir(target.get_id(), target.is_alive);
+      _on_not_receive_ir(_bank.id(i), _bank.is_alive(i));
     }
   }
 }
 
-void Targets::_handle_shoot(WebServer *server)
+void Targets::handle_field_requests(void)
 {
-  String shoot_gun_num_s = server->arg("gun_num");
-  if (shoot_gun_num_s == "")
+  if (!Targets::_field_requests)
   {
-    _response_to_center(*server, 0);
     return;
   }
+  FieldRequest request;
+  while (Targets::_field_requests->receive(&request, 0))
+  {
+    // 依頼元が待つのを諦めた依頼は、センターに503が伝わっているので判定せずに捨てる
+    // 諦めるのと同時に処理を始めようとした場合でも、CASでどちらか一方だけが成功する
+    uint32_t pending_seq = request.seq;
+    if (!Targets::_pending_field_seq.compare_exchange_strong(pending_seq, 0))
+    {
+      continue;
+    }
+    FieldReply reply;
+    _execute(request, reply);
+    Targets::_field_replies->overwrite(&reply);
+    // 応答は依頼元のタスクが送るので、演出は応答と並行して始まる
+    _notify_hits(request, reply);
+  }
+}
 
-  int shoot_gun_num_i = shoot_gun_num_s.toInt();
-  for (auto &target : _targets)
+void Targets::_detect_hits(void)
+{
+  // 読み取りタスクがupdate()より速く走査している場合、最新の値だけでは間に受信した短いパルスを見逃すので、
+  // 射撃判定と同じく、走査時刻から遡って履歴に残っている受信から探す
+  using Sample = IrHistory<IR_HISTORY_SIZE>::Sample;
+  const Bank::Readings &readings = _bank.readings();
+  for (size_t i = 0; i < _bank.size(); i++)
   {
-    if (!target.is_alive)
+    if (!_bank.is_alive(i))
+    {
+      continue;
+    }
+    const Sample *first = nullptr;
+    readings.histories[i].for_each_within(
+        readings.sweep_millis, Targets::_hit_window_ms, [&first](const Sample &sample) {
+          // 新しい順に呼ばれるので、最後に残ったものが一番早く受信した銃
+          // 復活させる前の受信は、読み取りタスクが履歴を消す前の結果が残っているだけなので数えない
+          if (static_cast<long>(sample.millis - Targets::_revived_millis) > 0)
+          {
+            first = &sample;
+          }
+        });
+    if (first == nullptr)
     {
       continue;
     }
-    if (_is_hit(target, shoot_gun_num_i))
+    _bank.kill(i);
+    metrics::hits.increment();
+    if (!_hit_notifier.push(static_cast<uint8_t>(_bank.id(i)), first->gun_num, first->millis))
+    {
+      DebugPrint("<ERROR> hit queue is full, the oldest hit was dropped");
+    }
+    Targets::_on_hit(_bank.id(i), first->gun_num);
+  }
+}
+
+void Targets::set_ir_edge_mode(bool enable, unsigned long debounce_ms)
+{
+  _is_edge_mode = enable;
+  _debounce_ms = debounce_ms;
+}
+
+bool Targets::_update_edge_state(IrEdgeState &state, bool is_receiving, unsigned long now)
+{
+  if (is_receiving != state.raw_is_receiving)
+  {
+    state.raw_is_receiving = is_receiving;
+    state.raw_changed_millis = now;
+  }
+  if (state.raw_is_receiving == state.is_receiving)
+  {
+    return false;
+  }
+  if (now - state.raw_changed_millis < _debounce_ms)
+  {
+    return false;
+  }
+  state.is_receiving = state.raw_is_receiving;
+  return true;
+}
+
+void Targets::set_max_snapshot_age(unsigned long max_age_ms)
+{
+  Targets::_max_snapshot_age_ms = max_age_ms;
+}
+
+void Targets::set_hit_window(unsigned long window_ms)
+{
+  Targets::_hit_window_ms = window_ms;
+}
+
+int Targets::get_alive_target_num(void)
+{
+  return static_cast<int>(Targets::_bank.alive_count());
+}
+
+Targets::IrSnapshot Targets::get_snapshot(int target_id)
+{
+  const Bank::Readings &readings = Targets::_bank.readings();
+  IrSnapshot snapshot;
+  if (target_id < 0 || target_id >= static_cast<int>(Targets::_bank.size()))
+  {
+    return snapshot;
+  }
+  snapshot.gun_num = readings.gun_nums[target_id];
+  snapshot.millis = readings.read_millis[target_id];
+  snapshot.connected = readings.connected.test(target_id);
+  return snapshot;
+}
+
+void Targets::_refresh_readings(void)
+{
+  if (!Targets::_is_polling_task_running)
+  {
+    _bank.sweep(_bank.readings(), Targets::_hit_window_ms);
+    return;
+  }
+  // 書き込み中で読めなかった場合は数回だけ読み直し、それでもだめなら前回の値を使う
+  for (int i = 0; i < 3; i++)
+  {
+    if (Targets::_published_readings.try_read(_bank.back_readings()))
     {
-      _response_to_center(*server, shoot_gun_num_i);
-      target.is_alive = false;
-      Targets::alive_target_num--;
-      Targets::_on_hit(target.get_id(), shoot_gun_num_i);
+      _bank.swap_readings();
       return;
     }
   }
-  _response_to_center(*server, 0);
-  return;
 }
 
-void Targets::_handle_init(WebServer *server)
+bool Targets::_is_snapshot_stale(void)
 {
-  Targets::_on_init();
-  for (auto &target : Targets::_targets)
+  return (hal::millis() - Targets::_bank.readings().sweep_millis) > Targets::_max_snapshot_age_ms;
+}
+
+void Targets::_poll_task(void * /* arg */)
+{
+  // 履歴を積み上げていくので、走査結果はタスク側で保持し続ける
+  static Bank::Readings readings{};
+  const unsigned long period_ms = 1000 / Targets::_poll_rate_hz;
+  unsigned long next_wake_ms = hal::millis();
+  while (true)
+  {
+    if (Targets::_clear_history_requested.exchange(false))
+    {
+      _bank.clear_histories(readings);
+    }
+    _bank.sweep(readings, Targets::_hit_window_ms);
+    Targets::_published_readings.write(readings);
+    // 走査にかかった時間を除いて待ち、周期がずれていかないようにする
+    next_wake_ms += period_ms;
+    long wait_ms = static_cast<long>(next_wake_ms - hal::millis());
+    if (wait_ms > 0)
+    {
+      hal::delay(wait_ms);
+    }
+    else
+    {
+      // 走査が周期に間に合わなかった場合は、他のタスクに1tick譲ってから次の周期を始める
+      hal::delay(1);
+      next_wake_ms = hal::millis();
+    }
+  }
+}
+
+void Targets::_network_task(void *arg)
+{
+  TargetServer *server = static_cast<TargetServer *>(arg);
+  const unsigned long interval_ms = std::max(Targets::_network_poll_interval_ms, 1UL);
+  while (true)
+  {
+    server->handle_client();
+    hal::delay(interval_ms);
+  }
+}
+
+void Targets::_handle_shoot(hal::HttpServer *server)
+{
+  metrics::ScopedTimer timer(metrics::shot_duration);
+  char shoot_gun_num_s[8];
+  if (!server->arg("gun_num", shoot_gun_num_s, sizeof(shoot_gun_num_s)) || shoot_gun_num_s[0] == '\0')
+  {
+    _response_to_center(*server, 0);
+    return;
+  }
+  FieldRequest request;
+  request.type = FieldRequest::Type::shoot;
+  request.gun_count = 1;
+  request.gun_nums[0] = atoi(shoot_gun_num_s);
+  FieldReply reply;
+  if (!_submit(request, reply))
+  {
+    server->send(503, "text/plain", "busy");
+    return;
+  }
+  _response_to_center(*server, (reply.target_ids[0] < 0) ? 0 : request.gun_nums[0]);
+  if (!Targets::_is_network_task_running)
+  {
+    _notify_hits(request, reply);
+  }
+}
+
+void Targets::_handle_shoot_batch(hal::HttpServer *server)
+{
+  metrics::ScopedTimer timer(metrics::shot_duration);
+  // guns=1,2,3 のように銃番号をカンマ区切りで受け取り、
+  // targets=1,0,3 のように銃毎の結果(当たれば銃番号、外れたら0)を同じ順番で返す
+  // 正しい値は最長でMAX_BATCH_GUN_NUM * 4 - 1文字なので、バッファが埋まった場合は切り捨てられている
+  char guns_s[MAX_BATCH_GUN_NUM * 4 + 1];
+  FieldRequest request;
+  request.type = FieldRequest::Type::shoot;
+  if (!server->arg("guns", guns_s, sizeof(guns_s)) || strlen(guns_s) + 1 >= sizeof(guns_s) ||
+      !_parse_guns(guns_s, request))
+  {
+    // 一部の銃だけ判定すると、センターが残りの銃を外れと区別できないので全体を拒否する
+    server->send(400, "text/plain", "invalid guns");
+    return;
+  }
+
+  FieldReply reply;
+  if (!_submit(request, reply))
+  {
+    server->send(503, "text/plain", "busy");
+    return;
+  }
+  char body[16 + MAX_BATCH_GUN_NUM * 4] = "targets=";
+  size_t length = strlen(body);
+  for (int i = 0; i < request.gun_count; i++)
+  {
+    length += snprintf(body + length, sizeof(body) - length, (i == 0) ? "%d" : ",%d",
+                       (reply.target_ids[i] < 0) ? 0 : request.gun_nums[i]);
+  }
+  server->send(200, "text/plain", body);
+  if (!Targets::_is_network_task_running)
   {
-    target.is_alive = true;
+    _notify_hits(request, reply);
+  }
+}
+
+bool Targets::_parse_guns(const char *guns_s, FieldRequest &request)
+{
+  request.gun_count = 0;
+  const char *p = guns_s;
+  while (true)
+  {
+    // strtol()は空白や符号も読み飛ばすので、数字で始まることを先に確認する
+    if (*p < '0' || *p > '9' || request.gun_count >= MAX_BATCH_GUN_NUM)
+    {
+      return false;
+    }
+    char *end = nullptr;
+    long gun_num = strtol(p, &end, 10);
+    if (gun_num > 0xFF || (*end != ',' && *end != '\0'))
+    {
+      return false;
+    }
+    request.gun_nums[request.gun_count++] = static_cast<int>(gun_num);
+    if (*end == '\0')
+    {
+      return true;
+    }
+    p = end + 1;
+  }
+}
+
+void Targets::_handle_init(hal::HttpServer *server)
+{
+  FieldRequest request;
+  request.type = FieldRequest::Type::init;
+  FieldReply reply;
+  if (!_submit(request, reply))
+  {
+    server->send(503, "text/plain", "busy");
+    return;
   }
-  Targets::alive_target_num = Targets::_targets.size();
   server->send(200, "text/plain", "initialized");
 }
 
-void Targets::_response_to_center(WebServer &server, int response_num)
+bool Targets::_handle_udp_request(const shot_protocol::Request &udp_request, shot_protocol::Reply &reply)
 {
-  server.send(200, "text/plain", "target=" + String(response_num));
+  FieldRequest request;
+  FieldReply field_reply;
+  if (udp_request.type == shot_protocol::MessageType::init)
+  {
+    request.type = FieldRequest::Type::init;
+    if (!_submit(request, field_reply))
+    {
+      return false;
+    }
+    reply.type = shot_protocol::MessageType::initialized;
+    return true;
+  }
+  metrics::ScopedTimer timer(metrics::shot_duration);
+  request.type = FieldRequest::Type::shoot;
+  request.gun_count = 1;
+  request.gun_nums[0] = udp_request.gun_num;
+  if (!_submit(request, field_reply))
+  {
+    return false;
+  }
+  reply.type = shot_protocol::MessageType::result;
+  if (field_reply.target_ids[0] < 0)
+  {
+    return true;
+  }
+  reply.gun_num = udp_request.gun_num;
+  reply.target_id = static_cast<uint8_t>(field_reply.target_ids[0]);
+  if (!Targets::_is_network_task_running)
+  {
+    // 応答はこの関数を抜けた後に送るので、演出は応答より先に始まる
+    _notify_hits(request, field_reply);
+  }
+  return true;
 }
 
-bool Targets::_is_hit(const Target &target, int shoot_gun_num_i)
+bool Targets::_submit(FieldRequest &request, FieldReply &reply)
 {
-  byte gun_num = target.get_gun_num();
-  if (gun_num == shoot_gun_num_i)
+  if (!Targets::_is_network_task_running)
   {
+    // update()の中から呼ばれているので、その場で判定する
+    _execute(request, reply);
     return true;
   }
-  return false;
+  // 0は待っている依頼が無いことを表すので使わない
+  if (++Targets::_field_seq == 0)
+  {
+    ++Targets::_field_seq;
+  }
+  request.seq = Targets::_field_seq;
+  unsigned long deadline_millis = hal::millis() + Targets::_field_timeout_ms;
+  Targets::_pending_field_seq.store(request.seq);
+  if (!Targets::_field_requests->send(&request, Targets::_field_timeout_ms))
+  {
+    Targets::_pending_field_seq.store(0);
+    metrics::field_timeouts.increment();
+    return false;
+  }
+  while (true)
+  {
+    long remaining_ms = static_cast<long>(deadline_millis - hal::millis());
+    if (remaining_ms <= 0)
+    {
+      // update()側がまだ処理を始めていなければ取り消す
+      uint32_t pending_seq = request.seq;
+      if (Targets::_pending_field_seq.compare_exchange_strong(pending_seq, 0))
+      {
+        metrics::field_timeouts.increment();
+        return false;
+      }
+      // 処理が始まっているので結果は必ず届く、それを待って応答する
+      // (命中させたのに503を返すと、センターが再送して同じ射撃を2回判定してしまう)
+      deadline_millis = hal::millis() + Targets::_field_timeout_ms;
+      continue;
+    }
+    if (Targets::_field_replies->receive(&reply, remaining_ms) && reply.seq == request.seq)
+    {
+      return true;
+    }
+  }
 }
 
-bool Targets::_connect_ap(int id)
+void Targets::_execute(const FieldRequest &request, FieldReply &reply)
 {
-  WiFi.mode(WIFI_AP_STA);
-  WiFi.config(IPAddress(192, 168, 100, 200 + id),
-              IPAddress(192, 168, 100, 1), IPAddress(255, 255, 255, 0));
-  const char *ssid = "your-ssid";
-  const char *password = "your-pass";
-  WiFi.begin(ssid, password);
-  DebugPrint("connecting to wifi ssid = %s, password = %s\n", ssid, password);
-  unsigned int try_connect_count = 0;
-  while (WiFi.status() != WL_CONNECTED)
+  reply.seq = request.seq;
+  if (request.type == FieldRequest::Type::init)
   {
-    try_connect_count++;
-    if (try_connect_count > 30)
-      break;
-    DebugPrint(".");
-    delay(500);
+    _init();
+    return;
   }
-  if (WiFi.status() == WL_CONNECTED)
+  // 全ての銃を同じ読み取り結果で判定する
+  // 同じまとに複数の銃が当たっていた場合は、リクエストで先に書かれた銃が倒したことにする
+  _prepare_readings();
+  unsigned long now = hal::millis();
+  for (int i = 0; i < request.gun_count; i++)
   {
-    return true;
+    int index = _judge(request.gun_nums[i], now);
+    reply.target_ids[i] = (index < 0) ? -1 : _bank.id(index);
+  }
+}
+
+void Targets::_notify_hits(const FieldRequest &request, const FieldReply &reply)
+{
+  for (int i = 0; i < request.gun_count; i++)
+  {
+    if (reply.target_ids[i] >= 0)
+    {
+      Targets::_on_hit(reply.target_ids[i], request.gun_nums[i]);
+    }
+  }
+}
+
+void Targets::_prepare_readings(void)
+{
+  if (Targets::_is_polling_task_running)
+  {
+    // 読み取りタスクの最新結果を取り込む、バス通信は発生しない
+    _refresh_readings();
+  }
+  else if (_is_snapshot_stale())
+  {
+    _bank.sweep(_bank.readings(), Targets::_hit_window_ms);
   }
-  return false;
-}
\ No newline at end of file
+}
+
+int Targets::_judge(int shoot_gun_num_i, unsigned long now)
+{
+  if (shoot_gun_num_i <= 0 || shoot_gun_num_i > 0xFF)
+  {
+    return -1;
+  }
+  // リクエストがIRパルスより少し遅れて届いても命中とするため、直近の受信履歴で判定する
+  // /initより前の受信は、読み取りタスクから受け取った古い走査結果に残っていても数えない
+  int index = _bank.find_hit(static_cast<byte>(shoot_gun_num_i), now, Targets::_hit_window_ms,
+                             Targets::_revived_millis);
+  if (index >= 0)
+  {
+    _bank.kill(index);
+    metrics::hits.increment();
+  }
+  else
+  {
+    metrics::misses.increment();
+  }
+  return index;
+}
+
+void Targets::_init(void)
+{
+  Targets::_on_init();
+  _bank.revive_all();
+  Targets::_revived_millis = hal::millis();
+  _bank.clear_histories(_bank.readings());
+  Targets::_clear_history_requested = true;
+  // on_init()で演出が消されている前提で、受信していない状態から数え直す
+  Targets::_edge_states.fill(IrEdgeState());
+}
+
+void Targets::_handle_metrics(hal::HttpServer *server)
+{
+  // ヒープを使わないよう、書き出し先は静的なバッファにする
+  static char body[16384];
+  metrics::write_prometheus(body, sizeof(body));
+  server->send(200, "text/plain; version=0.0.4", body);
+}
+
+void Targets::_response_to_center(hal::HttpServer &server, int response_num)
+{
+  // Stringの連結でヒープを確保しないよう固定長バッファに書き込む
+  char body[16];
+  snprintf(body, sizeof(body), "target=%d", response_num);
+  server.send(200, "text/plain", body);
+}
+
+bool Targets::_connect_ap(int id)
+{
+  const char *ssid = "your-ssid";
+  const char *password = "your-pass";
+  DebugPrint("connecting to wifi ssid = %s, password = %s\n", ssid, password);
+  return hal::connect_wifi(hal::IpAddress(192, 168, 100, 200 + id),
+                           hal::IpAddress(192, 168, 100, 1), hal::IpAddress(255, 255, 255, 0),
+                           ssid, password, 15000);
+}
@@ -1,17 +1,45 @@
 #ifndef TARGETS_HPP
 #define TARGETS_HPP
 
-#include "Target.hpp"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <hal.hpp>
+#include <i2c_mux.hpp>
+#include "TargetBank.hpp"
+#include "Seqlock.hpp"
+#include "HitNotifier.hpp"
+#include "UdpHitTransport.hpp"
 #include "TargetServer.hpp"
 
+// 1ユニットに接続できるまとの最大数、17個以上繋ぐ場合は-DTARGETS_MAX_NUM=64のようにビルドフラグで指定する
+#ifndef TARGETS_MAX_NUM
+#define TARGETS_MAX_NUM 16
+#endif
+
 class Targets
 {
 public:
+  /**
+   * @brief 赤外線受信状態のスナップショット
+   *
+   * update()の1回の走査で全てのまとについて1度だけ読み取り、
+   * 演出処理と射撃判定の両方でこの値を参照する。
+   */
+  struct IrSnapshot
+  {
+    byte gun_num = 0;         // 受信している銃番号、受信していなければ0
+    unsigned long millis = 0; // 読み取った時刻[ms]
+    bool connected = false;   // 読み取り時に赤外線受信モジュールから応答があったか
+  };
   /**
    * @brief コンストラクタ
    * @param on_init ゲーム開始時に毎回行う初期化処理
    * @param on_receive_ir 赤外線を受信した時の演出処理
    * @param on_not_receive_ir 赤外線を受信していない時に演出処理
+   * @note set_ir_edge_mode()でエッジモードにした場合、on_receive_irは受信開始時、
+   *       on_not_receive_irは受信終了時にだけ呼ばれる
    * @param on_hit 弾が当たった時の演出処理
    */
   Targets(void (*on_init)(),
@@ -21,18 +49,87 @@ public:
   /**
    * @brief 最初に1度だけ行う必要がある初期化処理
    * @param unit_id まとユニットの番号、0始まりで指定する
-   * @param targets_num まとの個数
+   * @param targets_num まとの個数、17個以上の場合は先にset_ir_routes()で経路を設定しておく
    * @param begin_wifi true:WiFi.begin()を実行する, false:WiFi.begin()を実行しない
+   * @param poll_rate_hz 0より大きい値を指定すると、専用タスクでこの周期[Hz]で赤外線受信モジュールを読み取る。
+   *                     0の場合はupdate()の中で読み取る。
+   * @param http_port HTTPの待ち受けポート、シミュレーションで複数のユニットを1台で動かす場合に変える
    * @return bool true:成功, false:失敗
    * @attention Serial.begin() or M5.begin() 後に呼び出す必要がある。
    * 
    * 初期化処理は本当はコンストラクタでまとめてやってもよいのだが、
    * 一部エラーをシリアル出力したい処理があるのでそれはこっちでやる。
    */
-  bool begin(int unit_id, int targets_num, bool begin_wifi = true);
+  bool begin(int unit_id, int targets_num, bool begin_wifi = true, int poll_rate_hz = 0,
+             uint16_t http_port = 80);
+  /**
+   * @brief 赤外線受信モジュールをTCA9548Aの先に繋ぐ場合の経路を設定する、begin()の前に呼ぶ
+   * @param routes まと16個毎の経路、id 16k~16k+15のまとはroutes[k]に繋ぐ
+   * @param count routesの要素数、最大MAX_TARGET_NUM / 16
+   *
+   * 赤外線受信モジュールのロータリースイッチは、経路毎にidの下位4bit(0~15)に合わせる。
+   * 走査では経路毎に1度だけチャンネルを選択し、かかった時間は"/metrics"のsyateki_ir_group_sweep_secondsで見られる。
+   */
+  void set_ir_routes(const i2c_mux::Route *routes, size_t count);
+  /**
+   * @brief 赤外線受信モジュールを繋いだバスを設定する、begin()の前に呼ぶ
+   * @param bus 0:Wire(既定), 1:Wire1
+   *
+   * LEDやXIAOと別のバスにして、begin()のpoll_rate_hzで読み取りタスクを動かすと、
+   * 走査とLEDの送信が互いを待たずに同時に行われる。バスのクロックはi2c_bus::begin()で設定する。
+   */
+  void set_ir_bus(int bus);
+  /**
+   * @brief UDPでの射撃判定を受け付ける、begin()の後に呼ぶ
+   * @param port 待ち受けポート
+   * @return bool true:成功, false:失敗
+   *
+   * HTTPの"/"と"/init"と同じ処理を、ShotProtocol.hppの固定長バイナリで受け付ける。
+   */
+  bool begin_udp(uint16_t port = shot_protocol::DEFAULT_PORT);
+  /**
+   * @brief 命中をまとユニット側で検出し、センターへ通知するモードにする、begin()の後に呼ぶ
+   * @param center_ip センターのIPアドレス
+   * @param center_port センターで命中通知を待ち受けているポート
+   * @return bool true:成功, false:失敗
+   *
+   * update()の中で、生存しているまとが赤外線を受信したら命中としてon_hitを呼び、
+   * ShotProtocol.hppの命中通知をセンターへ送る。センターが"/"で問い合わせる必要はなくなる。
+   * 受信履歴から探すので、読み取りタスクが前回のupdate()との間に読んだ短いパルスも、
+   * set_hit_window()の時間内であれば命中になる。
+   */
+  bool begin_push(const hal::IpAddress &center_ip, uint16_t center_port = shot_protocol::DEFAULT_PUSH_CENTER_PORT);
+  /**
+   * @brief 送信手段を指定して命中通知モードにする
+   * @param transport 通知の送信手段、Targetsより長く生存させること
+   */
+  void begin_push(HitTransport &transport);
+  /**
+   * @brief HTTP/UDPの処理をupdate()から切り離して専用タスクで行う、begin()とbegin_udp()の後に呼ぶ
+   * @param core タスクを動かすコア
+   * @param priority タスクの優先度
+   * @param poll_interval_ms HTTP/UDPの受信を確認する周期[ms]
+   * @param field_timeout_ms 射撃判定をupdate()側に依頼してから、判定が始まるのを待つ最大時間[ms]
+   * @return bool true:成功, false:失敗
+   *
+   * 射撃判定と演出処理はこれまで通りupdate()を呼んだタスクで行い、結果を待ってから応答する。
+   * 遅いHTTPクライアントがいても、update()を呼ぶ側の処理は待たされなくなる。
+   * 依頼した判定がfield_timeout_ms以内に始まらなければ、取り消してHTTPは503を返し、UDPは応答しない(センターに再送させる)。
+   * 取り消しと判定の開始が重なった場合は必ずどちらか一方になり、判定した射撃に503を返すことは無い。
+   */
+  bool begin_network_task(int core = 0, int priority = 1,
+                          unsigned long poll_interval_ms = 1, unsigned long field_timeout_ms = 50);
+  /**
+   * @brief 専用タスクから依頼された射撃判定を処理する
+   *
+   * update()の中でも呼ばれる。判定の遅れをupdate()の周期より短くしたい場合は、これを高い頻度で呼ぶ。
+   */
+  void handle_field_requests(void);
   /**
    * @brief 異常状態になっている的を取得する
    * @return std::vector<int> 異常状態のまとのid、無ければ空のvectorを返す。
+   *
+   * 最後の走査で赤外線受信モジュールから応答が無かったまとを返す。改めて通信はしない。
    */
   std::vector<int> get_error_targets(void);
   /**
@@ -42,20 +139,145 @@ public:
    * この処理はM5.update()のように定期的に呼び出す必要がある。
    */
   void update();
-  static int alive_target_num;
+  /**
+   * @brief スナップショットの有効期間を設定する
+   * @param max_age_ms 射撃判定時にスナップショットがこれより古ければ読み直す[ms]
+   */
+  void set_max_snapshot_age(unsigned long max_age_ms);
+  /**
+   * @brief 最後に読み取ったスナップショットを取得する
+   * @param target_id まとのid
+   */
+  static IrSnapshot get_snapshot(int target_id);
+  /**
+   * @brief 射撃判定で遡る赤外線受信履歴の時間を設定する
+   * @param window_ms 射撃リクエストを受け取った時刻からこの時間内に受信していれば命中とする[ms]
+   */
+  void set_hit_window(unsigned long window_ms);
+  /**
+   * @brief 赤外線受信演出の呼び出し方を設定する
+   * @param enable true:受信状態が変化した時だけ演出処理を呼ぶ, false:update()の度に毎回呼ぶ
+   * @param debounce_ms 受信状態がこの時間以上続いたら変化したとみなす[ms]、0ならすぐに変化とみなす
+   *
+   * 何も変化が無ければ演出処理が呼ばれないので、LEDへの無駄な書き込みが無くなる。
+   */
+  void set_ir_edge_mode(bool enable, unsigned long debounce_ms = 0);
+  //! 生存しているまとの数
+  static int get_alive_target_num(void);
+  // 1ユニットに接続できる赤外線受信モジュールの最大数、ビルドフラグTARGETS_MAX_NUMで変える
+  // 1つの経路にはロータリースイッチの範囲の16個まで、TCA9548Aを使えば16個毎に経路を増やせる
+  // まと毎の配列と走査結果の大きさがこの値で決まるので、繋ぐ数に合わせて小さくしておく
+  static constexpr int MAX_TARGET_NUM = TARGETS_MAX_NUM;
+  // "/batch"で1度に判定できる銃の数
+  static constexpr int MAX_BATCH_GUN_NUM = 8;
+  // 命中通知を貯めておける数
+  static constexpr size_t HIT_QUEUE_SIZE = 32;
 
 private:
+  // まと毎に保持する赤外線受信履歴のサンプル数
+  static constexpr size_t IR_HISTORY_SIZE = 8;
+  // 読み取りタスクの設定
+  static constexpr int POLL_TASK_CORE = 0;
+  static constexpr int POLL_TASK_PRIORITY = 2;
+  static constexpr int POLL_TASK_STACK_SIZE = 4096;
+  // HTTP/UDP処理タスクの設定
+  static constexpr int NETWORK_TASK_STACK_SIZE = 8192;
+  static constexpr size_t FIELD_QUEUE_SIZE = 4;
+  using Bank = TargetBank<MAX_TARGET_NUM, IR_HISTORY_SIZE>;
+  /**
+   * @brief update()側で行う処理の依頼
+   *
+   * 射撃判定は、銃1つでもまとめて判定する場合でも同じ形で依頼する。
+   */
+  struct FieldRequest
+  {
+    enum class Type : uint8_t
+    {
+      shoot,
+      init
+    };
+    uint32_t seq = 0;
+    Type type = Type::shoot;
+    int gun_count = 0;
+    int gun_nums[MAX_BATCH_GUN_NUM] = {};
+  };
+  //! FieldRequestの結果、銃毎に当たったまとのid、外れたら-1
+  struct FieldReply
+  {
+    uint32_t seq = 0;
+    int target_ids[MAX_BATCH_GUN_NUM] = {};
+  };
+  /**
+   * @brief エッジモードで使う、まと毎の受信状態
+   */
+  struct IrEdgeState
+  {
+    bool is_receiving = false;            // 演出処理に通知済みの受信状態
+    bool raw_is_receiving = false;        // 最後に読み取った受信状態
+    unsigned long raw_changed_millis = 0; // raw_is_receivingが変化した時刻[ms]
+  };
+
   std::unique_ptr<TargetServer> _server;
-  static std::vector<Target> _targets;
+  std::vector<i2c_mux::Route> _ir_routes;
+  int _ir_bus = 0;
+  // まと情報と、loop()側から参照する走査結果
+  static Bank _bank;
+  static unsigned long _hit_window_ms;
+  static unsigned long _max_snapshot_age_ms;
+  static unsigned long _revived_millis; // 最後に全てのまとを復活させた時刻[ms]、これより前の受信は命中にしない
+  // 読み取りタスク関係
+  // 読み取りタスクで更新したものをSeqlockでloop()側に渡す
+  static Seqlock<Bank::Readings> _published_readings;
+  static std::atomic<bool> _clear_history_requested;
+  static int _poll_rate_hz;
+  static bool _is_polling_task_running;
+  // HTTP/UDP処理タスク関係
+  static std::unique_ptr<hal::Queue> _field_requests;
+  static std::unique_ptr<hal::Queue> _field_replies;
+  static uint32_t _field_seq;
+  // 依頼元が結果を待っている依頼のseq、待っていなければ0
+  // update()側は処理を始める時に、依頼元は待つのを諦める時に、0へのCASで取り合う
+  static std::atomic<uint32_t> _pending_field_seq;
+  static unsigned long _network_poll_interval_ms;
+  static unsigned long _field_timeout_ms;
+  static bool _is_network_task_running;
+  // 命中通知関係
+  int _unit_id = 0;
+  bool _is_push_mode = false;
+  std::unique_ptr<UdpHitTransport> _udp_hit_transport;
+  HitNotifier<HIT_QUEUE_SIZE> _hit_notifier;
+  // エッジモード関係
+  bool _is_edge_mode = false;
+  unsigned long _debounce_ms = 0;
+  static std::array<IrEdgeState, MAX_TARGET_NUM> _edge_states;
   void (*_on_receive_ir)(int, bool);
   void (*_on_not_receive_ir)(int, bool);
   static void (*_on_init)(void);
   static void (*_on_hit)(int, int);
   
-  static void _handle_shoot(WebServer *server);
-  static void _handle_init(WebServer *server);
-  static void _response_to_center(WebServer &server, int response_num);
-  static bool _is_hit(const Target &target, int shoot_gun_num_i);
+  static void _handle_shoot(hal::HttpServer *server);
+  static void _handle_shoot_batch(hal::HttpServer *server);
+  static void _handle_init(hal::HttpServer *server);
+  static void _handle_metrics(hal::HttpServer *server);
+  /**
+   * @brief "/batch"のgunsを読み取る
+   * @return bool true:成功, false:空の項目、数字以外、0~255の範囲外の値があるか、MAX_BATCH_GUN_NUMより多い
+   */
+  static bool _parse_guns(const char *guns_s, FieldRequest &request);
+  static bool _handle_udp_request(const shot_protocol::Request &udp_request, shot_protocol::Reply &reply);
+  static bool _submit(FieldRequest &request, FieldReply &reply);
+  static void _execute(const FieldRequest &request, FieldReply &reply);
+  static void _notify_hits(const FieldRequest &request, const FieldReply &reply);
+  static void _prepare_readings(void);
+  static int _judge(int shoot_gun_num_i, unsigned long now);
+  static void _init(void);
+  void _detect_hits(void);
+  static void _response_to_center(hal::HttpServer &server, int response_num);
+  static void _refresh_readings(void);
+  static bool _is_snapshot_stale(void);
+  static void _poll_task(void *arg);
+  static void _network_task(void *arg);
+  bool _update_edge_state(IrEdgeState &state, bool is_receiving, unsigned long now);
   bool _connect_ap(int id);
 };
 
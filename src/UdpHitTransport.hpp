@@ -0,0 +1,54 @@
+/**
+ * @file UdpHitTransport.hpp
+ * @brief 命中通知をUDPで送るクラスヘッダ
+ */
+
+#ifndef UDP_HIT_TRANSPORT_HPP
+#define UDP_HIT_TRANSPORT_HPP
+
+#include <memory>
+#include <hal.hpp>
+#include "HitNotifier.hpp"
+
+/**
+ * @class UdpHitTransport
+ * @brief ShotProtocol.hppの命中通知をセンターへUDPで送信するクラス
+ */
+class UdpHitTransport : public HitTransport
+{
+public:
+  explicit UdpHitTransport(uint8_t unit_id) : _unit_id(unit_id), _udp(hal::make_udp_socket()) {}
+  bool begin(const hal::IpAddress &center_ip, uint16_t center_port, uint16_t local_port)
+  {
+    _center_ip = center_ip;
+    _center_port = center_port;
+    return _udp->begin(local_port);
+  }
+  bool send(const shot_protocol::HitEvent *events, size_t count) override
+  {
+    shot_protocol::HitEventsBuffer buf;
+    size_t length = shot_protocol::encode_hit_events(events, count, _unit_id, hal::millis(), buf);
+    return _udp->send_to(_center_ip, _center_port, buf.data(), length);
+  }
+  bool poll_ack(uint32_t &acked_seq) override
+  {
+    while (_udp->parse_packet() > 0)
+    {
+      uint8_t data[shot_protocol::MESSAGE_SIZE + 1];
+      int length = _udp->read(data, sizeof(data));
+      if (length > 0 && shot_protocol::decode_hit_ack(data, length, acked_seq))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  uint8_t _unit_id;
+  hal::IpAddress _center_ip;
+  uint16_t _center_port = shot_protocol::DEFAULT_PUSH_CENTER_PORT;
+  std::unique_ptr<hal::UdpSocket> _udp;
+};
+
+#endif // UDP_HIT_TRANSPORT_HPP
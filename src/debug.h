@@ -9,7 +9,17 @@
 //  デバッグ出力ON/OFF用マクロ
 #define DEBUG
 
-#ifdef DEBUG
+#if defined(DEBUG) && !defined(ARDUINO)
+    // nativeビルドでは標準出力に出す
+    #include <cstdio>
+    #define BeginDebugPrint()
+    #define DebugPrint( ... )\
+        {\
+            printf( __VA_ARGS__ );\
+            printf( " (Func:%s)\n", __func__ );\
+            fflush( stdout );\
+        }
+#elif defined(DEBUG)
     #define BeginDebugPrint()    Serial.begin( 115200 )
     #define DebugPrint( ... )\
         {\
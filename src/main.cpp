@@ -5,35 +5,37 @@
 #include <motor.hpp>
 #include <photo_reflector.hpp>
 #include <servo.hpp>
+#include <servo_trajectory.hpp>
 #include <ht16k33LED.hpp>
+#include <ht16k33Animator.hpp>
+#include <i2c_bus.hpp>
+#include <alloc_counter.hpp>
+#include <metrics.hpp>
+#include <scheduler.hpp>
+#include <status_panel.hpp>
+#include <xiao_link.hpp>
+#include "GunColor.hpp"
 #include "Targets.hpp"
 #include "debug.h"
 
-/*
-struct RotationServoPhase
-{
-  unsigned long millis_phase_change = 0;
-  bool is_reversing = false;
-  unsigned long interval = 0;
-  int current_angle = 0;
-};
-*/
-
 static void on_init();
 static void on_receive_ir(int target_id, bool is_alive);
 static void on_not_receive_ir(int target_id, bool is_alive);
 static void on_hit(int target_id, int gun_id);
 static void maintenance();
 static void init_lcd();
-static void show_motor_value(int power);
-static void update_motor(int motor_power);
+static void show_motor_value();
+static void show_target_values();
+static void show_loop_values();
 static void show_reflector_values(int top, int bottom);
 static void clear_leds();
-static ht16k33LED::Color gun_id2color(int gun_id);
-static void update_servos();
-//static void update_rotation_servo(M5Servo &servo, RotationServoPhase &phase);
-static long update_normal_servo(M5Servo &servo, long millis_angle_change);
-static void send_to_xiao(char phase, int pattern);
+static void begin_servos();
+static void task_targets();
+static void task_field_requests();
+static void task_buttons();
+static void task_xiao();
+static void task_lcd();
+static void task_report();
 
 // まとユニット番号、この番号によってIPアドレスが決まるため、他とかぶってはいけない
 static constexpr int UNIT_ID = 2;
@@ -48,27 +50,72 @@ static constexpr int PIN_TOP_REFLECTOR = 36;
 static constexpr int PIN_SERVO_PICK = 2;    // 起動設定に関係するピンなので注意
 static constexpr int PIN_SERVO_VOLUMES = 5; // 起動設定に関係するピンなので注意
 
+#ifdef DUAL_I2C_BUS
+// LEDとXIAOはWire1に繋ぎ、赤外線受信モジュールだけをWireに残す
+// Wire1のピンはM-Busの空きピン、配線に合わせて変える
+static constexpr int LED_BUS = 1;
+static constexpr int PIN_WIRE1_SDA = 13;
+static constexpr int PIN_WIRE1_SCL = 15;
+// HT16K33とXIAOは400kHzに対応している
+static constexpr uint32_t WIRE1_CLOCK_HZ = 400000;
+// 赤外線受信モジュールは専用タスクで走査し、loop()側のLEDの送信と同時に進める
+static constexpr int IR_POLL_RATE_HZ = 200;
+#else
+static constexpr int LED_BUS = 0;
+static constexpr int IR_POLL_RATE_HZ = 0;
+#endif
+
+#ifdef XIAO_FRAMED_LINK
+// 演出用マイコンがフレームに対応している場合は、1トランザクションでまとめて送る
+static constexpr xiao_link::Link::Format XIAO_FORMAT = xiao_link::Link::Format::framed;
+#else
+// 従来のXIAOのスケッチは1文字ずつ受け取るので、既定ではその形式で送る
+static constexpr xiao_link::Link::Format XIAO_FORMAT = xiao_link::Link::Format::legacy;
+#endif
+
+// 各処理の周期[us]
+static constexpr uint32_t PERIOD_REFLECTOR_SAMPLE_US = 500; // フォトリフレクタの読み取り
+static constexpr uint32_t PERIOD_MOTOR_US = 500;            // 端での停止・反転が遅れないよう、読み取りと同じ周期で確認する
+static constexpr uint32_t PERIOD_TARGETS_US = 10000;        // HTTP/UDPの処理とLEDの演出
+static constexpr uint32_t PERIOD_FIELD_REQUESTS_US = 1000;  // HTTP/UDP処理タスクから依頼された射撃判定
+static constexpr uint32_t PERIOD_XIAO_US = 10000;           // 演出用マイコンへの送信
+static constexpr uint32_t PERIOD_BUTTONS_US = 100000;       // 押している間モータの出力が変わり続けるので、速くしすぎない
+static constexpr uint32_t PERIOD_LCD_US = 200000;
+static constexpr uint32_t PERIOD_REPORT_US = 10000000;      // 周期に間に合わなかった処理の報告
+
 // Targetsクラスのインスタンスをglobalで定義する
 static Targets targets(on_init, on_receive_ir, on_not_receive_ir, on_hit);
 static int motor_power = 0;
 static LGFX lcd;
+static status_panel::StatusPanel status_panel_lcd(lcd);
+// 状態表示パネルのフィールド番号、init_lcd()で決まる
+static int field_reflector = -1;
+static int field_motor = -1;
+static int field_targets = -1;
+static int field_loop = -1;
 static Motor motor(PIN_MOTOR_REF, PIN_MOTOR1, PIN_MOTOR2);
 static PhotoReflector bottom_reflector(PIN_BOTTOM_REFLECTOR);
 static PhotoReflector top_reflector(PIN_TOP_REFLECTOR);
+static MotorController motor_controller(motor, top_reflector, bottom_reflector);
+static PhotoReflectorSampler reflector_sampler;
 static M5Servo servo_pick(0, PIN_SERVO_PICK, 0.5, 2.4);
 static M5Servo servo_volumes(1, PIN_SERVO_VOLUMES, 0.5, 2.4);
+static ServoTrajectory servo_trajectory;
+static xiao_link::Link xiao(xiao_link::Link::DEFAULT_ADDRESS, LED_BUS);
 static ht16k33LED::Led leds[TARGET_NUM] = {
-    ht16k33LED::Led(0),
-    ht16k33LED::Led(1),
-    ht16k33LED::Led(2),
-    ht16k33LED::Led(3),
-    ht16k33LED::Led(4),
-    ht16k33LED::Led(0, 0x71),
-    ht16k33LED::Led(1, 0x71),
-    ht16k33LED::Led(2, 0x71),
-    ht16k33LED::Led(3, 0x71)};
-//static RotationServoPhase servo_pick_phase{};
-static long millis_nservo_angle_change[2] = {0, 0};
+    ht16k33LED::Led(0, 0x70, false, LED_BUS),
+    ht16k33LED::Led(1, 0x70, false, LED_BUS),
+    ht16k33LED::Led(2, 0x70, false, LED_BUS),
+    ht16k33LED::Led(3, 0x70, false, LED_BUS),
+    ht16k33LED::Led(4, 0x70, false, LED_BUS),
+    ht16k33LED::Led(0, 0x71, false, LED_BUS),
+    ht16k33LED::Led(1, 0x71, false, LED_BUS),
+    ht16k33LED::Led(2, 0x71, false, LED_BUS),
+    ht16k33LED::Led(3, 0x71, false, LED_BUS)};
+static ht16k33LED::Animator animator;
+static unsigned long micros_targets_start = 0;
+static scheduler::Scheduler task_scheduler;
+static uint32_t reported_overrun_count = 0;
 
 void setup()
 {
@@ -77,8 +124,42 @@ void setup()
   dacWrite(25, 0);
   M5.Power.begin();
 
+  // フォトリフレクタはタイマで読み取り、フィルタ後の値をモータ制御と表示で使う
+  reflector_sampler.add(top_reflector);
+  reflector_sampler.add(bottom_reflector);
+  if (!reflector_sampler.begin(PERIOD_REFLECTOR_SAMPLE_US))
+  {
+    DebugPrint("<ERROR> failed to begin photo reflector sampling");
+  }
+  // モータは端の確認と加減速をタイマで行う、0から255まで0.5秒で加速し、0.25秒で減速する
+  motor_controller.set_ramp(510, 1020);
+  if (!motor_controller.begin(PERIOD_MOTOR_US))
+  {
+    DebugPrint("<ERROR> failed to begin motor control");
+  }
+
   // まと関係の初期化、M5.begin() or Serial.begin() の後に行う
-  targets.begin(UNIT_ID, TARGET_NUM);
+  // 17個以上のまとを繋ぐ場合は、TCA9548Aのチャンネル毎に16個ずつ繋ぎ、begin()の前に経路を設定する
+  // その場合はビルドフラグで最大数も増やしておく(-DTARGETS_MAX_NUM=32など)
+  //const i2c_mux::Route ir_routes[] = {i2c_mux::Route(0x77, 0), i2c_mux::Route(0x77, 1)};
+  //targets.set_ir_routes(ir_routes, 2);
+#ifdef DUAL_I2C_BUS
+  // WireはM5.begin()で開始済み、Wire1はピンを指定して開始する
+  i2c_bus::begin(LED_BUS, PIN_WIRE1_SDA, PIN_WIRE1_SCL, WIRE1_CLOCK_HZ);
+  targets.set_ir_bus(0);
+#endif
+  targets.begin(UNIT_ID, TARGET_NUM, true, IR_POLL_RATE_HZ);
+  // HTTPより低遅延なUDPでの射撃判定も受け付ける
+  targets.begin_udp();
+  // センターが命中通知に対応している場合は、まとユニット側で命中を検出して通知する
+  //targets.begin_push(hal::IpAddress(192, 168, 100, 1));
+  // 受信状態が変わった時だけ演出処理を呼ぶ、LEDへの書き込みが変化時だけになる
+  targets.set_ir_edge_mode(true);
+#ifdef TARGETS_NETWORK_TASK
+  // HTTP/UDPの処理をコア0のタスクで行い、遅いクライアントがいてもloop()側を待たせない
+  // 受信は1ms毎に確認し、射撃判定を50ms以内にできなければセンターに503を返す
+  targets.begin_network_task(0, 1, 1, 50);
+#endif
 
   // 赤外線受光モジュールとの疎通確認が可能
   std::vector<int> error_target_ids = targets.get_error_targets();
@@ -94,21 +175,76 @@ void setup()
 
   // 動作の確認
   maintenance();
+  // 確認が終わってからサーボを動かし始める
+  begin_servos();
 
   init_lcd();
-  show_motor_value(motor_power);
-
-  send_to_xiao('r', 9);
+  show_motor_value();
+  status_panel_lcd.render();
+
+  // フレームで送る場合、届いたことまで確認するならuse_ackをtrueにする
+  xiao.begin(XIAO_FORMAT, false);
+  xiao.send('r', 9);
+
+  // loop()で周期的に行う処理を登録する
+  task_scheduler.add("targets", task_targets, PERIOD_TARGETS_US);
+#ifdef TARGETS_NETWORK_TASK
+  task_scheduler.add("field_requests", task_field_requests, PERIOD_FIELD_REQUESTS_US);
+#endif
+  task_scheduler.add("xiao", task_xiao, PERIOD_XIAO_US);
+  task_scheduler.add("buttons", task_buttons, PERIOD_BUTTONS_US);
+  task_scheduler.add("lcd", task_lcd, PERIOD_LCD_US);
+  task_scheduler.add("report", task_report, PERIOD_REPORT_US);
 }
 
 void loop()
 {
-  // M5Stack関係の更新処理、ボタンを使わないなら多分いらない
-  M5.update();
+  // 期限が来た処理を実行して、次の期限まで待つ
+  task_scheduler.run();
+}
+
+static void task_targets()
+{
+  // targets.update()の周期を記録する
+  unsigned long now_us = micros();
+  if (micros_targets_start != 0)
+  {
+    metrics::loop_period.record(now_us - micros_targets_start);
+  }
+  micros_targets_start = now_us;
+
   // まと関係の更新処理、ここでHTTPリクエストの処理をしたり、まとの演出処理をやっている
+  alloc_counter::Scope alloc_scope;
   targets.update();
+  // 演出処理でLEDに書き込んだ内容をまとめて送信する
+  animator.tick(millis());
+  ht16k33LED::Display::flush_all();
+#ifdef ALLOC_COUNTER
+  // 計測ビルドの時だけ、ヒープ確保が発生したtickを報告する
+  // (HTTPリクエストを受けたtickはWebServer内部でも確保が発生する)
+  if (alloc_scope.allocations() > 0)
+  {
+    DebugPrint("alloc: %u allocations in targets.update()", alloc_scope.allocations());
+  }
+#endif
+}
 
-  update_servos();
+// HTTP/UDP処理タスクを使う時だけ登録する、依頼が無ければすぐに戻る
+static void task_field_requests()
+{
+  targets.handle_field_requests();
+}
+
+// 演出用マイコンへの指示を1つずつ送る、命中時の処理はキューに積むだけなので射撃判定の応答を遅らせない
+static void task_xiao()
+{
+  xiao.update();
+}
+
+static void task_buttons()
+{
+  // M5Stack関係の更新処理、ボタンを使わないなら多分いらない
+  M5.update();
 
   int motor_power_diff = 10;
   if (M5.BtnA.isPressed())
@@ -125,22 +261,50 @@ void loop()
       motor_power += motor_power_diff;
     }
   }
-  update_motor(motor_power);
+  motor_controller.set_power(motor_power);
+}
 
+// 表示内容が変化したところだけLCDへ送る
+static void task_lcd()
+{
   show_reflector_values(top_reflector.value(), bottom_reflector.value());
+  show_motor_value();
+  show_target_values();
+  show_loop_values();
+  status_panel_lcd.render();
+}
 
-  delay(100);
+// 周期に間に合わなかった処理があれば報告する
+static void task_report()
+{
+  uint32_t overrun_count = task_scheduler.total_overrun_count();
+  if (overrun_count == reported_overrun_count)
+  {
+    return;
+  }
+  reported_overrun_count = overrun_count;
+  for (size_t i = 0; i < task_scheduler.task_num(); i++)
+  {
+    const scheduler::TaskStats &stats = task_scheduler.stats(i);
+    if (stats.overrun_count > 0)
+    {
+      DebugPrint("<WARN> task %s: overrun=%u/%u, max=%uus, period=%uus",
+                 stats.name, static_cast<unsigned>(stats.overrun_count), static_cast<unsigned>(stats.run_count),
+                 static_cast<unsigned>(stats.max_run_us), static_cast<unsigned>(stats.period_us));
+    }
+  }
 }
 
 // ゲーム開始毎の初期化処理、LED消したり、動きを元に戻したりを想定
 static void on_init()
 {
   DebugPrint("on_init() start");
+  animator.stop_all();
   clear_leds();
 }
 
 // 赤外線を受光した時の処理、引数で対象のまと番号(赤外線受光モジュールのロータリースイッチの値)がとれるので、まと毎に違う処理もできる
-// この関数はtargets.update()を呼ばれたタイミングで赤外線を受光していたら実行される
+// この関数はtargets.update()を呼ばれたタイミングで赤外線の受光を開始していたら実行される
 static void on_receive_ir(int target_id, bool is_alive)
 {
   if(is_alive){
@@ -149,7 +313,7 @@ static void on_receive_ir(int target_id, bool is_alive)
 }
 
 // 赤外線を受光していない時の処理、引数で対象のまと番号(赤外線受光モジュールのロータリースイッチの値)がとれるので、まと毎に違う処理もできる
-// この関数はtargets.update()を呼ばれたタイミングで赤外線を受光していなかったら実行される
+// この関数はtargets.update()を呼ばれたタイミングで赤外線の受光が終わっていたら実行される
 static void on_not_receive_ir(int target_id, bool is_alive)
 {
   if(is_alive){
@@ -162,13 +326,12 @@ static void on_hit(int target_id, int gun_id)
 {
   DebugPrint("on_hit() target_id=%d", target_id);
   ht16k33LED::Color color = gun_id2color(gun_id);
-  send_to_xiao('h', -1);
-  // LED点滅
-  leds[target_id].blink(color, 3, 300);
-  // 弾が一度当たったまとのLEDは点灯しっぱなしにしておく
-  leds[target_id].write_color(color);
-  if(targets.alive_target_num == 0){
-    send_to_xiao('e', 0);
+  xiao.send(xiao_link::PHASE_HIT);
+  // LED点滅、弾が一度当たったまとのLEDは点滅後も点灯しっぱなしにしておく
+  // HTTPのレスポンスを待たせないよう、点滅はloop()の中で進める
+  animator.blink(leds[target_id], color, 3, 300, color);
+  if(targets.get_alive_target_num() == 0){
+    xiao.send('e', 0);
   }
 }
 
@@ -191,124 +354,70 @@ static void init_lcd()
   lcd.init();
   lcd.setBrightness(100);
   lcd.clear();
-  return;
-}
 
-static void show_motor_value(int power)
-{
-  lcd.setCursor(10, 20);
-  lcd.printf("motor: power=%4d", power);
-  return;
-}
-
-static void update_motor(int motor_power)
-{
-  Direction direction = Direction::NOCHANGE;
-  if (bottom_reflector.is_close())
+  int width = lcd.width() - 10;
+  field_reflector = status_panel_lcd.add_field(10, 10, width);
+  field_motor = status_panel_lcd.add_field(10, 20, width);
+  field_targets = status_panel_lcd.add_field(10, 30, width);
+  field_loop = status_panel_lcd.add_field(10, 40, width);
+  if (!status_panel_lcd.begin())
   {
-    direction = Direction::UP;
-    if (top_reflector.is_close())
-    {
-      // 両方のフォトリフレクタが反応していたら念のためモータは止める
-      motor_power = 0;
-    }
+    DebugPrint("<ERROR> failed to create status panel sprites");
   }
-  else if (top_reflector.is_close())
-  {
-    direction = Direction::DOWN;
-  }
-  motor.set_power(motor_power, direction);
-  show_motor_value(motor_power);
+  return;
 }
 
-static void show_reflector_values(int top, int bottom)
+// 出力は加減速中の値、reactは端で反応してから反転・停止するまでの最大時間
+static void show_motor_value()
 {
-  lcd.setCursor(10, 10);
-  lcd.printf("photo reflector: top=%4d, bottom=%4d", top, bottom);
+  status_panel_lcd.set_text(field_motor, "motor: power=%4d/%4d, react=%uus",
+                            motor_controller.get_power(), motor_controller.get_target_power(),
+                            static_cast<unsigned>(motor_controller.max_reaction_us()));
   return;
 }
 
-static void clear_leds()
+static void show_target_values()
 {
-  for (auto &led : leds)
-  {
-    led.clear();
-  }
+  status_panel_lcd.set_text(field_targets, "targets: alive=%2d/%d, hits=%u",
+                            targets.get_alive_target_num(), TARGET_NUM,
+                            static_cast<unsigned>(metrics::hits.value()));
 }
 
-static ht16k33LED::Color gun_id2color(int gun_id)
+// targets.update()の周期と、周期に間に合わなかった処理の数
+static void show_loop_values()
 {
-  std::map<int, ht16k33LED::Color> dict{
-      {1, ht16k33LED::Color::red},
-      {2, ht16k33LED::Color::blue}};
-  try
-  {
-    return dict.at(gun_id);
-  }
-  catch (std::out_of_range &)
-  {
-  }
-  return ht16k33LED::Color::clear;
+  status_panel_lcd.set_text(field_loop, "loop: p50=%uus, p99=%uus, overrun=%u",
+                            static_cast<unsigned>(metrics::loop_period.quantile_us(0.5f)),
+                            static_cast<unsigned>(metrics::loop_period.quantile_us(0.99f)),
+                            static_cast<unsigned>(task_scheduler.total_overrun_count()));
 }
 
-static void update_servos()
+static void show_reflector_values(int top, int bottom)
 {
-  //update_rotation_servo(servo_pick, servo_pick_phase);
-  millis_nservo_angle_change[0] = update_normal_servo(servo_pick, millis_nservo_angle_change[0]);
-  millis_nservo_angle_change[1] = update_normal_servo(servo_volumes, millis_nservo_angle_change[1]);
+  status_panel_lcd.set_text(field_reflector, "photo reflector: top=%4d, bottom=%4d", top, bottom);
+  return;
 }
 
-/*
-static void update_rotation_servo(M5Servo &servo, RotationServoPhase &phase)
+static void clear_leds()
 {
-  unsigned long now = millis();
-  if (now > phase.millis_phase_change)
+  for (auto &led : leds)
   {
-    if (phase.is_reversing)
-    {
-      long interval = random(1000, 3001);
-      phase.millis_phase_change = now + interval;
-      phase.interval = interval;
-      int angle = static_cast<int>(random(-10, 11));
-      servo.write(angle);
-      DebugPrint("rotation servo angle: %d", angle);
-      phase.current_angle = angle;
-      phase.is_reversing = false;
-    }
-    else
-    {
-      phase.millis_phase_change = now + phase.interval;
-      servo.write(-phase.current_angle);
-      DebugPrint("rotation servo angle(reverse): %d", -phase.current_angle);
-      phase.current_angle *= -1;
-      phase.is_reversing = true;
-    }
+    led.clear();
   }
 }
-*/
 
-static long update_normal_servo(M5Servo &servo, long millis_angle_change)
+// サーボの動きはタイマで進めるので、ここでは動かし方を決めるだけ
+static void begin_servos()
 {
-  long next_millis_angle_change = millis_angle_change;
-  unsigned long now = millis();
-  if (now > millis_angle_change)
+  int pick = servo_trajectory.add(servo_pick);
+  int volumes = servo_trajectory.add(servo_volumes);
+  // 1~3秒毎にランダムな角度へ0.8秒かけて動かす
+  servo_trajectory.play_random(pick, -90, 90, 1000, 3000, 800);
+  servo_trajectory.play_random(volumes, -90, 90, 1000, 3000, 800);
+  // 回転サーボとして使う場合は、-10~10度のランダムな角度とその反対側を1~3秒毎に行き来させる
+  //servo_trajectory.play_oscillation(pick, 10, 1000, 3000, 300);
+  if (!servo_trajectory.begin())
   {
-    next_millis_angle_change = millis_angle_change + random(1000, 3001);
-    int angle = static_cast<int>(random(-90, 91));
-    servo.write(angle);
-    DebugPrint("normal servo angle: %d", angle)
+    DebugPrint("<ERROR> failed to begin servo trajectory");
   }
-  return next_millis_angle_change;
 }
-
-static void send_to_xiao(char phase, int pattern)
-{
-  Wire.beginTransmission(0x7D);
-  Wire.write(phase);
-  Wire.endTransmission();
-  if(pattern > 0 && pattern < 10){
-    Wire.beginTransmission(0x7D);
-    Wire.write(pattern + '0');
-    Wire.endTransmission();
-  }
-}
\ No newline at end of file
@@ -0,0 +1,238 @@
+/**
+ * @file test_main.cpp
+ * @brief 周期処理と射撃判定でヒープ確保が発生しないことのテスト、pio test -e native-test で実行する
+ *
+ * main.cppのtask_targets()と同じ処理(update()、演出、LEDの送信)と、射撃判定のハンドラを
+ * alloc_counter::Scopeで囲み、確保回数が0であることを確認する。
+ * 確保を数えるため、native-test環境はALLOC_COUNTERと-Wl,--wrap=mallocなどを指定してビルドする。
+ */
+
+#include <vector>
+#include <alloc_counter.hpp>
+#include <hal.hpp>
+#include <hal_sim.hpp>
+#include <ht16k33LED.hpp>
+#include <ht16k33Animator.hpp>
+#include <unity.h>
+#include "GunColor.hpp"
+#include "Targets.hpp"
+
+static void on_init();
+static void on_receive_ir(int target_id, bool is_alive);
+static void on_not_receive_ir(int target_id, bool is_alive);
+static void on_hit(int target_id, int gun_id);
+
+static constexpr int TARGET_NUM = 9;
+static constexpr int LED_PER_DISPLAY = 5;
+static constexpr uint16_t HTTP_PORT = 18180;
+// 1つのテストで繰り返す回数、演出の途中や全て倒した後の状態も通るようにする
+static constexpr int ITERATION_NUM = 200;
+
+static Targets targets(on_init, on_receive_ir, on_not_receive_ir, on_hit);
+static std::vector<ht16k33LED::Led> leds;
+static ht16k33LED::Animator animator;
+static hal::sim::IrReceiverDevice ir_devices[TARGET_NUM];
+static hal::sim::Ht16k33Device displays[(TARGET_NUM + LED_PER_DISPLAY - 1) / LED_PER_DISPLAY];
+
+/**
+ * @class NullTransport
+ * @brief 送った命中通知を全てすぐに確認応答したことにする
+ */
+class NullTransport : public HitTransport
+{
+public:
+  bool send(const shot_protocol::HitEvent *events, size_t count) override
+  {
+    if (count > 0)
+    {
+      _last_seq = events[count - 1].seq;
+      _has_ack = true;
+    }
+    return true;
+  }
+  bool poll_ack(uint32_t &acked_seq) override
+  {
+    if (!_has_ack)
+    {
+      return false;
+    }
+    acked_seq = _last_seq;
+    _has_ack = false;
+    return true;
+  }
+
+private:
+  uint32_t _last_seq = 0;
+  bool _has_ack = false;
+};
+
+static NullTransport null_transport;
+
+//! main.cppのtask_targets()と同じ処理
+static void tick(void)
+{
+  targets.update();
+  animator.tick(hal::millis());
+  ht16k33LED::Display::flush_all();
+}
+
+static void set_gun_num(int target_id, byte gun_num)
+{
+  ir_devices[target_id].set_gun_num(gun_num);
+}
+
+void setUp(void)
+{
+  hal::sim::dispatch_http(HTTP_PORT, "/init");
+  for (int i = 0; i < TARGET_NUM; i++)
+  {
+    set_gun_num(i, 0);
+  }
+  tick();
+}
+
+void tearDown(void)
+{
+}
+
+void test_counter_is_active(void)
+{
+  // 計測できていなければ、他のテストが確保を見逃して通ってしまう
+  alloc_counter::Scope scope;
+  int *volatile value = new int(1);
+  delete value;
+  TEST_ASSERT_GREATER_THAN(0, scope.allocations());
+}
+
+void test_update_does_not_allocate(void)
+{
+  alloc_counter::Scope scope;
+  for (int i = 0; i < ITERATION_NUM; i++)
+  {
+    // 受信の開始と終了を繰り返し、エッジモードの演出処理も通す
+    set_gun_num(i % TARGET_NUM, static_cast<byte>((i / TARGET_NUM) % 2 + 1));
+    tick();
+    hal::delay(10);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, scope.allocations());
+}
+
+void test_shot_handlers_do_not_allocate(void)
+{
+  for (int i = 0; i < TARGET_NUM; i++)
+  {
+    set_gun_num(i, 1);
+  }
+  tick();
+  alloc_counter::Scope scope;
+  for (int i = 0; i < ITERATION_NUM; i++)
+  {
+    // 全て倒した後は外れになるので、命中と外れの両方を通る
+    hal::sim::dispatch_http(HTTP_PORT, "/?gun_num=1");
+    hal::sim::dispatch_http(HTTP_PORT, "/?gun_num=2");
+    hal::sim::dispatch_http(HTTP_PORT, "/batch?guns=1,2,3");
+    if (i % (TARGET_NUM * 2) == 0)
+    {
+      hal::sim::dispatch_http(HTTP_PORT, "/init");
+    }
+    tick();
+    hal::delay(10);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, scope.allocations());
+}
+
+void test_display_flush_does_not_allocate(void)
+{
+  alloc_counter::Scope scope;
+  for (int i = 0; i < ITERATION_NUM; i++)
+  {
+    leds[i % TARGET_NUM].write_color(gun_id2color(i % 4));
+    ht16k33LED::Display::flush_all();
+  }
+  ht16k33LED::Display::get(ht16k33LED::Display::BASE_ADDRESS).set_brightness(8);
+  ht16k33LED::Display::get(ht16k33LED::Display::BASE_ADDRESS).set_blink_rate(ht16k33LED::BlinkRate::hz1);
+  ht16k33LED::Display::flush_all();
+  TEST_ASSERT_EQUAL_UINT32(0, scope.allocations());
+}
+
+void test_push_mode_does_not_allocate(void)
+{
+  targets.begin_push(null_transport);
+  alloc_counter::Scope scope;
+  for (int i = 0; i < ITERATION_NUM; i++)
+  {
+    set_gun_num(i % TARGET_NUM, (i % 3 == 0) ? 1 : 0);
+    if (i % (TARGET_NUM * 2) == 0)
+    {
+      hal::sim::dispatch_http(HTTP_PORT, "/init");
+    }
+    tick();
+    hal::delay(10);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, scope.allocations());
+}
+
+int main(void)
+{
+  hal::sim::set_real_time(false);
+  hal::sim::SimI2cBus &bus = hal::sim::bus(0);
+  for (int i = 0; i < TARGET_NUM; i++)
+  {
+    bus.attach(IrReceiver(static_cast<uint8_t>(i)).address(), ir_devices[i]);
+  }
+  for (size_t i = 0; i < sizeof(displays) / sizeof(displays[0]); i++)
+  {
+    bus.attach(ht16k33LED::Display::BASE_ADDRESS + i, displays[i]);
+  }
+  leds.reserve(TARGET_NUM);
+  for (int i = 0; i < TARGET_NUM; i++)
+  {
+    leds.push_back(ht16k33LED::Led(i % LED_PER_DISPLAY, ht16k33LED::Display::BASE_ADDRESS + i / LED_PER_DISPLAY));
+  }
+  targets.begin(0, TARGET_NUM, false, 0, HTTP_PORT);
+  targets.set_ir_edge_mode(true);
+  for (auto &led : leds)
+  {
+    led.init();
+  }
+
+  UNITY_BEGIN();
+  RUN_TEST(test_counter_is_active);
+  RUN_TEST(test_update_does_not_allocate);
+  RUN_TEST(test_shot_handlers_do_not_allocate);
+  RUN_TEST(test_display_flush_does_not_allocate);
+  RUN_TEST(test_push_mode_does_not_allocate);
+  return UNITY_END();
+}
+
+// 演出処理はmain.cppと同じ内容にする
+static void on_init()
+{
+  animator.stop_all();
+  for (auto &led : leds)
+  {
+    led.clear();
+  }
+}
+
+static void on_receive_ir(int target_id, bool is_alive)
+{
+  if (is_alive)
+  {
+    leds[target_id].write_color(ht16k33LED::red);
+  }
+}
+
+static void on_not_receive_ir(int target_id, bool is_alive)
+{
+  if (is_alive)
+  {
+    leds[target_id].clear();
+  }
+}
+
+static void on_hit(int target_id, int gun_id)
+{
+  ht16k33LED::Color color = gun_id2color(gun_id);
+  animator.blink(leds[target_id], color, 3, 300, color);
+}
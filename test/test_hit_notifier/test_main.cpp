@@ -0,0 +1,251 @@
+/**
+ * @file test_main.cpp
+ * @brief HitNotifierのテスト、pio test -e native-test で実行する
+ *
+ * 送ったバッチを記録し、決めておいた確認応答を返すHitTransportを使って、
+ * まとめて送る時間、送る順番、再送、一部だけの確認応答、溢れた時の破棄、seqの一周を確認する。
+ */
+
+#include <unity.h>
+#include "HitNotifier.hpp"
+
+static constexpr size_t CAPACITY = 4;
+static constexpr unsigned long BATCH_DELAY_MS = 10;
+static constexpr unsigned long RETRY_TIMEOUT_MS = 100;
+
+/**
+ * @class FakeTransport
+ * @brief 送られたバッチを順に記録し、ack()で積んだ確認応答を1つずつ返す
+ */
+class FakeTransport : public HitTransport
+{
+public:
+  static constexpr size_t MAX_BATCH_NUM = 16;
+  static constexpr size_t MAX_ACK_NUM = 8;
+
+  struct Batch
+  {
+    shot_protocol::HitEvent events[shot_protocol::MAX_HIT_EVENTS];
+    size_t count = 0;
+  };
+
+  bool send(const shot_protocol::HitEvent *events, size_t count) override
+  {
+    if (_batch_count < MAX_BATCH_NUM)
+    {
+      Batch &batch = _batches[_batch_count];
+      for (size_t i = 0; i < count; i++)
+      {
+        batch.events[i] = events[i];
+      }
+      batch.count = count;
+    }
+    _batch_count++;
+    return true;
+  }
+  bool poll_ack(uint32_t &acked_seq) override
+  {
+    if (_ack_head == _ack_count)
+    {
+      return false;
+    }
+    acked_seq = _acks[_ack_head++];
+    return true;
+  }
+  //! 次のpoll_ack()で返す確認応答を積む
+  void ack(uint32_t seq)
+  {
+    if (_ack_count < MAX_ACK_NUM)
+    {
+      _acks[_ack_count++] = seq;
+    }
+  }
+  size_t batch_count(void) const { return _batch_count; }
+  const Batch &batch(size_t index) const { return _batches[index]; }
+  void reset(void)
+  {
+    _batch_count = 0;
+    _ack_head = 0;
+    _ack_count = 0;
+  }
+
+private:
+  Batch _batches[MAX_BATCH_NUM];
+  size_t _batch_count = 0;
+  uint32_t _acks[MAX_ACK_NUM] = {};
+  size_t _ack_head = 0;
+  size_t _ack_count = 0;
+};
+
+static FakeTransport transport;
+static HitNotifier<CAPACITY> notifier;
+
+void setUp(void)
+{
+  transport.reset();
+  notifier = HitNotifier<CAPACITY>();
+  notifier.set_transport(&transport);
+  notifier.set_batch_delay(BATCH_DELAY_MS);
+  notifier.set_retry_timeout(RETRY_TIMEOUT_MS);
+}
+
+void tearDown(void)
+{
+}
+
+void test_batches_in_detection_order(void)
+{
+  notifier.push(3, 1, 1000);
+  notifier.push(5, 2, 1002);
+  notifier.push(1, 3, 1004);
+  // 最初のイベントからBATCH_DELAY_MS経つまでは送らずに待つ
+  notifier.update(1000 + BATCH_DELAY_MS - 1);
+  TEST_ASSERT_EQUAL(0, transport.batch_count());
+  notifier.update(1000 + BATCH_DELAY_MS);
+  TEST_ASSERT_EQUAL(1, transport.batch_count());
+
+  const FakeTransport::Batch &batch = transport.batch(0);
+  const uint8_t target_ids[] = {3, 5, 1};
+  TEST_ASSERT_EQUAL(3, batch.count);
+  for (size_t i = 0; i < batch.count; i++)
+  {
+    TEST_ASSERT_EQUAL(i + 1, batch.events[i].seq);
+    TEST_ASSERT_EQUAL(target_ids[i], batch.events[i].target_id);
+    TEST_ASSERT_EQUAL(i + 1, batch.events[i].gun_num);
+    TEST_ASSERT_EQUAL(1000 + 2 * i, batch.events[i].detected_ms);
+  }
+
+  transport.ack(3);
+  notifier.update(1020);
+  TEST_ASSERT_EQUAL(0, notifier.pending());
+  TEST_ASSERT_EQUAL(1, transport.batch_count());
+}
+
+void test_resend_after_retry_timeout(void)
+{
+  notifier.push(0, 1, 0);
+  notifier.update(BATCH_DELAY_MS);
+  TEST_ASSERT_EQUAL(1, transport.batch_count());
+  // 確認応答待ちの間は、タイムアウトするまで送り直さない
+  notifier.update(BATCH_DELAY_MS + RETRY_TIMEOUT_MS - 1);
+  TEST_ASSERT_EQUAL(1, transport.batch_count());
+  notifier.update(BATCH_DELAY_MS + RETRY_TIMEOUT_MS);
+  TEST_ASSERT_EQUAL(2, transport.batch_count());
+  TEST_ASSERT_EQUAL(1, notifier.retry_count());
+  TEST_ASSERT_EQUAL(1, transport.batch(1).count);
+  TEST_ASSERT_EQUAL(1, transport.batch(1).events[0].seq);
+
+  transport.ack(1);
+  notifier.update(BATCH_DELAY_MS + 2 * RETRY_TIMEOUT_MS);
+  TEST_ASSERT_EQUAL(0, notifier.pending());
+  TEST_ASSERT_EQUAL(2, transport.batch_count());
+}
+
+void test_partial_ack_resends_rest(void)
+{
+  notifier.push(0, 1, 0);
+  notifier.push(1, 2, 0);
+  notifier.push(2, 3, 0);
+  notifier.update(BATCH_DELAY_MS);
+  TEST_ASSERT_EQUAL(3, transport.batch(0).count);
+
+  // 先頭の2つだけ届いた
+  transport.ack(2);
+  notifier.update(BATCH_DELAY_MS + 1);
+  TEST_ASSERT_EQUAL(1, notifier.pending());
+  // 確認応答待ちの間に増えたイベントは、残りが確認されるまで送らない
+  notifier.push(3, 4, BATCH_DELAY_MS + 1);
+  notifier.update(BATCH_DELAY_MS + 1 + BATCH_DELAY_MS);
+  TEST_ASSERT_EQUAL(1, transport.batch_count());
+
+  notifier.update(BATCH_DELAY_MS + RETRY_TIMEOUT_MS);
+  TEST_ASSERT_EQUAL(2, transport.batch_count());
+  TEST_ASSERT_EQUAL(1, transport.batch(1).count);
+  TEST_ASSERT_EQUAL(3, transport.batch(1).events[0].seq);
+
+  transport.ack(3);
+  notifier.update(BATCH_DELAY_MS + RETRY_TIMEOUT_MS + 1);
+  TEST_ASSERT_EQUAL(3, transport.batch_count());
+  TEST_ASSERT_EQUAL(1, transport.batch(2).count);
+  TEST_ASSERT_EQUAL(4, transport.batch(2).events[0].seq);
+}
+
+void test_overflow_drops_oldest(void)
+{
+  for (uint8_t i = 0; i < CAPACITY; i++)
+  {
+    TEST_ASSERT_TRUE(notifier.push(i, 1, 0));
+  }
+  TEST_ASSERT_FALSE(notifier.push(CAPACITY, 1, 0));
+  TEST_ASSERT_EQUAL(1, notifier.dropped_count());
+  TEST_ASSERT_EQUAL(CAPACITY, notifier.pending());
+
+  notifier.update(BATCH_DELAY_MS);
+  const FakeTransport::Batch &batch = transport.batch(0);
+  TEST_ASSERT_EQUAL(CAPACITY, batch.count);
+  for (size_t i = 0; i < batch.count; i++)
+  {
+    // 一番古いseq 1が捨てられ、残りは順番通り
+    TEST_ASSERT_EQUAL(i + 2, batch.events[i].seq);
+    TEST_ASSERT_EQUAL(i + 1, batch.events[i].target_id);
+  }
+}
+
+void test_overflow_while_inflight(void)
+{
+  notifier.push(0, 1, 0);
+  notifier.push(1, 1, 0);
+  notifier.update(BATCH_DELAY_MS);
+  for (uint8_t i = 2; i < CAPACITY + 1; i++)
+  {
+    notifier.push(i, 1, BATCH_DELAY_MS);
+  }
+  // 送信中の先頭が捨てられても、残りの送信中のイベントの確認応答は受け付ける
+  TEST_ASSERT_EQUAL(1, notifier.dropped_count());
+  transport.ack(2);
+  notifier.update(BATCH_DELAY_MS + 1);
+  TEST_ASSERT_EQUAL(CAPACITY - 1, notifier.pending());
+  // 残りは、その先頭を検出してからBATCH_DELAY_MS後にまとめて送る
+  notifier.update(2 * BATCH_DELAY_MS);
+  TEST_ASSERT_EQUAL(2, transport.batch_count());
+  TEST_ASSERT_EQUAL(CAPACITY - 1, transport.batch(1).count);
+  TEST_ASSERT_EQUAL(3, transport.batch(1).events[0].seq);
+}
+
+void test_seq_wraparound(void)
+{
+  notifier.set_next_seq(0xFFFFFFFE);
+  notifier.push(0, 1, 0);
+  notifier.push(1, 1, 0);
+  notifier.push(2, 1, 0);
+  notifier.update(BATCH_DELAY_MS);
+  const FakeTransport::Batch &batch = transport.batch(0);
+  TEST_ASSERT_EQUAL(3, batch.count);
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFE, batch.events[0].seq);
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFF, batch.events[1].seq);
+  TEST_ASSERT_EQUAL_UINT32(0, batch.events[2].seq);
+
+  // 一周する前のseqの確認応答では、一周した後のイベントを消さない
+  transport.ack(0xFFFFFFFF);
+  notifier.update(BATCH_DELAY_MS + 1);
+  TEST_ASSERT_EQUAL(1, notifier.pending());
+  // 古い確認応答が遅れて届いても何も消さない
+  transport.ack(0xFFFFFFFE);
+  notifier.update(BATCH_DELAY_MS + 2);
+  TEST_ASSERT_EQUAL(1, notifier.pending());
+  transport.ack(0);
+  notifier.update(BATCH_DELAY_MS + 3);
+  TEST_ASSERT_EQUAL(0, notifier.pending());
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_batches_in_detection_order);
+  RUN_TEST(test_resend_after_retry_timeout);
+  RUN_TEST(test_partial_ack_resends_rest);
+  RUN_TEST(test_overflow_drops_oldest);
+  RUN_TEST(test_overflow_while_inflight);
+  RUN_TEST(test_seq_wraparound);
+  return UNITY_END();
+}
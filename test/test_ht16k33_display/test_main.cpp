@@ -0,0 +1,199 @@
+/**
+ * @file test_main.cpp
+ * @brief HT16K33の明るさ・点滅コマンドのテスト、pio test -e native-test で実行する
+ *
+ * シミュレーションのHT16K33に届いたコマンドのバイトと、バスに流れたトランザクションの数を確認する。
+ */
+
+#include <hal_sim.hpp>
+#include <ht16k33LED.hpp>
+#include <unity.h>
+
+// テストに使うHT16K33のアドレス
+static constexpr uint8_t ADDRESS = 0x72;
+// begin()の時に応答しないHT16K33のアドレス
+static constexpr uint8_t NACK_ADDRESS = 0x73;
+
+/**
+ * @class RecordingHt16k33Device
+ * @brief 受け取ったコマンドを順に覚えておくHT16K33
+ */
+class RecordingHt16k33Device : public hal::sim::Ht16k33Device
+{
+public:
+  static constexpr size_t MAX_COMMAND_NUM = 16;
+
+  bool on_write(const uint8_t *data, size_t length) override
+  {
+    if (length > 0 && data[0] >= RAM_SIZE && _command_count < MAX_COMMAND_NUM)
+    {
+      _commands[_command_count++] = data[0];
+    }
+    return hal::sim::Ht16k33Device::on_write(data, length);
+  }
+  size_t command_count(void) const { return _command_count; }
+  uint8_t command(size_t index) const { return _commands[index]; }
+
+private:
+  uint8_t _commands[MAX_COMMAND_NUM] = {};
+  size_t _command_count = 0;
+};
+
+static hal::sim::Ht16k33Device device;
+static RecordingHt16k33Device nack_device;
+
+static ht16k33LED::Display &display(void)
+{
+  return ht16k33LED::Display::get(ADDRESS);
+}
+
+//! バス0に流れたトランザクションの数
+static uint64_t transactions(void)
+{
+  return hal::sim::bus(0).stats().transactions;
+}
+
+void setUp(void)
+{
+  hal::sim::bus(0).attach(ADDRESS, device);
+  display().begin();
+  // 前のテストの設定を戻しておく
+  display().set_blink_rate(ht16k33LED::BlinkRate::off);
+  display().set_brightness(1);
+  display().flush();
+}
+
+void tearDown(void)
+{
+}
+
+void test_begin_sends_default_settings(void)
+{
+  TEST_ASSERT_TRUE(display().is_initialized());
+  TEST_ASSERT_FALSE(display().is_dirty());
+  TEST_ASSERT_TRUE(display().blink_rate() == ht16k33LED::BlinkRate::off);
+  TEST_ASSERT_EQUAL(1, display().brightness());
+}
+
+void test_blink_rate_commands(void)
+{
+  const ht16k33LED::BlinkRate rates[] = {ht16k33LED::BlinkRate::hz2, ht16k33LED::BlinkRate::hz1,
+                                         ht16k33LED::BlinkRate::hz0_5, ht16k33LED::BlinkRate::off};
+  const uint8_t commands[] = {0x83, 0x85, 0x87, 0x81};
+  for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+  {
+    display().set_blink_rate(rates[i]);
+    TEST_ASSERT_TRUE(display().is_dirty());
+    uint64_t before = transactions();
+    display().flush();
+    TEST_ASSERT_EQUAL(1, transactions() - before);
+    TEST_ASSERT_EQUAL_HEX8(commands[i], device.last_command());
+  }
+}
+
+void test_brightness_commands(void)
+{
+  for (uint8_t level = 0; level <= 15; level++)
+  {
+    if (level == display().brightness())
+    {
+      continue;
+    }
+    display().set_brightness(level);
+    uint64_t before = transactions();
+    display().flush();
+    TEST_ASSERT_EQUAL(1, transactions() - before);
+    TEST_ASSERT_EQUAL_HEX8(0xE0 | level, device.last_command());
+  }
+  // 15を超える値は15として送る
+  display().set_brightness(3);
+  display().flush();
+  display().set_brightness(200);
+  display().flush();
+  TEST_ASSERT_EQUAL_HEX8(0xEF, device.last_command());
+}
+
+void test_unchanged_settings_send_nothing(void)
+{
+  display().set_blink_rate(ht16k33LED::BlinkRate::hz1);
+  display().set_brightness(8);
+  display().flush();
+  uint64_t before = transactions();
+  display().set_blink_rate(ht16k33LED::BlinkRate::hz1);
+  display().set_brightness(8);
+  TEST_ASSERT_FALSE(display().is_dirty());
+  display().flush();
+  TEST_ASSERT_EQUAL(0, transactions() - before);
+}
+
+void test_changed_then_restored_settings_send_nothing(void)
+{
+  // flush()の前に元の値に戻した場合も、送信済みの値と同じなので送らない
+  uint64_t before = transactions();
+  display().set_brightness(9);
+  display().set_brightness(1);
+  display().set_blink_rate(ht16k33LED::BlinkRate::hz2);
+  display().set_blink_rate(ht16k33LED::BlinkRate::off);
+  display().flush();
+  TEST_ASSERT_EQUAL(0, transactions() - before);
+}
+
+void test_led_group_sends_one_command(void)
+{
+  ht16k33LED::Led leds[] = {ht16k33LED::Led(0, ADDRESS), ht16k33LED::Led(1, ADDRESS), ht16k33LED::Led(2, ADDRESS)};
+  ht16k33LED::LedGroup group(ADDRESS);
+  for (auto &led : leds)
+  {
+    TEST_ASSERT_TRUE(group.add(led));
+  }
+  uint64_t before = transactions();
+  group.set_blink_rate(ht16k33LED::BlinkRate::hz2);
+  group.flush();
+  TEST_ASSERT_EQUAL(1, transactions() - before);
+  TEST_ASSERT_EQUAL_HEX8(0x83, device.last_command());
+  before = transactions();
+  group.set_brightness(12);
+  group.flush();
+  TEST_ASSERT_EQUAL(1, transactions() - before);
+  TEST_ASSERT_EQUAL_HEX8(0xEC, device.last_command());
+}
+
+void test_nack_at_begin_is_retried(void)
+{
+  ht16k33LED::Display &nack_display = ht16k33LED::Display::get(NACK_ADDRESS);
+  // 電源投入直後などで応答が無い
+  hal::sim::bus(0).detach(NACK_ADDRESS);
+  nack_display.begin();
+  TEST_ASSERT_TRUE(nack_display.is_initialized());
+  TEST_ASSERT_TRUE(nack_display.is_dirty());
+  nack_display.flush();
+  TEST_ASSERT_TRUE(nack_display.is_dirty());
+
+  // 応答するようになったら、オシレータON、点滅、明るさ、RAMの順に全て送り直す
+  hal::sim::bus(0).attach(NACK_ADDRESS, nack_device);
+  nack_display.flush();
+  TEST_ASSERT_FALSE(nack_display.is_dirty());
+  TEST_ASSERT_EQUAL(3, nack_device.command_count());
+  TEST_ASSERT_EQUAL_HEX8(0x21, nack_device.command(0));
+  TEST_ASSERT_EQUAL_HEX8(0x81, nack_device.command(1));
+  TEST_ASSERT_EQUAL_HEX8(0xE1, nack_device.command(2));
+  TEST_ASSERT_EQUAL(1, nack_device.ram_write_count());
+
+  // 送り直した後は、変化が無ければ何も送らない
+  uint64_t before = transactions();
+  nack_display.flush();
+  TEST_ASSERT_EQUAL(0, transactions() - before);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_sends_default_settings);
+  RUN_TEST(test_blink_rate_commands);
+  RUN_TEST(test_brightness_commands);
+  RUN_TEST(test_unchanged_settings_send_nothing);
+  RUN_TEST(test_changed_then_restored_settings_send_nothing);
+  RUN_TEST(test_led_group_sends_one_command);
+  RUN_TEST(test_nack_at_begin_is_retried);
+  return UNITY_END();
+}
@@ -0,0 +1,191 @@
+/**
+ * @file test_main.cpp
+ * @brief フォトリフレクタのフィルタと接近判定のテスト、pio test -e native-test で実行する
+ *
+ * hal::sim::set_adc()でADCの値を1サンプルずつ設定してsample()を呼び、
+ * 中央値フィルタの出力と、接近中の判定が閾値付近でばたつかないことを確認する。
+ */
+
+#include <hal.hpp>
+#include <hal_sim.hpp>
+#include <photo_reflector.hpp>
+#include <unity.h>
+
+// テストに使うピン
+static constexpr int PIN = 34;
+static constexpr int CLOSE_REF_VALUE = 3500;
+static constexpr int LEAVE_REF_VALUE = 3700;
+// 離れている時と接近している時の値
+static constexpr int FAR_VALUE = 4000;
+static constexpr int NEAR_VALUE = 3000;
+// 段差が入力されてから中央値が切り替わるまでのサンプル数
+static constexpr size_t STEP_DELAY = PhotoReflector::FILTER_SIZE / 2 + 1;
+
+/**
+ * @struct Replay
+ * @brief トレースを流した結果
+ */
+struct Replay
+{
+  static constexpr size_t MAX_SAMPLE_NUM = 64;
+  int values[MAX_SAMPLE_NUM]{};     // サンプル毎のvalue()
+  bool is_closes[MAX_SAMPLE_NUM]{}; // サンプル毎のis_close()
+  int toggle_count = 0;             // is_close()が変化した回数
+};
+
+/**
+ * @brief traceの値を順にADCに設定してsample()を呼ぶ
+ * @param reflector 読み取るフォトリフレクタ、set_sampled(true)にしておく
+ */
+static Replay replay(PhotoReflector &reflector, const int *trace, size_t size)
+{
+  Replay result;
+  bool is_close = reflector.is_close();
+  for (size_t i = 0; i < size && i < Replay::MAX_SAMPLE_NUM; i++)
+  {
+    hal::sim::set_adc(PIN, trace[i]);
+    reflector.sample();
+    result.values[i] = reflector.value();
+    result.is_closes[i] = reflector.is_close();
+    if (result.is_closes[i] != is_close)
+    {
+      result.toggle_count++;
+      is_close = result.is_closes[i];
+    }
+    // 変化した時刻が区別できるよう、時計を進めておく
+    hal::delay_microseconds(10);
+  }
+  return result;
+}
+
+//! 離れている状態で読み取りを始めたフォトリフレクタを作る
+static PhotoReflector &make_reflector(void)
+{
+  static PhotoReflector *reflector = nullptr;
+  delete reflector;
+  hal::sim::set_adc(PIN, FAR_VALUE);
+  reflector = new PhotoReflector(PIN, CLOSE_REF_VALUE, LEAVE_REF_VALUE);
+  reflector->set_sampled(true);
+  for (size_t i = 0; i < PhotoReflector::FILTER_SIZE; i++)
+  {
+    reflector->sample();
+  }
+  return *reflector;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_default_leave_value(void)
+{
+  // leave_ref_valueを省略するとclose_ref_value+200になる
+  hal::sim::set_adc(PIN, CLOSE_REF_VALUE + 100);
+  PhotoReflector reflector(PIN, CLOSE_REF_VALUE);
+  hal::sim::set_adc(PIN, CLOSE_REF_VALUE - 1);
+  TEST_ASSERT_TRUE(reflector.is_close());
+  hal::sim::set_adc(PIN, CLOSE_REF_VALUE + 200);
+  for (size_t i = 0; i < PhotoReflector::FILTER_SIZE; i++)
+  {
+    TEST_ASSERT_TRUE(reflector.is_close());
+  }
+  hal::sim::set_adc(PIN, CLOSE_REF_VALUE + 201);
+  for (size_t i = 0; i < PhotoReflector::FILTER_SIZE; i++)
+  {
+    reflector.is_close();
+  }
+  TEST_ASSERT_FALSE(reflector.is_close());
+}
+
+void test_single_spikes_are_rejected(void)
+{
+  PhotoReflector &reflector = make_reflector();
+  // 離れている間に、接近と誤判定しそうな単発のノイズが入る
+  const int trace[] = {4000, 0,    4010, 3990, 100,  4000, 4005, 0,    3995, 4000,
+                       200,  4000, 4010, 3990, 4000, 50,   4000, 4000, 3990, 0};
+  Replay result = replay(reflector, trace, sizeof(trace) / sizeof(trace[0]));
+  for (size_t i = 0; i < sizeof(trace) / sizeof(trace[0]); i++)
+  {
+    TEST_ASSERT_INT_WITHIN(10, FAR_VALUE, result.values[i]);
+    TEST_ASSERT_FALSE(result.is_closes[i]);
+  }
+  TEST_ASSERT_EQUAL(0, result.toggle_count);
+}
+
+void test_median_of_window(void)
+{
+  PhotoReflector &reflector = make_reflector();
+  const int trace[] = {3000, 3900, 3100, 3800, 3200};
+  Replay result = replay(reflector, trace, sizeof(trace) / sizeof(trace[0]));
+  // 直近5サンプルの中央値
+  const int expected[] = {4000, 4000, 3900, 3800, 3200};
+  for (size_t i = 0; i < sizeof(trace) / sizeof(trace[0]); i++)
+  {
+    TEST_ASSERT_EQUAL(expected[i], result.values[i]);
+  }
+}
+
+void test_step_toggles_once(void)
+{
+  PhotoReflector &reflector = make_reflector();
+  int trace[30];
+  for (size_t i = 0; i < 30; i++)
+  {
+    // 10サンプル離れて、10サンプル接近して、また離れる
+    trace[i] = (i >= 10 && i < 20) ? NEAR_VALUE : FAR_VALUE;
+  }
+  uint32_t before = reflector.close_changed_micros();
+  Replay result = replay(reflector, trace, 30);
+  for (size_t i = 0; i < 30; i++)
+  {
+    // 中央値の遅れだけ後にずれて切り替わる
+    bool is_near = (i >= 10 + STEP_DELAY - 1 && i < 20 + STEP_DELAY - 1);
+    TEST_ASSERT_EQUAL(is_near ? NEAR_VALUE : FAR_VALUE, result.values[i]);
+    TEST_ASSERT_EQUAL(is_near, result.is_closes[i]);
+  }
+  TEST_ASSERT_EQUAL(2, result.toggle_count);
+  TEST_ASSERT_NOT_EQUAL(before, reflector.close_changed_micros());
+}
+
+void test_noise_between_thresholds_does_not_chatter(void)
+{
+  PhotoReflector &reflector = make_reflector();
+  // 接近した後、close_ref_valueとleave_ref_valueの間を行き来する
+  const int trace[] = {3000, 3000, 3000, 3450, 3550, 3690, 3480, 3650, 3520, 3700,
+                       3490, 3600, 3510, 3680, 3460, 3700, 3550, 3620, 3505, 3690};
+  Replay result = replay(reflector, trace, sizeof(trace) / sizeof(trace[0]));
+  TEST_ASSERT_EQUAL(1, result.toggle_count);
+  uint32_t changed_micros = reflector.close_changed_micros();
+  for (size_t i = STEP_DELAY - 1; i < sizeof(trace) / sizeof(trace[0]); i++)
+  {
+    TEST_ASSERT_TRUE(result.is_closes[i]);
+    TEST_ASSERT_LESS_OR_EQUAL(LEAVE_REF_VALUE, result.values[i]);
+  }
+
+  // 離れた後、同じ範囲を行き来しても接近とはみなさない
+  const int leave_trace[] = {4000, 4000, 4000, 3690, 3510, 3650, 3500, 3700, 3520, 3600,
+                             3505, 3680, 3550, 3500, 3620};
+  result = replay(reflector, leave_trace, sizeof(leave_trace) / sizeof(leave_trace[0]));
+  TEST_ASSERT_EQUAL(1, result.toggle_count);
+  TEST_ASSERT_NOT_EQUAL(changed_micros, reflector.close_changed_micros());
+  for (size_t i = STEP_DELAY - 1; i < sizeof(leave_trace) / sizeof(leave_trace[0]); i++)
+  {
+    TEST_ASSERT_FALSE(result.is_closes[i]);
+    TEST_ASSERT_GREATER_OR_EQUAL(CLOSE_REF_VALUE, result.values[i]);
+  }
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_default_leave_value);
+  RUN_TEST(test_single_spikes_are_rejected);
+  RUN_TEST(test_median_of_window);
+  RUN_TEST(test_step_toggles_once);
+  RUN_TEST(test_noise_between_thresholds_does_not_chatter);
+  return UNITY_END();
+}
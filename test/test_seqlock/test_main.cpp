@@ -0,0 +1,125 @@
+/**
+ * @file test_main.cpp
+ * @brief Seqlockのテスト、pio test -e native-test で実行する
+ *
+ * 読み取りタスクとloop()の代わりに書き込みスレッドと読み出しスレッドを同時に動かし、
+ * try_read()が成功した時に書き込み途中の(フレームの混ざった)値が返らないことを確認する。
+ */
+
+#include <atomic>
+#include <thread>
+#include <unity.h>
+#include "Seqlock.hpp"
+#include "TargetBank.hpp"
+
+using Readings = TargetBank<16>::Readings;
+
+// 書き込むフレームの数
+static constexpr uint32_t FRAME_NUM = 200000;
+
+static Seqlock<Readings> seqlock;
+
+//! フレームkの値、全ての要素にkが入る
+static void fill_frame(Readings &readings, uint32_t k)
+{
+  readings.gun_nums.fill(static_cast<byte>(k));
+  readings.read_millis.fill(k);
+  readings.sweep_millis = k;
+}
+
+//! 全ての要素が同じフレームの値か
+static bool is_consistent(const Readings &readings)
+{
+  unsigned long k = readings.sweep_millis;
+  for (size_t i = 0; i < readings.gun_nums.size(); i++)
+  {
+    if (readings.read_millis[i] != k || readings.gun_nums[i] != static_cast<byte>(k))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_read_before_first_write(void)
+{
+  Seqlock<Readings> empty;
+  Readings out;
+  fill_frame(out, 7);
+  TEST_ASSERT_EQUAL(0, empty.version());
+  TEST_ASSERT_TRUE(empty.try_read(out));
+  TEST_ASSERT_EQUAL(0, out.sweep_millis);
+}
+
+void test_single_thread_round_trip(void)
+{
+  static Readings in;
+  static Readings out;
+  fill_frame(in, 42);
+  seqlock.write(in);
+  TEST_ASSERT_TRUE(seqlock.try_read(out));
+  TEST_ASSERT_EQUAL(42, out.sweep_millis);
+  TEST_ASSERT_TRUE(is_consistent(out));
+  TEST_ASSERT_EQUAL(1, seqlock.version());
+}
+
+void test_no_torn_frame_under_contention(void)
+{
+  std::atomic<bool> is_done{false};
+  std::thread writer([&is_done]() {
+    static Readings frame;
+    for (uint32_t k = 1; k <= FRAME_NUM; k++)
+    {
+      fill_frame(frame, k);
+      seqlock.write(frame);
+    }
+    is_done.store(true);
+  });
+
+  static Readings out;
+  uint32_t read_count = 0;
+  uint32_t torn_count = 0;
+  uint32_t reversed_count = 0;
+  unsigned long last_frame = 0;
+  while (!is_done.load())
+  {
+    if (!seqlock.try_read(out))
+    {
+      continue;
+    }
+    read_count++;
+    if (!is_consistent(out))
+    {
+      torn_count++;
+    }
+    if (out.sweep_millis < last_frame)
+    {
+      reversed_count++;
+    }
+    last_frame = out.sweep_millis;
+  }
+  writer.join();
+
+  TEST_ASSERT_GREATER_THAN(0, read_count);
+  TEST_ASSERT_EQUAL(0, torn_count);
+  TEST_ASSERT_EQUAL(0, reversed_count);
+  TEST_ASSERT_TRUE(seqlock.try_read(out));
+  TEST_ASSERT_EQUAL(FRAME_NUM, out.sweep_millis);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_read_before_first_write);
+  RUN_TEST(test_single_thread_round_trip);
+  RUN_TEST(test_no_torn_frame_under_contention);
+  return UNITY_END();
+}
@@ -0,0 +1,93 @@
+/**
+ * @file test_main.cpp
+ * @brief /initの後の射撃判定のテスト、pio test -e native-test で実行する
+ *
+ * 読み取りタスクを動かした状態で、/initより前に受信した赤外線が、
+ * タスクから受け取った古い走査結果に残っていても命中にならないことを確認する。
+ */
+
+#include <cstring>
+#include <hal.hpp>
+#include <hal_sim.hpp>
+#include <unity.h>
+#include "Targets.hpp"
+
+static constexpr int TARGET_NUM = 4;
+static constexpr uint16_t HTTP_PORT = 18181;
+static constexpr int POLL_RATE_HZ = 50;
+// 読み取りタスクが少なくとも1回は走査し終える時間[ms]
+static constexpr unsigned long POLL_WAIT_MS = 3 * 1000 / POLL_RATE_HZ;
+
+static void on_init() {}
+static void on_receive_ir(int, bool) {}
+static void on_not_receive_ir(int, bool) {}
+static void on_hit(int, int) {}
+
+static Targets targets(on_init, on_receive_ir, on_not_receive_ir, on_hit);
+static hal::sim::IrReceiverDevice ir_devices[TARGET_NUM];
+
+//! 銃gun_numで撃った時の応答の本文、応答が無ければ空文字列
+static const char *shoot(int gun_num)
+{
+  char target[32];
+  snprintf(target, sizeof(target), "/?gun_num=%d", gun_num);
+  const char *body = nullptr;
+  if (hal::sim::dispatch_http(HTTP_PORT, target, &body) != 200 || body == nullptr)
+  {
+    return "";
+  }
+  return body;
+}
+
+void setUp(void)
+{
+  for (int i = 0; i < TARGET_NUM; i++)
+  {
+    ir_devices[i].set_gun_num(0);
+  }
+  hal::delay(POLL_WAIT_MS);
+  hal::sim::dispatch_http(HTTP_PORT, "/init");
+  targets.update();
+}
+
+void tearDown(void)
+{
+}
+
+void test_pulse_before_init_is_not_hit(void)
+{
+  // 銃1の赤外線を受信してから止め、その走査結果をloop()側に取り込んでおく
+  ir_devices[0].set_gun_num(1);
+  hal::delay(POLL_WAIT_MS);
+  ir_devices[0].set_gun_num(0);
+  targets.update();
+  TEST_ASSERT_EQUAL(1, targets.get_snapshot(0).gun_num);
+
+  // 受信はまだ判定の時間内なので、/initの直後に撃つと古い走査結果に受信が残っている
+  hal::sim::dispatch_http(HTTP_PORT, "/init");
+  TEST_ASSERT_EQUAL_STRING("target=0", shoot(1));
+  TEST_ASSERT_EQUAL(TARGET_NUM, Targets::get_alive_target_num());
+}
+
+void test_pulse_after_init_is_hit(void)
+{
+  ir_devices[2].set_gun_num(3);
+  hal::delay(POLL_WAIT_MS);
+  TEST_ASSERT_EQUAL_STRING("target=3", shoot(3));
+  TEST_ASSERT_EQUAL(TARGET_NUM - 1, Targets::get_alive_target_num());
+}
+
+int main(void)
+{
+  hal::sim::SimI2cBus &bus = hal::sim::bus(0);
+  for (int i = 0; i < TARGET_NUM; i++)
+  {
+    bus.attach(IrReceiver(static_cast<uint8_t>(i)).address(), ir_devices[i]);
+  }
+  targets.begin(0, TARGET_NUM, false, POLL_RATE_HZ, HTTP_PORT);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_pulse_before_init_is_not_hit);
+  RUN_TEST(test_pulse_after_init_is_hit);
+  return UNITY_END();
+}
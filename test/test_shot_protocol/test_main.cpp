@@ -0,0 +1,257 @@
+/**
+ * @file test_main.cpp
+ * @brief UDPの射撃判定プロトコルと再送判定のテスト、pio test -e native-test で実行する
+ *
+ * 要求と応答のエンコード・デコードを確認した後、TargetServerのUDP待ち受けに
+ * ループバックで要求を送り、再送された要求に判定し直さずに同じ応答を返すことを確認する。
+ */
+
+#include <memory>
+#include <hal.hpp>
+#include <unity.h>
+#include "ShotProtocol.hpp"
+#include "TargetServer.hpp"
+
+using namespace shot_protocol;
+
+static constexpr uint16_t HTTP_PORT = 18182;
+static constexpr uint16_t UDP_PORT = 15100;
+static constexpr uint16_t CLIENT_PORT = 15101;
+// 応答を待つ最大回数、1回あたり1ms
+static constexpr int RECEIVE_RETRY_NUM = 100;
+
+static TargetServer server(HTTP_PORT);
+static std::unique_ptr<hal::UdpSocket> client;
+// 要求を判定した回数
+static int judge_count = 0;
+
+//! 判定する度に違うまとに当たったことにする、再送を判定し直すと応答が変わる
+static bool on_udp_request(const Request &request, Reply &reply)
+{
+  judge_count++;
+  if (request.type == MessageType::init)
+  {
+    reply.type = MessageType::initialized;
+    return true;
+  }
+  reply.type = MessageType::result;
+  reply.gun_num = request.gun_num;
+  reply.target_id = static_cast<uint8_t>(judge_count);
+  return true;
+}
+
+/**
+ * @brief 要求を送ってサーバに処理させ、応答を受け取る
+ * @return bool true:応答を受け取った, false:応答が無かった
+ */
+static bool exchange(const Request &request, Reply &reply)
+{
+  Buffer buf = encode(request);
+  client->send_to(hal::IpAddress(127, 0, 0, 1), UDP_PORT, buf.data(), buf.size());
+  for (int i = 0; i < RECEIVE_RETRY_NUM; i++)
+  {
+    server.handle_client();
+    if (client->parse_packet() > 0)
+    {
+      uint8_t data[MESSAGE_SIZE + 1];
+      int length = client->read(data, sizeof(data));
+      return length > 0 && decode(data, static_cast<size_t>(length), reply);
+    }
+    hal::delay(1);
+  }
+  return false;
+}
+
+static Request shoot_request(uint32_t seq, uint8_t gun_num)
+{
+  Request request;
+  request.type = MessageType::shoot;
+  request.seq = seq;
+  request.timestamp_ms = 1000 + seq;
+  request.gun_num = gun_num;
+  return request;
+}
+
+void setUp(void)
+{
+  judge_count = 0;
+}
+
+void tearDown(void)
+{
+}
+
+void test_request_round_trip(void)
+{
+  Request request = shoot_request(0x12345678, 7);
+  request.timestamp_ms = 0xCAFEBABE;
+  Buffer buf = encode(request);
+  TEST_ASSERT_EQUAL(MESSAGE_SIZE, buf.size());
+  TEST_ASSERT_EQUAL('S', buf[0]);
+  TEST_ASSERT_EQUAL('G', buf[1]);
+  TEST_ASSERT_EQUAL(VERSION, buf[2]);
+  // 数値はリトルエンディアン
+  TEST_ASSERT_EQUAL_HEX8(0x78, buf[4]);
+  TEST_ASSERT_EQUAL_HEX8(0x12, buf[7]);
+
+  Request decoded;
+  TEST_ASSERT_TRUE(decode(buf.data(), buf.size(), decoded));
+  TEST_ASSERT_TRUE(decoded.type == MessageType::shoot);
+  TEST_ASSERT_EQUAL_UINT32(0x12345678, decoded.seq);
+  TEST_ASSERT_EQUAL_UINT32(0xCAFEBABE, decoded.timestamp_ms);
+  TEST_ASSERT_EQUAL(7, decoded.gun_num);
+}
+
+void test_reply_round_trip(void)
+{
+  Reply reply;
+  reply.seq = 42;
+  reply.timestamp_ms = 123456;
+  reply.gun_num = 3;
+  reply.target_id = 9;
+  Buffer buf = encode(reply);
+  Reply decoded;
+  TEST_ASSERT_TRUE(decode(buf.data(), buf.size(), decoded));
+  TEST_ASSERT_TRUE(decoded.type == MessageType::result);
+  TEST_ASSERT_EQUAL_UINT32(42, decoded.seq);
+  TEST_ASSERT_EQUAL_UINT32(123456, decoded.timestamp_ms);
+  TEST_ASSERT_EQUAL(3, decoded.gun_num);
+  TEST_ASSERT_EQUAL(9, decoded.target_id);
+  // 応答を要求として読むことはできない
+  Request request;
+  TEST_ASSERT_FALSE(decode(buf.data(), buf.size(), request));
+}
+
+void test_bad_header_is_rejected(void)
+{
+  Request decoded;
+  Buffer buf = encode(shoot_request(1, 1));
+  buf[0] = 'X';
+  TEST_ASSERT_FALSE(decode(buf.data(), buf.size(), decoded));
+
+  buf = encode(shoot_request(1, 1));
+  buf[2] = VERSION + 1;
+  TEST_ASSERT_FALSE(decode(buf.data(), buf.size(), decoded));
+
+  buf = encode(shoot_request(1, 1));
+  buf[3] = 0x7F;
+  TEST_ASSERT_FALSE(decode(buf.data(), buf.size(), decoded));
+
+  // 長さが違う
+  buf = encode(shoot_request(1, 1));
+  TEST_ASSERT_FALSE(decode(buf.data(), buf.size() - 1, decoded));
+}
+
+void test_hit_events_round_trip(void)
+{
+  HitEvent events[3];
+  for (size_t i = 0; i < 3; i++)
+  {
+    events[i].seq = 100 + i;
+    events[i].detected_ms = 5000 + i;
+    events[i].target_id = static_cast<uint8_t>(i * 2);
+    events[i].gun_num = static_cast<uint8_t>(i + 1);
+  }
+  HitEventsBuffer buf;
+  size_t length = encode_hit_events(events, 3, 4, 6000, buf);
+  TEST_ASSERT_EQUAL(HIT_EVENTS_HEADER_SIZE + 3 * HIT_EVENT_SIZE, length);
+
+  HitEvent decoded[MAX_HIT_EVENTS];
+  size_t count = 0;
+  uint8_t unit_id = 0;
+  TEST_ASSERT_TRUE(decode_hit_events(buf.data(), length, decoded, count, unit_id));
+  TEST_ASSERT_EQUAL(3, count);
+  TEST_ASSERT_EQUAL(4, unit_id);
+  for (size_t i = 0; i < count; i++)
+  {
+    TEST_ASSERT_EQUAL_UINT32(events[i].seq, decoded[i].seq);
+    TEST_ASSERT_EQUAL_UINT32(events[i].detected_ms, decoded[i].detected_ms);
+    TEST_ASSERT_EQUAL(events[i].target_id, decoded[i].target_id);
+    TEST_ASSERT_EQUAL(events[i].gun_num, decoded[i].gun_num);
+  }
+  // countと長さが合わない
+  TEST_ASSERT_FALSE(decode_hit_events(buf.data(), length - 1, decoded, count, unit_id));
+
+  Buffer ack = encode_hit_ack(102);
+  uint32_t acked_seq = 0;
+  TEST_ASSERT_TRUE(decode_hit_ack(ack.data(), ack.size(), acked_seq));
+  TEST_ASSERT_EQUAL_UINT32(102, acked_seq);
+}
+
+void test_duplicate_filter_forgets_oldest(void)
+{
+  DuplicateFilter<2> filter;
+  Reply reply;
+  for (uint32_t seq = 1; seq <= 3; seq++)
+  {
+    reply.seq = seq;
+    reply.target_id = static_cast<uint8_t>(seq * 10);
+    filter.remember(reply);
+  }
+  Reply found;
+  TEST_ASSERT_FALSE(filter.find(1, found));
+  TEST_ASSERT_TRUE(filter.find(3, found));
+  TEST_ASSERT_EQUAL(30, found.target_id);
+  filter.clear();
+  TEST_ASSERT_FALSE(filter.find(3, found));
+}
+
+void test_retransmitted_seq_returns_cached_reply(void)
+{
+  Reply first;
+  TEST_ASSERT_TRUE(exchange(shoot_request(7, 2), first));
+  TEST_ASSERT_EQUAL(1, judge_count);
+  TEST_ASSERT_EQUAL_UINT32(7, first.seq);
+  TEST_ASSERT_EQUAL_UINT32(1007, first.timestamp_ms);
+
+  // 応答が失われたとしてセンターが同じseqで送り直す
+  Reply second;
+  TEST_ASSERT_TRUE(exchange(shoot_request(7, 2), second));
+  TEST_ASSERT_EQUAL(1, judge_count);
+  TEST_ASSERT_EQUAL_UINT32(7, second.seq);
+  TEST_ASSERT_EQUAL(first.target_id, second.target_id);
+  TEST_ASSERT_EQUAL(first.gun_num, second.gun_num);
+
+  // 別のseqは判定する
+  Reply third;
+  TEST_ASSERT_TRUE(exchange(shoot_request(8, 2), third));
+  TEST_ASSERT_EQUAL(2, judge_count);
+  TEST_ASSERT_NOT_EQUAL(first.target_id, third.target_id);
+}
+
+void test_init_clears_filter(void)
+{
+  Reply reply;
+  TEST_ASSERT_TRUE(exchange(shoot_request(20, 1), reply));
+  uint8_t first_target_id = reply.target_id;
+
+  // センターが再起動してseqが巻き戻った
+  Request init;
+  init.type = MessageType::init;
+  init.seq = 1;
+  TEST_ASSERT_TRUE(exchange(init, reply));
+  TEST_ASSERT_TRUE(reply.type == MessageType::initialized);
+  TEST_ASSERT_EQUAL(2, judge_count);
+
+  // 初期化前と同じseqでも、新しい射撃として判定する
+  TEST_ASSERT_TRUE(exchange(shoot_request(20, 1), reply));
+  TEST_ASSERT_EQUAL(3, judge_count);
+  TEST_ASSERT_NOT_EQUAL(first_target_id, reply.target_id);
+}
+
+int main(void)
+{
+  server.begin_udp(on_udp_request, UDP_PORT);
+  client = hal::make_udp_socket();
+  client->begin(CLIENT_PORT);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_request_round_trip);
+  RUN_TEST(test_reply_round_trip);
+  RUN_TEST(test_bad_header_is_rejected);
+  RUN_TEST(test_hit_events_round_trip);
+  RUN_TEST(test_duplicate_filter_forgets_oldest);
+  RUN_TEST(test_retransmitted_seq_returns_cached_reply);
+  RUN_TEST(test_init_clears_filter);
+  return UNITY_END();
+}